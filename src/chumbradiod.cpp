@@ -20,13 +20,21 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <csignal>
 #include <iostream>
 #include <chumby_httpd/chumby_http_server.h>
 
 #include "crad_content_handler.h"
 #include "crad_crossdomain_handler.h"
+#include "crad_event_handler.h"
+#include "crad_file_handler.h"
+#include "crad_http_server.h"
+#include "crad_server_handler.h"
+#include "crad_status_sampler.h"
 #include "crad_interface.h"
+#include "crad_cache.h"
+#include "crad_job_manager.h"
 
 using namespace std;
 extern crad_t *p_crad;
@@ -34,6 +42,12 @@ extern crad_t *p_crad;
 /*! print program usage screen */
 static void show_usage();
 
+/*! register the Chumby Radio content handlers with the threaded server */
+static void add_content_handlers(chumby::HTTPServer *p_server);
+
+/*! register the Chumby Radio routes with the event driven server */
+static void add_routes(ChumbRadioHTTPServer *p_server);
+
 
 
 
@@ -48,12 +62,40 @@ static void sigterm_handler( int sig )
 /*! daemon program entry point */
 int main(int argc, char **argv) 
 {
-    /*! HTTP server instance */
+    /*! HTTP server instance (thread per connection) */
     chumby::HTTPServer *p_server = 0;
+
+    /*! HTTP server instance (event driven) */
+    ChumbRadioHTTPServer *p_reactor = 0;
     
     /*! port number for HTTP server */
     uint16_t port_number = 8081;
 
+    /*! spawn a thread per connection instead of using the reactor */
+    int threaded = 0;
+
+    /*! number of reactor dispatch threads */
+    int workers = CRAD_HTTP_DEFAULT_WORKERS;
+
+    /*! idle seconds before a persistent connection is closed */
+    int keepalive_timeout = CRAD_HTTP_KEEPALIVE_TIMEOUT;
+
+    /*! requests allowed to wait for a dispatch thread */
+    int queue_depth = CRAD_HTTP_DEFAULT_QUEUE_DEPTH;
+
+    /*! client connections allowed open at once, 0 to size it from the descriptor limit */
+    int max_connections = 0;
+
+    /*! ms between radio status samples while clients are active */
+    int sample_interval = CRAD_STATUS_SAMPLE_INTERVAL;
+
+    /*! RF scene for the simulated chip, NULL for the hardware */
+    const char *simulate = NULL;
+
+    /*! station cache, NULL for none; defaults to CRAD_DEFAULT_CACHE_PATH on the hardware */
+    const char *cache = NULL;
+    int cache_given = 0;
+
     /*! options for stdout */
     int print_usage = 0;
 
@@ -86,6 +128,76 @@ int main(int argc, char **argv)
                 }
                 break;
 
+                case 't':
+                    threaded = 1;
+                    break;
+
+                case 'w':
+                {
+                    /*! skip over to worker count */
+                    if(++cur_arg >= argc) { break; }
+
+                    sscanf(argv[cur_arg], "%d", &workers);
+                }
+                break;
+
+                case 'k':
+                {
+                    /*! skip over to keep-alive timeout */
+                    if(++cur_arg >= argc) { break; }
+
+                    sscanf(argv[cur_arg], "%d", &keepalive_timeout);
+                }
+                break;
+
+                case 'q':
+                {
+                    /*! skip over to queue depth */
+                    if(++cur_arg >= argc) { break; }
+
+                    sscanf(argv[cur_arg], "%d", &queue_depth);
+                }
+                break;
+
+                case 'c':
+                {
+                    /*! skip over to connection limit */
+                    if(++cur_arg >= argc) { break; }
+
+                    sscanf(argv[cur_arg], "%d", &max_connections);
+                }
+                break;
+
+                case 's':
+                {
+                    /*! skip over to sample interval */
+                    if(++cur_arg >= argc) { break; }
+
+                    sscanf(argv[cur_arg], "%d", &sample_interval);
+                }
+                break;
+
+                case 'm':
+                {
+                    /*! skip over to scene file */
+                    if(++cur_arg >= argc) { break; }
+
+                    /*! "-" selects the built-in scene */
+                    simulate = strcmp(argv[cur_arg], "-") ? argv[cur_arg] : "";
+                }
+                break;
+
+                case 'f':
+                {
+                    /*! skip over to cache file */
+                    if(++cur_arg >= argc) { break; }
+
+                    /*! "-" turns the cache off */
+                    cache = strcmp(argv[cur_arg], "-") ? argv[cur_arg] : NULL;
+                    cache_given = 1;
+                }
+                break;
+
                 case '-':
                     print_usage = 1;
                     break;
@@ -107,7 +219,15 @@ int main(int argc, char **argv)
 
     /*! create chumby radio interface instance */
     if(!p_crad) {
-        crad_info_t crad_info = { 0 };
+        crad_info_t crad_info;
+
+        memset(&crad_info, 0, sizeof(crad_info));
+
+        crad_info.simulate = simulate;
+        crad_info.async = 1;
+
+        /*! a simulated scene's stations don't belong in the device's cache */
+        crad_info.cache = (cache_given || simulate != NULL) ? cache : CRAD_DEFAULT_CACHE_PATH;
 
         int ret = crad_create(&crad_info, &p_crad);
 
@@ -118,18 +238,37 @@ int main(int argc, char **argv)
         }
     }
 
+    ChumbRadioStatusSampler::instance()->setInterval(sample_interval);
 
-    p_server = new chumby::HTTPServer(port_number, 1);
+    /*! the list is from the last run, or empty; fill it in without holding up the server */
+    if(p_crad->stations_stale)
+    {
+        ChumbRadioJobManager::instance()->submit(CRAD_JOB_RESCAN);
+    }
 
-    if(p_server == 0) { goto cleanup; }
 
-    p_server->addContentHandler(new chumby::HTTPSimpleFileContentHandler("/", "/usr/widgets/chumbradiod.html", "text/html"));
-    p_server->addContentHandler(new chumby::HTTPSimpleFileContentHandler("/m.swf", "/usr/widgets/chumbradiod.swf", "application/x-shockwave-flash"));
-    p_server->addContentHandler(new chumby::HTTPSimpleFileContentHandler("/user", "/mnt/usb/chumbradiod.html", "text/html"));
-    p_server->addContentHandler(new chumby::HTTPSimpleFileContentHandler("/user/m.swf", "/mnt/usb/chumbradiod.swf", "application/x-shockwave-flash"));
-    p_server->addContentHandler(new ChumbRadioContentHandler());
-    p_server->addContentHandler(new ChumbRadioCrossDomainHandler());
-    p_server->start();
+    if(threaded)
+    {
+        p_server = new chumby::HTTPServer(port_number, 1);
+
+        if(p_server == 0) { goto cleanup; }
+
+        add_content_handlers(p_server);
+        p_server->start();
+    }
+    else
+    {
+        p_reactor = new ChumbRadioHTTPServer(port_number, 1, workers);
+
+        if(p_reactor == 0) { goto cleanup; }
+
+        p_reactor->setKeepAliveTimeout(keepalive_timeout);
+        p_reactor->setQueueDepth(queue_depth);
+        if(max_connections > 0) { p_reactor->setMaxConnections(max_connections); }
+
+        add_routes(p_reactor);
+        p_reactor->start();
+    }
 
 cleanup:
 
@@ -140,14 +279,52 @@ cleanup:
         p_server = 0;
     }
 
+    if(p_reactor != 0)
+    {
+        delete p_reactor;
+        p_reactor = 0;
+    }
+
     return 0;
 }
 
+static void add_content_handlers(chumby::HTTPServer *p_server)
+{
+    p_server->addContentHandler(new ChumbRadioFileHandler("/", "/usr/widgets/chumbradiod.html", "text/html"));
+    p_server->addContentHandler(new ChumbRadioFileHandler("/m.swf", "/usr/widgets/chumbradiod.swf", "application/x-shockwave-flash"));
+    p_server->addContentHandler(new ChumbRadioFileHandler("/user", "/mnt/usb/chumbradiod.html", "text/html"));
+    p_server->addContentHandler(new ChumbRadioFileHandler("/user/m.swf", "/mnt/usb/chumbradiod.swf", "application/x-shockwave-flash"));
+    p_server->addContentHandler(new ChumbRadioContentHandler());
+    p_server->addContentHandler(new ChumbRadioCrossDomainHandler());
+    p_server->addContentHandler(new ChumbRadioEventHandler());
+}
+
+static void add_routes(ChumbRadioHTTPServer *p_server)
+{
+    ChumbRadioContentHandler *radio = new ChumbRadioContentHandler();
+
+    p_server->addRoute("/", new ChumbRadioFileHandler("/", "/usr/widgets/chumbradiod.html", "text/html"));
+    p_server->addRoute("/m.swf", new ChumbRadioFileHandler("/m.swf", "/usr/widgets/chumbradiod.swf", "application/x-shockwave-flash"));
+    p_server->addRoute("/user", new ChumbRadioFileHandler("/user", "/mnt/usb/chumbradiod.html", "text/html"));
+    p_server->addRoute("/user/m.swf", new ChumbRadioFileHandler("/user/m.swf", "/mnt/usb/chumbradiod.swf", "application/x-shockwave-flash"));
+    p_server->addRoute(CRAD_URI_STATUS, radio);
+    p_server->addRoute(CRAD_URI_CONFIGURE, radio);
+    p_server->addRoute(CRAD_URI_SERVICE_START, radio);
+    p_server->addRoute(CRAD_URI_SERVICE_STOP, radio);
+    p_server->addRoute(CRAD_URI_SERVICE_STATUS, radio);
+    p_server->addPrefixRoute(CRAD_URI_JOBS, radio);
+    p_server->addRoute(CRAD_URI_CROSSDOMAIN, new ChumbRadioCrossDomainHandler());
+    p_server->addRoute(CRAD_URI_SERVER_STATUS, new ChumbRadioServerHandler(p_server));
+    p_server->addRoute(CRAD_URI_EVENTS, new ChumbRadioEventHandler());
+}
+
 static void show_usage()
 {
     printf("chumbradiod 1.0 [caustik@chumby.com]\n");
     printf("\n");
-    printf("Usage : chumbradiod [-p PORT]\n");
+    printf("Usage : chumbradiod [-p PORT] [-t] [-w WORKERS] [-k SECONDS]\n");
+    printf("                   [-q DEPTH] [-c CONNECTIONS] [-s MS] [-m SCENE]\n");
+    printf("                   [-f CACHE]\n");
     printf("\n");
     printf("Chumby Radio HTTP daemon\n");
     printf("\n");
@@ -157,6 +334,33 @@ static void show_usage()
     printf("\n");
     printf("    -p <PORT>   Serve using the specified port number\n");
     printf("\n");
+    printf("    -t          Spawn a thread per connection instead of using\n");
+    printf("                the event driven server\n");
+    printf("\n");
+    printf("    -w <COUNT>  Number of request dispatch threads (default %d)\n", CRAD_HTTP_DEFAULT_WORKERS);
+    printf("\n");
+    printf("    -k <SECS>   Close idle keep-alive connections after SECS\n");
+    printf("                seconds (default %d)\n", CRAD_HTTP_KEEPALIVE_TIMEOUT);
+    printf("\n");
+    printf("    -q <DEPTH>  Requests allowed to wait for a dispatch thread;\n");
+    printf("                more are answered 503 (default %d)\n", CRAD_HTTP_DEFAULT_QUEUE_DEPTH);
+    printf("\n");
+    printf("    -c <COUNT>  Connections allowed open at once, not counting event\n");
+    printf("                streams and waiting status polls; more are answered\n");
+    printf("                503 (default: the open file limit less %d, at most %d)\n", CRAD_HTTP_RESERVED_FDS, CRAD_HTTP_MAX_CONNECTIONS);
+    printf("\n");
+    printf("    -s <MS>     Milliseconds between radio status samples while\n");
+    printf("                clients are active (default %d)\n", CRAD_STATUS_SAMPLE_INTERVAL);
+    printf("\n");
+    printf("    -m <SCENE>  Run against a simulated radio chip playing the\n");
+    printf("                stations in the SCENE file, or a built-in\n");
+    printf("                scene if SCENE is -\n");
+    printf("\n");
+    printf("    -f <CACHE>  Start from the stations and calibration saved in\n");
+    printf("                CACHE, rescanning in the background, and save\n");
+    printf("                them there after every scan; - for none\n");
+    printf("                (default %s, none when simulating)\n", CRAD_DEFAULT_CACHE_PATH);
+    printf("\n");
     return;
 }
 
@@ -19,19 +19,19 @@
 */
 
 #include "crad_interface.h"
+#include "crad_bench.h"
 
 #include <ctype.h>
 #include <unistd.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 static void usage(char *s);
 static int debug = 0;
 
 extern "C" void dump_radio_registers(crad_t *p_crad);
 extern "C" void set_radio_led(crad_t *p_crad,int value);
-extern "C" int tune_radio(crad_t *p_crad, int station);
-extern "C" int seek_radio(crad_t *p_crad, int up, int strength);
 extern "C" void set_radio_volume(crad_t *p_crad,int volume);
 
 /*! dump current radio status XML */
@@ -50,8 +50,10 @@ int main(int argc, char **argv) {
     int strength = 20;
     int volume = -1;
     int led = -1;
+    char *benchmark = NULL;
+    const char *simulate = NULL;
 
-    while ((c=getopt(argc,argv,"p:t:Dhxuds:v:l:"))!=-1) {
+    while ((c=getopt(argc,argv,"p:t:Dhxuds:v:l:b:m:"))!=-1) {
         switch (c) {
             case 'p':
                 hiddev_path = optarg;
@@ -86,6 +88,12 @@ int main(int argc, char **argv) {
             case 'l':
                 sscanf(optarg,"%d",&led);
                 break;
+            case 'b':
+                benchmark = optarg;
+                break;
+            case 'm':
+                simulate = strcmp(optarg, "-") ? optarg : "";
+                break;
             case '?':
                 if (isprint(optopt))
                     fprintf(stderr,"Unknown option '-%c'.\n",optopt);
@@ -99,9 +107,18 @@ int main(int argc, char **argv) {
         }
     }
 
+    /*! benchmarks don't touch the radio */
+    if (benchmark) {
+        exit(crad_run_benchmark(benchmark));
+    }
+
     /*! create chumby radio interface instance */
     {
-        crad_info_t crad_info = { 0 };
+        crad_info_t crad_info;
+
+        memset(&crad_info, 0, sizeof(crad_info));
+
+        crad_info.simulate = simulate;
 
         int ret = crad_create(&crad_info, &p_crad);
 
@@ -125,11 +142,11 @@ int main(int argc, char **argv) {
 
     if (station>=87.5 && station<=108.0) {
         if (debug) dump_radio_registers(p_crad);
-        tune_radio(p_crad,station*100);
+        crad_tune_radio(p_crad,station);
         if (debug) dump_radio_registers(p_crad);
     } else if (seek) {
         if (debug) dump_radio_registers(p_crad);
-        seek_radio(p_crad,up,strength);
+        crad_seek_radio(p_crad,up?CRAD_SEEK_DIR_UP:CRAD_SEEK_DIR_DOWN,strength);
         if (debug) dump_radio_registers(p_crad);
     }
     if (volume>=0 && volume<=15) {
@@ -170,6 +187,8 @@ static void usage(char *s) {
         "\t-l <value> (set the LED color/behavior 0..7)\n"
         "\t-h (print this message)\n"
         "\t-D (turn on debug output)\n"
+        "\t-b <name> (run a benchmark and exit, \"list\" to list them)\n"
+        "\t-m <scene> (use a simulated radio chip, \"-\" for the built-in scene)\n"
     );
     return;
 }
@@ -0,0 +1,482 @@
+/*
+    crad_bench.cpp
+
+    This file is part of chumbyradio.
+    Copyright (c) Chumby Industries, 2009
+
+    chumbyradio is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    chumbyradio is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with chumbyradio; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/time.h>
+#include <pthread.h>
+#include <string>
+#include <chumby_httpd/chumby_http_request.h>
+#include "crad_bench.h"
+#include "crad_blob.h"
+#include "crad_format.h"
+#include "crad_http_request.h"
+#include "crad_scan.h"
+#include "qnsim.h"
+
+/*! a status poll as sent by the widget */
+static const char *sampleRequest =
+    "GET /radio/status.xml?nocache=1234567 HTTP/1.1\r\n"
+    "Host: localhost:8081\r\n"
+    "User-Agent: Shockwave Flash\r\n"
+    "Accept: */*\r\n"
+    "Accept-Encoding: gzip, deflate\r\n"
+    "Accept-Language: en-us\r\n"
+    "If-None-Match: \"1234567890\"\r\n"
+    "Referer: http://localhost:8081/m.swf\r\n"
+    "Connection: keep-alive\r\n"
+    "\r\n";
+
+/*! returns the current time, in seconds */
+static double now()
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+/*! utility function used to print one result line */
+static void report(const char *label, int iterations, double seconds)
+{
+    printf("  %-40s %10.0f req/s  (%.3f us/req)\n", label, iterations / seconds, seconds * 1000000.0 / iterations);
+}
+
+static int benchParser()
+{
+    const int iterations = 200000;
+    size_t length = strlen(sampleRequest);
+    double start;
+    int i, sink = 0;
+
+    printf("parser: %d x %lu byte request\n", iterations, (unsigned long)length);
+
+    /*! before: the library parser, fed a std::string copy of the request */
+    start = now();
+    for(i=0;i<iterations;i++)
+    {
+        std::string raw(sampleRequest, length);
+        chumby::HTTPRequest request(raw);
+
+        sink += request.getRequestURI().size();
+    }
+    report("chumby::HTTPRequest", iterations, now() - start);
+
+    /*! after: in place, whole request available */
+    start = now();
+    for(i=0;i<iterations;i++)
+    {
+        ChumbRadioRequest request;
+
+        sink += request.parse(sampleRequest, length);
+        sink += request.getPath().length + request.getHeader("if-none-match").length + request.keepAlive();
+    }
+    report("ChumbRadioRequest", iterations, now() - start);
+
+    /*! after: in place, request trickling in 16 bytes per read */
+    start = now();
+    for(i=0;i<iterations;i++)
+    {
+        ChumbRadioRequest request;
+        size_t got = 0;
+        long used = CRAD_HTTP_PARSE_INCOMPLETE;
+
+        while(used == CRAD_HTTP_PARSE_INCOMPLETE)
+        {
+            got = (got + 16 < length) ? got + 16 : length;
+            used = request.parse(sampleRequest, got);
+        }
+
+        sink += used + request.getPath().length + request.getHeader("if-none-match").length + request.keepAlive();
+    }
+    report("ChumbRadioRequest (16 byte reads)", iterations, now() - start);
+
+    return (sink == 0) ? 1 : 0;
+}
+
+/*! render a status document with a station list, as the sampler does */
+static void renderStatus(crad_buffer_t *buffer, int format, const crad_status_t *status, const crad_station_t *stations, int count)
+{
+    int s;
+
+    crad_format_begin(buffer, format, &crad_status_schema, status, CRAD_FIELDS_ALL, count);
+
+    for(s=0;s<count;s++)
+    {
+        crad_format_child(buffer, format, &crad_station_schema, &stations[s], s);
+    }
+
+    crad_format_end(buffer, format, &crad_status_schema, CRAD_FIELDS_ALL);
+}
+
+static int benchFormats()
+{
+    const int iterations = 100000;
+    crad_station_t stations[30];
+    crad_status_t status;
+    crad_buffer_t buffer;
+    int format, s, sink = 0;
+
+    /*! a typical status: tuned, RDS running, a band's worth of stations */
+    memset(&status, 0, sizeof(status));
+    status.generation = 1234567890;
+    status.found = 1;
+    status.tuned = 1;
+    status.channel = 10130;
+    status.stereo = 1;
+    status.signal = 112;
+    status.signal_max = 256;
+    status.seek_threshold_max = 255;
+    status.spacing = 200;
+    status.start = 8790;
+    status.stop = 10790;
+    status.band = "US";
+    status.rds = 1;
+    strcpy(status.callsign, "KFOG");
+    strcpy(status.program_service_name, "KFOG 104");
+    status.program_type_code = "Rock";
+    strcpy(status.radiotext[0], "Now playing: \"Song Title\" by The Artist & Friends");
+    status.julian_date = 55000;
+    status.hour_code = 18;
+    status.minute = 42;
+    status.localtime_hours = -8;
+
+    for(s=0;s<30;s++) { stations[s].freq = 8790 + s * 60; }
+
+    crad_buffer_init(&buffer);
+
+    printf("formats: %d renders, status with RDS and %d stations\n", iterations, 30);
+
+    for(format=0;format<CRAD_FORMAT_COUNT;format++)
+    {
+        ChumbRadioBlob *gzip;
+        double start, seconds;
+        char label[64];
+        int i;
+
+        start = now();
+        for(i=0;i<iterations;i++)
+        {
+            crad_buffer_clear(&buffer);
+            renderStatus(&buffer, format, &status, stations, 30);
+            sink += buffer.length;
+        }
+        seconds = now() - start;
+
+        gzip = ChumbRadioBlob::gzip(buffer.data, buffer.length, CRAD_GZIP_LEVEL_DYNAMIC);
+
+        snprintf(label, sizeof(label), "%s (%d bytes, %ld gzipped)", crad_format_name(format), buffer.length,
+                 (gzip != NULL) ? (long)gzip->getSize() : (long)buffer.length);
+        report(label, iterations, seconds);
+
+        if(gzip != NULL) { gzip->unref(); }
+    }
+
+    crad_buffer_free(&buffer);
+
+    return (sink == 0) ? 1 : 0;
+}
+
+/*! utility function used to print one driver operation against the simulated chip */
+static void reportDriver(const char *label, const struct timespec *virtualStart, double wallStart, UINT32 transfers)
+{
+    printf("  %-24s %10.1f ms radio time  %8.3f ms wall  %6lu transfers\n", label,
+           QND_Elapsed(virtualStart) / 1000.0, (now() - wallStart) * 1000.0, (unsigned long)(qnd_i2c_transfers - transfers));
+}
+
+/*! init, full-band scan, seek and tune against the built-in scene, on the virtual clock */
+static int benchScan()
+{
+    struct timespec virtualStart;
+    double wallStart;
+    UINT32 transfers;
+    UINT16 found;
+    int s, missed = 0, failed = 0;
+
+    QNS_DefaultScene();
+    QND_SetBus(&qns_bus);
+    QND_SetClock(&qnd_virtual_clock);
+
+    printf("scan: simulated QN8005, built-in scene, virtual clock\n");
+
+    QND_Now(&virtualStart); wallStart = now(); transfers = qnd_i2c_transfers;
+    QND_Init();
+    QND_SetSysMode(QND_MODE_FM|QND_MODE_RX);
+    QND_SetCountry(COUNTRY_USA);
+    reportDriver("init", &virtualStart, wallStart, transfers);
+
+    QND_Now(&virtualStart); wallStart = now(); transfers = qnd_i2c_transfers;
+    QND_RXSeekCHAll(QND_CH_START, QND_CH_STOP, QND_CH_STEP, 0, 1);
+    QND_WriteReg(REG_PD2, UNMUTE);
+    reportDriver("full-band scan", &virtualStart, wallStart, transfers);
+
+    /*! every station in the scene is on the US raster and above the noise */
+    for(s=0;QNS_GetStation(s)!=NULL;s++)
+    {
+        int c;
+
+        for(c=0;c<chCount && chList[c]!=QNS_GetStation(s)->freq;c++) { }
+        if(c == chCount) { missed++; }
+    }
+    if(missed || chCount != s)
+    {
+        printf("  scan found %d stations, expected %d (%d missed)\n", chCount, s, missed);
+        failed = 1;
+    }
+
+    QND_Now(&virtualStart); wallStart = now(); transfers = qnd_i2c_transfers;
+    found = QND_RXSeekCH(QND_CH_START, QND_CH_STOP, QND_CH_STEP, 0, 1);
+    reportDriver("seek up", &virtualStart, wallStart, transfers);
+
+    if(found != QNS_GetStation(0)->freq)
+    {
+        printf("  seek found %d, expected %d\n", found, QNS_GetStation(0)->freq);
+        failed = 1;
+    }
+
+    QND_Now(&virtualStart); wallStart = now(); transfers = qnd_i2c_transfers;
+    QND_TuneToCH(10130);
+    reportDriver("tune", &virtualStart, wallStart, transfers);
+
+    QND_SetClock(&qnd_real_clock);
+    QND_SetBus(&qnd_i2c_dev_bus);
+
+    return failed;
+}
+
+/*! a crowded band: a weak station beside a strong one, an adjacent pair, and two at the threshold */
+static void denseScene()
+{
+    static const qns_station_t scene[] =
+    {
+        {  8810, 54, 1, "", 0, "", "" },
+        {  8830, 38, 0, "", 0, "", "" },
+        {  9090, 24, 0, "", 0, "", "" },
+        {  9330, 23, 0, "", 0, "", "" },
+        {  9550, 40, 1, "", 0, "", "" },
+        {  9770, 52, 1, "", 0, "", "" },
+        { 10090, 46, 1, "", 0, "", "" },
+        { 10110, 50, 1, "", 0, "", "" },
+        { 10330, 28, 0, "", 0, "", "" },
+        { 10570, 44, 1, "", 0, "", "" },
+        { 10790, 33, 0, "", 0, "", "" },
+    };
+    unsigned int i;
+
+    QNS_Reset();
+    for(i=0;i<sizeof(scene)/sizeof(scene[0]);i++) { QNS_AddStation(&scene[i]); }
+}
+
+/*! total scan time and found stations for each strategy, against two scenes */
+static int benchStrategies()
+{
+    static const char *configs[] = { "seek", "coarse", "coarse+skip", "hardware", "hardware+skip" };
+    static const char *sceneNames[2] = { "built-in scene", "dense scene" };
+    struct timespec virtualStart;
+    double wallStart;
+    UINT32 transfers;
+    int failed = 0, n, c;
+
+    QND_SetBus(&qns_bus);
+    QND_SetClock(&qnd_virtual_clock);
+
+    printf("strategies: simulated QN8005, virtual clock\n");
+
+    for(n=0;n<2;n++)
+    {
+        printf("  %s\n", sceneNames[n]);
+
+        for(c=0;c<(int)(sizeof(configs)/sizeof(configs[0]));c++)
+        {
+            int strategy = crad_scan_lookup(configs[c]);
+            int s, missed = 0, extra, total;
+            crad_scan_t scan;
+
+            if(n == 0) { QNS_DefaultScene(); } else { denseScene(); }
+
+            QND_Init();
+            QND_SetSysMode(QND_MODE_FM|QND_MODE_RX);
+            QND_SetCountry(COUNTRY_USA);
+
+            QND_Now(&virtualStart); wallStart = now(); transfers = qnd_i2c_transfers;
+            crad_scan_begin(&scan, strategy, 0);
+            while(crad_scan_step(&scan)) { }
+            crad_scan_end(&scan);
+
+            for(s=0;QNS_GetStation(s)!=NULL;s++)
+            {
+                int i;
+
+                for(i=0;i<scan.count && scan.channels[i]!=QNS_GetStation(s)->freq;i++) { }
+                if(i == scan.count) { missed++; }
+            }
+            total = s;
+            extra = scan.count - (total - missed);
+
+            printf("    %-14s %8.1f ms radio time  %8.3f ms wall  %5lu transfers  %3d tests  %2d/%d found  %d false\n",
+                   configs[c], QND_Elapsed(&virtualStart) / 1000.0, (now() - wallStart) * 1000.0,
+                   (unsigned long)(qnd_i2c_transfers - transfers), scan.tests, total - missed, total, extra);
+
+            /*! skipping neighbours may lose a weak station; nothing may add one */
+            if(extra || (missed && !(strategy & CRAD_SCAN_SKIP_NEIGHBOURS))) { failed = 1; }
+        }
+    }
+
+    QND_SetClock(&qnd_real_clock);
+    QND_SetBus(&qnd_i2c_dev_bus);
+
+    return failed;
+}
+
+/*! @brief background load for benchExecutor() */
+struct ExecutorLoad
+{
+    crad_executor_t *executor;
+    volatile int running;
+};
+
+/*! an RDS poll: STATUS3, then the group */
+static int pollCommand(crad_t *, void *)
+{
+    UINT8 raw[8];
+
+    QND_ReadReg(STATUS3);
+    QND_ReadRegs(RDSD0, raw, sizeof(raw));
+
+    return CRAD_OK;
+}
+
+static int tuneCommand(crad_t *, void *arg)
+{
+    QND_TuneToCH(*(UINT16 *)arg);
+
+    return CRAD_OK;
+}
+
+static void *pollLoop(void *arg)
+{
+    ExecutorLoad *load = (ExecutorLoad *)arg;
+
+    while(load->running)
+    {
+        crad_execute(load->executor, CRAD_PRIORITY_BACKGROUND, pollCommand, NULL);
+    }
+
+    return NULL;
+}
+
+/*! tune latency while RDS polls keep the executor busy, with and without the priority classes */
+static int benchExecutor()
+{
+    const int pollers = 8, tunes = 2000;
+    static const char *labels[2] = { "tune, interactive class", "tune, queued with the polls" };
+    static const int priorities[2] = { CRAD_PRIORITY_INTERACTIVE, CRAD_PRIORITY_BACKGROUND };
+    crad_executor_t executor;
+    ExecutorLoad load;
+    pthread_t threads[8];
+    int p, t, i;
+
+    QNS_DefaultScene();
+    QND_SetBus(&qns_bus);
+    QND_SetClock(&qnd_virtual_clock);
+
+    crad_executor_init(&executor, NULL);
+    crad_executor_start(&executor);
+
+    load.executor = &executor;
+    load.running = 1;
+    for(t=0;t<pollers;t++) { pthread_create(&threads[t], NULL, pollLoop, &load); }
+
+    printf("executor: %d tunes against %d threads polling RDS\n", tunes, pollers);
+
+    for(p=0;p<2;p++)
+    {
+        double total = 0, worst = 0;
+
+        for(i=0;i<tunes;i++)
+        {
+            UINT16 channel = (i & 1) ? 9770 : 10130;
+            double start = now(), latency;
+
+            crad_execute(&executor, priorities[p], tuneCommand, &channel);
+            latency = now() - start;
+
+            total += latency;
+            if(latency > worst) { worst = latency; }
+        }
+
+        printf("  %-40s %8.1f us mean  %8.1f us worst\n", labels[p], total * 1000000.0 / tunes, worst * 1000000.0);
+    }
+
+    load.running = 0;
+    for(t=0;t<pollers;t++) { pthread_join(threads[t], NULL); }
+
+    printf("  %lu interactive, %lu background commands run\n",
+           executor.executed[CRAD_PRIORITY_INTERACTIVE], executor.executed[CRAD_PRIORITY_BACKGROUND]);
+
+    crad_executor_destroy(&executor);
+
+    QND_SetClock(&qnd_real_clock);
+    QND_SetBus(&qnd_i2c_dev_bus);
+
+    return 0;
+}
+
+/*! @brief benchmark table entry */
+struct Benchmark
+{
+    const char *name;
+    int (*run)();
+};
+
+static const Benchmark benchmarks[] =
+{
+    { "parser", benchParser },
+    { "formats", benchFormats },
+    { "scan", benchScan },
+    { "strategies", benchStrategies },
+    { "executor", benchExecutor },
+};
+
+int crad_run_benchmark(const char *name)
+{
+    unsigned int b;
+
+    for(b=0;b<sizeof(benchmarks)/sizeof(benchmarks[0]);b++)
+    {
+        if(!strcmp(name, benchmarks[b].name)) { return benchmarks[b].run(); }
+    }
+
+    if(strcmp(name, "list"))
+    {
+        fprintf(stderr, "Unknown benchmark \"%s\"\n", name);
+    }
+
+    printf("benchmarks:");
+    for(b=0;b<sizeof(benchmarks)/sizeof(benchmarks[0]);b++)
+    {
+        printf(" %s", benchmarks[b].name);
+    }
+    printf("\n");
+
+    return strcmp(name, "list") ? 1 : 0;
+}
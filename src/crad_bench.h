@@ -0,0 +1,25 @@
+/*
+ * crad_bench.h
+ *
+ * (c) Copyright Chumby Industries, 2009
+ * All rights reserved
+ *
+ * This header declares the microbenchmarks run by "chumbyradio -b".  They
+ * exercise the daemon's hot paths in isolation, so that changes to them
+ * can be measured on the device itself.
+ */
+
+#ifndef CRAD_BENCH_H
+#define CRAD_BENCH_H
+
+/*!
+
+  Run a benchmark and print its results to stdout.
+
+  @param name (INP) - benchmark name, or "list" to print the names
+  @return 0 on success, 1 if there is no such benchmark
+
+*/
+extern int crad_run_benchmark(const char *name);
+
+#endif
@@ -0,0 +1,89 @@
+/*
+    crad_blob.cpp
+
+    This file is part of chumbyradio.
+    Copyright (c) Chumby Industries, 2009
+
+    chumbyradio is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    chumbyradio is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with chumbyradio; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#include <string.h>
+#include <pthread.h>
+#include <zlib.h>
+#include "crad_blob.h"
+
+/*! guards every ChumbRadioBlob reference count */
+static pthread_mutex_t ref_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+ChumbRadioBlob::ChumbRadioBlob(const char *data, size_t length)
+{
+    _data.assign(data, length);
+    _refs = 1;
+}
+
+void ChumbRadioBlob::ref()
+{
+    pthread_mutex_lock(&ref_mutex);
+    _refs++;
+    pthread_mutex_unlock(&ref_mutex);
+}
+
+void ChumbRadioBlob::unref()
+{
+    int refs;
+
+    pthread_mutex_lock(&ref_mutex);
+    refs = --_refs;
+    pthread_mutex_unlock(&ref_mutex);
+
+    if(refs == 0) { delete this; }
+}
+
+ChumbRadioBlob * ChumbRadioBlob::gzip(const char *data, size_t length, int level)
+{
+    ChumbRadioBlob *blob;
+    z_stream stream;
+    int ret;
+
+    if(length < CRAD_GZIP_MIN_SIZE) { return NULL; }
+
+    memset(&stream, 0, sizeof(stream));
+
+    /*! 15 window bits, plus 16 to ask for a gzip header and trailer */
+    if(deflateInit2(&stream, level, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) { return NULL; }
+
+    blob = new ChumbRadioBlob();
+    blob->_data.resize(deflateBound(&stream, length));
+
+    stream.next_in = (Bytef *)data;
+    stream.avail_in = length;
+    stream.next_out = (Bytef *)&blob->_data[0];
+    stream.avail_out = blob->_data.size();
+
+    ret = deflate(&stream, Z_FINISH);
+
+    blob->_data.resize(stream.total_out);
+
+    deflateEnd(&stream);
+
+    /*! only keep the result if it is clearly smaller than the original */
+    if( (ret != Z_STREAM_END) || (blob->_data.size() > length - length / 10) )
+    {
+        blob->unref();
+        return NULL;
+    }
+
+    return blob;
+}
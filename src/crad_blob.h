@@ -0,0 +1,60 @@
+/*
+ * crad_blob.h
+ *
+ * (c) Copyright Chumby Industries, 2009
+ * All rights reserved
+ *
+ * This header declares a reference counted, immutable byte buffer.  Blobs
+ * let several responses share one cached body (e.g. a compressed file or
+ * status document) without copying it per request.
+ */
+
+#ifndef CRAD_BLOB_H
+#define CRAD_BLOB_H
+
+#include <string>
+
+/*! \name gzip settings */
+/*! \{ */
+#define CRAD_GZIP_MIN_SIZE              256     /*!< smaller bodies aren't worth compressing */
+#define CRAD_GZIP_LEVEL_STATIC          9       /*!< compressed once, served many times */
+#define CRAD_GZIP_LEVEL_DYNAMIC         1       /*!< compressed on the request path */
+/*! \} */
+
+/*! @brief Reference counted byte buffer */
+class ChumbRadioBlob
+{
+    public:
+
+        /*! copy length bytes into a new blob, holding one reference */
+        ChumbRadioBlob(const char *data, size_t length);
+
+        const char * getData() const { return _data.data(); }
+        size_t getSize() const { return _data.size(); }
+
+        void ref();
+        void unref();
+
+        /*!
+
+          Compress a buffer with gzip framing.
+
+          @param data (INP) - bytes to compress
+          @param length (INP) - number of bytes
+          @param level (INP) - zlib compression level
+          @return new blob holding one reference, or NULL if compression
+                  failed or did not save at least a tenth of the size
+
+        */
+        static ChumbRadioBlob * gzip(const char *data, size_t length, int level);
+
+    private:
+
+        ChumbRadioBlob() { _refs = 1; }
+        ~ChumbRadioBlob() { }
+
+        std::string     _data;
+        int             _refs;
+};
+
+#endif
@@ -0,0 +1,170 @@
+/*
+    crad_cache.c
+
+    This file is part of chumbyradio.
+    Copyright (c) Chumby Industries, 2009
+
+    chumbyradio is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    chumbyradio is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with chumbyradio; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "crad_interface.h"
+#include "crad_cache.h"
+
+extern UINT8 chumby_XCLK;
+
+// The file is text, a line per field:
+//
+//   chumbradiod-cache 1
+//   country 1
+//   xclk 0
+//   noise 14 14 14 14 14 7600
+//   station 8850
+//   station 8950
+//
+// "noise" is Rssinarray[0..3], RSSIn and the quietest channel.
+
+void crad_cache_capture(crad_cache_t *p_cache) {
+    int i;
+
+    p_cache->country = qnd_Country;
+    p_cache->xclk = chumby_XCLK;
+    memcpy(p_cache->rssinarray, Rssinarray, sizeof(p_cache->rssinarray));
+    p_cache->rssin = RSSIn;
+    p_cache->clearchannel = clearchannel;
+
+    for(i = 0; i < chCount && i < QN_CCA_MAX_CH; i++) {
+        p_cache->channels[i] = chList[i];
+    }
+    p_cache->count = i;
+}
+
+int crad_cache_load(const char *path, crad_cache_t *p_cache) {
+    FILE *file;
+    char line[64];
+    int version = 0, have_country = 0, have_xclk = 0, have_noise = 0, damaged = 0;
+
+    file = fopen(path, "r");
+    if(file == NULL) {
+        if(errno != ENOENT) { perror("Unable to open station cache"); }
+        return CRAD_FAIL;
+    }
+
+    memset(p_cache, 0, sizeof(*p_cache));
+
+    if(fgets(line, sizeof(line), file) == NULL ||
+       sscanf(line, "chumbradiod-cache %d", &version) != 1 ||
+       version != CRAD_CACHE_VERSION) {
+        fprintf(stderr, "Ignoring station cache %s of another version\n", path);
+        fclose(file);
+        return CRAD_FAIL;
+    }
+
+    while(!damaged && fgets(line, sizeof(line), file)) {
+        int noise[6], value;
+
+        if(sscanf(line, "country %d", &value) == 1) {
+            p_cache->country = value;
+            have_country = 1;
+        }
+        else if(sscanf(line, "xclk %d", &value) == 1) {
+            p_cache->xclk = value;
+            have_xclk = 1;
+        }
+        else if(sscanf(line, "noise %d %d %d %d %d %d", &noise[0], &noise[1], &noise[2], &noise[3], &noise[4], &noise[5]) == 6) {
+            int i;
+
+            for(i = 0; i < 4; i++) { p_cache->rssinarray[i] = (UINT8)noise[i]; }
+            p_cache->rssin = (UINT8)noise[4];
+            p_cache->clearchannel = (UINT16)noise[5];
+            have_noise = 1;
+        }
+        else if(sscanf(line, "station %d", &value) == 1 && p_cache->count < QN_CCA_MAX_CH) {
+            p_cache->channels[p_cache->count++] = (UINT16)value;
+        }
+        else {
+            damaged = 1;
+        }
+    }
+
+    fclose(file);
+
+    if(damaged || !have_country || !have_xclk || !have_noise) {
+        fprintf(stderr, "Ignoring damaged station cache %s\n", path);
+        return CRAD_FAIL;
+    }
+
+    return CRAD_OK;
+}
+
+// Make a rename in the directory holding path last through a power cut.
+static void sync_directory(const char *path) {
+    char dir[256];
+    const char *slash = strrchr(path, '/');
+    int fd;
+
+    if(slash == NULL) { strcpy(dir, "."); }
+    else if(slash == path) { strcpy(dir, "/"); }
+    else if(snprintf(dir, sizeof(dir), "%.*s", (int)(slash - path), path) >= (int)sizeof(dir)) { return; }
+
+    fd = open(dir, O_RDONLY);
+    if(fd < 0) { return; }
+    fsync(fd);
+    close(fd);
+}
+
+int crad_cache_save(const char *path, const crad_cache_t *p_cache) {
+    char temp[256];
+    FILE *file;
+    int i, failed;
+
+    // A crash part way through leaves the old cache, not half of a new one.
+    if(snprintf(temp, sizeof(temp), "%s.new", path) >= (int)sizeof(temp)) { return CRAD_INVALID_PARAM; }
+
+    file = fopen(temp, "w");
+    if(file == NULL) {
+        perror("Unable to write station cache");
+        return CRAD_FAIL;
+    }
+
+    fprintf(file, "chumbradiod-cache %d\n", CRAD_CACHE_VERSION);
+    fprintf(file, "country %d\n", p_cache->country);
+    fprintf(file, "xclk %d\n", p_cache->xclk);
+    fprintf(file, "noise %d %d %d %d %d %d\n",
+            p_cache->rssinarray[0], p_cache->rssinarray[1], p_cache->rssinarray[2], p_cache->rssinarray[3],
+            p_cache->rssin, p_cache->clearchannel);
+    for(i = 0; i < p_cache->count; i++) {
+        fprintf(file, "station %d\n", p_cache->channels[i]);
+    }
+
+    // The new file has to be on the disk before it replaces the old one,
+    // or a power cut could leave an empty cache behind the rename.
+    failed = fflush(file) || ferror(file) || fsync(fileno(file));
+    if(fclose(file)) { failed = 1; }
+
+    if(failed || rename(temp, path)) {
+        perror("Unable to write station cache");
+        remove(temp);
+        return CRAD_FAIL;
+    }
+
+    sync_directory(path);
+
+    return CRAD_OK;
+}
@@ -0,0 +1,65 @@
+/*
+ * crad_cache.h
+ *
+ * (c) Copyright Chumby Industries, 2009
+ * All rights reserved
+ *
+ * This header declares the station cache: the station list, the country
+ * and the noise floor QNF_GetFMRssiAvg() measured, as of the last
+ * complete scan.  With it, startup can skip both the calibration and the
+ * scan and be serving requests while the chip is still being set up; a
+ * rescan in the background brings the list up to date afterwards.
+ */
+
+#ifndef CRAD_CACHE_H
+#define CRAD_CACHE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "qndriver.h"
+
+/*! where the daemon keeps the cache on the device */
+#define CRAD_DEFAULT_CACHE_PATH     "/psp/fmradio_stations"
+
+/*! bumped whenever a field's meaning changes; other versions are ignored */
+#define CRAD_CACHE_VERSION          1
+
+/*! @brief Radio state saved between runs */
+typedef struct _crad_cache_t
+{
+    int     country;                /*!< COUNTRY_ */
+    int     xclk;                   /*!< chumby_XCLK the noise floor was measured with */
+    UINT8   rssinarray[4];          /*!< Rssinarray[] */
+    UINT8   rssin;                  /*!< RSSIn */
+    UINT16  clearchannel;           /*!< the quietest channel QNF_GetFMRssiAvg() found */
+    int     count;
+    UINT16  channels[QN_CCA_MAX_CH];   /*!< chList[] */
+}
+crad_cache_t;
+
+/*! copy the driver's current state; call it on the executor thread */
+extern void crad_cache_capture(crad_cache_t *p_cache);
+
+/*!
+
+ Read a cache written by crad_cache_save().
+
+  @param path (INP) - cache file
+  @param p_cache (OUT) - state read
+  @return CRAD_OK for success, CRAD_FAIL if the file is missing, of
+          another version or damaged
+
+*/
+
+extern int crad_cache_load(const char *path, crad_cache_t *p_cache);
+
+/*! write the cache, replacing the old file only once the new one is complete */
+extern int crad_cache_save(const char *path, const crad_cache_t *p_cache);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
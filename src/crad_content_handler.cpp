@@ -21,9 +21,13 @@
 */
 
 #include <strings.h>
+#include <string.h>
 #include <stdio.h>
 #include "crad_content_handler.h"
 #include "crad_interface.h"
+#include "crad_status_sampler.h"
+#include "crad_job_manager.h"
+#include "crad_format.h"
 #include "qndriver.h"
 
 #include <vector>
@@ -63,108 +67,301 @@ static void parseQueryString(std::string &uri, std::vector<std::string> &param,
 }
 
 /*! utility function used to append results to result-list */
-static void appendResult(std::string &content, const char *command, int ret)
+static void appendResult(std::vector<crad_result_t> &results, const char *command, int ret)
 {
-    char *status = "success";
+    crad_result_t result;
 
-    if(CRAD_FAILED(ret)) { status = "failure"; }
+    result.command = command;
+    result.status = CRAD_FAILED(ret) ? "failure" : "success";
+    result.job = 0;
 
-    content += "  <result command=\"";
-    content += command;
-    content += "\" status=\"";
-    content += status;
-    content += "\"/>";
+    results.push_back(result);
 
     return;
 }
 
+/*! utility function used to queue a job and append it to result-list */
+static void appendJob(std::vector<crad_result_t> &results, const char *command, int job_command, double station = 0.0, int strength = CRAD_DEFAULT_SEEK_STRENGTH, int strategy = CRAD_SCAN_DEFAULT)
+{
+    crad_result_t result;
+
+    result.command = command;
+    result.job = ChumbRadioJobManager::instance()->submit(job_command, station, strength, strategy);
+    result.status = (result.job != 0) ? "queued" : "failure";
+
+    results.push_back(result);
 
+    return;
+}
 
-chumby::HTTPResponse * ChumbRadioContentHandler::handleRequest(const chumby::HTTPRequest & request)
+/*! utility function used to append a command turned away while the chip is brought up */
+static void appendInitializing(std::vector<crad_result_t> &results, const char *command)
 {
-    std::string uri = request.getRequestURI();
-    std::string baseURI = uri;
-    std::string::size_type query_offs = uri.find("?", 0);
+    crad_result_t result;
+
+    result.command = command;
+    result.status = "initializing";
+    result.job = 0;
+
+    results.push_back(result);
+
+    return;
+}
+
+/*! utility function used to render the result-list as the response body */
+static void addResults(ChumbRadioResponse *response, int format, const std::vector<crad_result_t> &results)
+{
+    crad_buffer_t buffer;
+    unsigned int r;
+
+    crad_buffer_init(&buffer);
+
+    crad_format_begin(&buffer, format, &crad_result_list_schema, NULL, CRAD_FIELDS_ALL, results.size());
+
+    for(r=0;r<results.size();r++)
+    {
+        crad_format_child(&buffer, format, &crad_result_schema, &results[r], r);
+    }
+
+    crad_format_end(&buffer, format, &crad_result_list_schema, CRAD_FIELDS_ALL);
+
+    if(!buffer.failed) { response->addContent(buffer.data, buffer.length); }
 
-    static const char *statusURI = "/radio/status.xml";
-    static const char *configURI = "/radio/configure";
-    static const char *serviceStartURI = "/radio/start";
-    static const char *serviceStopURI = "/radio/stop";
-    static const char *serviceStatusURI = "/radio/status";
+    crad_buffer_free(&buffer);
 
+    return;
+}
+
+/*! utility function used to pick the response format from ?format= or, failing that, the Accept header */
+static int negotiateFormat(const ChumbRadioRequest &request, std::vector<std::string> &param, std::vector<std::string> &value)
+{
+    unsigned int v;
+
+    for(v=0;v<param.size();v++)
+    {
+        if(param[v] == "format")
+        {
+            int format = crad_format_lookup(value[v].c_str());
+
+            if(format >= 0) { return format; }
+        }
+    }
 
+    std::string accept = request.getHeader("accept").str();
+
+    if(accept.find(crad_format_mime_type(CRAD_FORMAT_CBOR)) != std::string::npos) { return CRAD_FORMAT_CBOR; }
+    if(accept.find(crad_format_mime_type(CRAD_FORMAT_JSON)) != std::string::npos) { return CRAD_FORMAT_JSON; }
+
+    return CRAD_FORMAT_XML;
+}
+
+/*! utility function used to create and refresh the Chumby Radio instance */
+static int prepareRadio()
+{
     /*! create chumby radio interface instance */
     if(!p_crad) {
-        crad_info_t crad_info = { 0 };
+        crad_info_t crad_info;
+
+        memset(&crad_info, 0, sizeof(crad_info));
 
         int ret = crad_create(&crad_info, &p_crad);
 
         if(CRAD_FAILED(ret)) 
         { 
             fprintf(stderr, "Error: crad_create failed (%s)\n", CRAD_RETURN_CODE_LOOKUP[ret]);
-            goto cleanup;
+            return ret;
         }
     }
 
     /*! refresh Chumby Radio instance */
-    crad_refresh(p_crad, CRAD_DEFAULT_DEVICE_PATH);
+    return crad_refresh(p_crad, CRAD_DEFAULT_DEVICE_PATH);
+}
 
-    /*! extract base URI (query string removed) */
-    if(query_offs != std::string::npos)
+ChumbRadioResponse * ChumbRadioContentHandler::serve(const ChumbRadioRequest &request)
+{
+    std::string uri = request.getRequestURI().str();
+    std::string baseURI = request.getPath().str();
+
+    static const char *statusURI = CRAD_URI_STATUS;
+    static const char *configURI = CRAD_URI_CONFIGURE;
+    static const char *serviceStartURI = CRAD_URI_SERVICE_START;
+    static const char *serviceStopURI = CRAD_URI_SERVICE_STOP;
+    static const char *serviceStatusURI = CRAD_URI_SERVICE_STATUS;
+    static const char *jobsURI = CRAD_URI_JOBS;
+
+    /*! only touch the radio for URIs that need it */
+    if( (baseURI == statusURI) || (baseURI == configURI) )
     {
-        baseURI = uri.substr(0, query_offs);
+        if(CRAD_FAILED(prepareRadio())) { goto cleanup; }
     }
 
     if(baseURI == statusURI)
     {
-        chumby::HTTPResponse *response = new chumby::HTTPResponse(chumby::HTTP_RESPONSE_CODE_OKAY);
+        std::vector<std::string> paramList, valueList;
+        unsigned int mask = CRAD_FIELDS_ALL;
+
+        if(!request.getQuery().isNull()) { parseQueryString(uri, paramList, valueList); }
+
+        /*! ?fields=station,signal,rds.radiotext shows only those fields,
+         *  and only takes the chip readings behind them */
+        {
+            unsigned int v;
+
+            for(v=0;v<paramList.size();v++)
+            {
+                if( (paramList[v] == "fields") &&
+                    CRAD_FAILED(crad_format_fields(&crad_status_schema, valueList[v].c_str(), &mask)) )
+                {
+                    ChumbRadioResponse *response = new ChumbRadioResponse(CRAD_HTTP_BAD_REQUEST);
+
+                    response->setMimeType("text/plain");
+                    response->addContent("Unknown field\n");
+                    return response;
+                }
+            }
+        }
+
+        /*! the status comes from the sampler's latest snapshot; requests never wait on the chip */
+        ChumbRadioStatus *status = ChumbRadioStatusSampler::instance()->acquire(crad_format_reads(&crad_status_schema, mask));
+
+        /*! if we can't prepare even an error XML, we shouldn't even give an OKAY response */
+        if(status == NULL) { return NULL; }
+
+        /*! the full document needs a snapshot with every reading taken */
+        if( (mask == CRAD_FIELDS_ALL) && (status->getBody(CRAD_FORMAT_XML) == NULL) )
+        {
+            status->unref();
+            return NULL;
+        }
+
+        unsigned int generation = status->getGeneration();
+
+        /*! ?since=<generation> waits (up to ?timeout= seconds) for the
+         *  state to move on, rather than answer with what the client has */
+        if(!request.isWaitExpired())
+        {
+            unsigned int since = 0, v;
+            int have_since = 0, timeout = CRAD_STATUS_WAIT_DEFAULT;
+
+            for(v=0;v<paramList.size();v++)
+            {
+                if(paramList[v] == "since")
+                {
+                    have_since = (sscanf(valueList[v].c_str(), "%u", &since) == 1);
+                }
+                else if(paramList[v] == "timeout")
+                {
+                    sscanf(valueList[v].c_str(), "%d", &timeout);
+                }
+            }
+
+            if(have_since && (since == generation) && (timeout > 0))
+            {
+                ChumbRadioResponse *response = new ChumbRadioResponse(CRAD_HTTP_OK);
+
+                if(timeout > CRAD_STATUS_WAIT_MAX) { timeout = CRAD_STATUS_WAIT_MAX; }
+
+                response->setParked(timeout, generation);
+
+                status->unref();
+                return response;
+            }
+        }
+
+        ChumbRadioResponse *response = new ChumbRadioResponse(CRAD_HTTP_OK);
 
         response->addHeader("Cache-Control", "no-cache");
         response->addHeader("Pragma", "no-cache");
 
-        response->setMimeType("text/xml");
+        int format = negotiateFormat(request, paramList, valueList);
+
+        response->setMimeType(crad_format_mime_type(format));
+        response->addHeader("Vary", "Accept, Accept-Encoding");
+
+        /*! projections are small, so they're rendered per request and never compressed */
+        int gzip = (mask == CRAD_FIELDS_ALL) && request.acceptsGzip() && (status->getGzip(format) != NULL);
+
+        /*! an unchanged radio state costs a header-only reply */
+        {
+            char etag[48];
+
+            /*! XML keeps its original tags, "<generation>" and "<generation>-gz" */
+            if(mask != CRAD_FIELDS_ALL)
+            {
+                snprintf(etag, sizeof(etag), "\"%u-%s-%x\"", generation, crad_format_name(format), mask);
+            }
+            else
+            {
+                snprintf(etag, sizeof(etag), "\"%u%s%s%s\"", generation,
+                         (format == CRAD_FORMAT_XML) ? "" : "-", (format == CRAD_FORMAT_XML) ? "" : crad_format_name(format),
+                         gzip ? "-gz" : "");
+            }
+
+            response->addHeader("ETag", etag);
+
+            if(request.isNotModified(etag, 0))
+            {
+                response->setNotModified();
+                status->unref();
+                return response;
+            }
+        }
 
         /*! output chumby radio status */
+        if(mask != CRAD_FIELDS_ALL)
         {
-            char buff[16384];
+            crad_buffer_t buffer;
+
+            crad_buffer_init(&buffer);
+
+            if(CRAD_SUCCESS(crad_write_status(p_crad, &status->getRecord(), format, mask, &buffer)))
+            {
+                response->addContent(buffer.data, buffer.length);
+            }
 
-            /*! retrieve status XML */
-            int ret = crad_get_status_xml(p_crad, buff, sizeof(buff));
+            crad_buffer_free(&buffer);
+        }
+        else
+        {
+            ChumbRadioBlob *blob = status->getBody(format);
 
-            /*! if we can't prepare even an error XML, we shouldn't even give an OKAY response */
-            if(CRAD_FAILED(ret)) { return NULL; }
+            if(gzip)
+            {
+                blob = status->getGzip(format);
+                response->addHeader("Content-Encoding", "gzip");
+            }
 
-            std::string content = buff; 
-            
-            response->addContent(content);
+            blob->ref();
+            response->setBlobContent(blob);
         }
 
+        status->unref();
         return response;
     }
     else if(baseURI == configURI)
     {
-        chumby::HTTPResponse *response = new chumby::HTTPResponse(chumby::HTTP_RESPONSE_CODE_OKAY);
+        ChumbRadioResponse *response = new ChumbRadioResponse(CRAD_HTTP_OK);
 
         response->addHeader("Cache-Control", "no-cache");
         response->addHeader("Pragma", "no-cache");
 
-        response->setMimeType("text/xml");
-
         std::vector<std::string> paramList, valueList;
 
         /*! parse parameter/value pairs from query string */
         parseQueryString(uri, paramList, valueList);
 
+        int format = negotiateFormat(request, paramList, valueList);
+
+        response->setMimeType(crad_format_mime_type(format));
+        response->addHeader("Vary", "Accept");
+
         double station = 0.0;
         int seek_up = 0, seek_down = 0, seek_strength = CRAD_DEFAULT_SEEK_STRENGTH;
         int power = -1, rescan = -1, rds_enable = -1, country = -1;
-        int api_key = 0, lock = -1;
-
-        /*! start with a standard XML header */
-        std::string content = "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"; 
+        int api_key = 0, lock = -1, async = 0, scan = CRAD_SCAN_DEFAULT;
 
-        /*! begin configuration results */
-        content += "<result-list>\n";
+        /*! configuration results */
+        std::vector<crad_result_t> results;
 
         /*! process parameters */
         {
@@ -226,6 +423,15 @@ chumby::HTTPResponse * ChumbRadioContentHandler::handleRequest(const chumby::HTT
                 {
                     sscanf(cur_value.c_str(), "%u", &lock);
                 }
+                else if(cur_param == "async")
+                {
+                    sscanf(cur_value.c_str(), "%u", &async);
+                }
+                else if(cur_param == "scan")
+                {
+                    /*! e.g. "coarse" or "hardware+skip"; see crad_scan.h */
+                    scan = crad_scan_lookup(cur_value.c_str());
+                }
             }
         }
 
@@ -233,47 +439,93 @@ chumby::HTTPResponse * ChumbRadioContentHandler::handleRequest(const chumby::HTT
         /*! If the radio is locked and the key isn't correct, deny access */
         if(crad_get_locked(p_crad) && crad_get_key(p_crad) != api_key)
         {
-            appendResult(content, "locked", CRAD_ACCESS_DENIED);
-            content += "</result-list>\n";
-            response->addContent(content);
+            appendResult(results, "locked", CRAD_ACCESS_DENIED);
+            addResults(response, format, results);
             return response;
         }
 
+        /*! Until the chip is brought up, anything that talks to it would hold
+         *  this dispatch thread behind the bring-up.  Tuning and seeking are
+         *  queued as jobs instead, and the rest is turned away; turning RDS
+         *  off waits for the RDS reader, which may be waiting on the chip. */
+        if(crad_get_initializing(p_crad))
+        {
+            if( (country != -1) || (rds_enable == 0) || (power == 0) )
+            {
+                char retry_after[16];
+
+                snprintf(retry_after, sizeof(retry_after), "%d", CRAD_CONFIGURE_RETRY_AFTER);
+                response->setStatus(CRAD_HTTP_SERVICE_UNAVAILABLE);
+                response->addHeader("Retry-After", retry_after);
+
+                if(country != -1) { appendInitializing(results, "country"); }
+                if(rds_enable == 0) { appendInitializing(results, "rds"); }
+                if(power == 0) { appendInitializing(results, "power"); }
+
+                addResults(response, format, results);
+                return response;
+            }
+
+            async = 1;
+        }
+
         if(lock >= 0)
         {
             crad_set_key(p_crad, api_key);
-            appendResult(content, "lock", crad_set_locked(p_crad, lock));
+            appendResult(results, "lock", crad_set_locked(p_crad, lock));
         }
 
 
         /*! attempt to tune radio, if requested */
-        if(station != 0.0)
+        if( (station != 0.0) && async )
+        {
+            appendJob(results, "station", CRAD_JOB_TUNE, station);
+        }
+        else if(station != 0.0)
         {
             int ret = crad_tune_radio(p_crad, station);
 
-            appendResult(content, "station", ret);
+            appendResult(results, "station", ret);
         }
 
         if(power != -1)
         {
-            appendResult(content, "power", crad_set_power(p_crad, power));
+            appendResult(results, "power", crad_set_power(p_crad, power));
         }
 
         /*! If the user requests we enable RDS, fire off an RDS thread. */
         if(rds_enable != -1) {
-            appendResult(content, "rds", crad_set_rds(p_crad, rds_enable));
+            appendResult(results, "rds", crad_set_rds(p_crad, rds_enable));
         }
 
         if(country != -1) {
-            appendResult(content, "country", crad_set_country(p_crad, country));
+            appendResult(results, "country", crad_set_country(p_crad, country));
         }
 
-        if(rescan != -1)
+        /*! a scan takes tens of seconds, so it always runs as a job */
+        if( (rescan != -1) && (scan < 0) )
         {
-            appendResult(content, "rescan", crad_refresh_station_list(p_crad));
+            appendResult(results, "rescan", CRAD_INVALID_PARAM);
+        }
+        else if(rescan != -1)
+        {
+            appendJob(results, "rescan", CRAD_JOB_RESCAN, 0.0, CRAD_DEFAULT_SEEK_STRENGTH, scan);
         }
 
-        if( (seek_up != 0) || (seek_down != 0) )
+        if( ((seek_up != 0) || (seek_down != 0)) && async )
+        {
+            if(seek_strength == -1) { seek_strength = CRAD_DEFAULT_SEEK_STRENGTH; }
+
+            if(seek_up != 0)
+            {
+                appendJob(results, "seek_up", CRAD_JOB_SEEK_UP, 0.0, seek_strength);
+            }
+            else
+            {
+                appendJob(results, "seek_down", CRAD_JOB_SEEK_DOWN, 0.0, seek_strength);
+            }
+        }
+        else if( (seek_up != 0) || (seek_down != 0) )
         {
             int ret = crad_seek_radio(p_crad, (seek_up != 0) ? CRAD_SEEK_DIR_UP : CRAD_SEEK_DIR_DOWN, seek_strength);
 
@@ -283,29 +535,27 @@ chumby::HTTPResponse * ChumbRadioContentHandler::handleRequest(const chumby::HTT
             }
             else
             {
-                appendResult(content, "seek_strength", ret);
+                appendResult(results, "seek_strength", ret);
             }
 
             if(seek_up != 0)
             {
-                appendResult(content, "seek_up", ret);
+                appendResult(results, "seek_up", ret);
             }
             else
             {
-                appendResult(content, "seek_down", ret);
+                appendResult(results, "seek_down", ret);
             }
         }
 
 
-        content += "</result-list>\n";
-
-        response->addContent(content);
+        addResults(response, format, results);
 
         return response;
     }
     else if( (baseURI == serviceStartURI) || (baseURI == serviceStopURI) || (baseURI == serviceStatusURI) )
     {
-        chumby::HTTPResponse *response = new chumby::HTTPResponse(chumby::HTTP_RESPONSE_CODE_OKAY);
+        ChumbRadioResponse *response = new ChumbRadioResponse(CRAD_HTTP_OK);
 
         std::string content;
 
@@ -344,6 +594,56 @@ chumby::HTTPResponse * ChumbRadioContentHandler::handleRequest(const chumby::HTT
 
         return response;
     }
+    else if(baseURI.compare(0, strlen(jobsURI), jobsURI) == 0)
+    {
+        std::vector<std::string> paramList, valueList;
+        unsigned int id = 0, v;
+        int cancel = 0;
+        char extra;
+
+        /*! anything but digits after the prefix names no job */
+        if(sscanf(baseURI.c_str() + strlen(jobsURI), "%u%c", &id, &extra) != 1)
+        {
+            return new ChumbRadioResponse(CRAD_HTTP_NOT_FOUND);
+        }
+
+        if(!request.getQuery().isNull()) { parseQueryString(uri, paramList, valueList); }
+
+        for(v=0;v<paramList.size();v++)
+        {
+            if(paramList[v] == "cancel") { sscanf(valueList[v].c_str(), "%d", &cancel); }
+        }
+
+        /*! a job that has finished stays as it was; the document says how it ended */
+        if( cancel && (ChumbRadioJobManager::instance()->cancel(id) == CRAD_INVALID_PARAM) )
+        {
+            return new ChumbRadioResponse(CRAD_HTTP_NOT_FOUND);
+        }
+
+        int format = negotiateFormat(request, paramList, valueList);
+        crad_buffer_t buffer;
+
+        crad_buffer_init(&buffer);
+
+        if(CRAD_FAILED(ChumbRadioJobManager::instance()->write(id, format, &buffer)))
+        {
+            crad_buffer_free(&buffer);
+            return new ChumbRadioResponse(CRAD_HTTP_NOT_FOUND);
+        }
+
+        ChumbRadioResponse *response = new ChumbRadioResponse(CRAD_HTTP_OK);
+
+        response->addHeader("Cache-Control", "no-cache");
+        response->addHeader("Pragma", "no-cache");
+        response->setMimeType(crad_format_mime_type(format));
+        response->addHeader("Vary", "Accept");
+
+        if(!buffer.failed) { response->addContent(buffer.data, buffer.length); }
+
+        crad_buffer_free(&buffer);
+
+        return response;
+    }
 
 cleanup:
 
@@ -11,14 +11,33 @@
 #ifndef CRAD_CONTENT_HANDLER_H
 #define CRAD_CONTENT_HANDLER_H
 
-#include <chumby_httpd/chumby_http_server.h>
+#include "crad_http_handler.h"
+
+/*! \name Chumby Radio Content Handler URIs */
+/*! \{ */
+#define CRAD_URI_STATUS             "/radio/status.xml"
+#define CRAD_URI_CONFIGURE          "/radio/configure"
+#define CRAD_URI_SERVICE_START      "/radio/start"
+#define CRAD_URI_SERVICE_STOP       "/radio/stop"
+#define CRAD_URI_SERVICE_STATUS     "/radio/status"
+#define CRAD_URI_JOBS               "/radio/jobs/"      /*!< followed by the job id */
+/*! \} */
+
+/*! \name status.xml?since=<generation> long poll limits, in seconds */
+/*! \{ */
+#define CRAD_STATUS_WAIT_DEFAULT    25
+#define CRAD_STATUS_WAIT_MAX        60
+/*! \} */
+
+/*! seconds a /radio/configure turned away during chip bring-up is asked to wait */
+#define CRAD_CONFIGURE_RETRY_AFTER  2
 
 /*! @brief Chumby Radio Content Handler */
-class ChumbRadioContentHandler : public chumby::HTTPContentHandler 
+class ChumbRadioContentHandler : public ChumbRadioHandler
 {
     public:
 
-        chumby::HTTPResponse * handleRequest(const chumby::HTTPRequest & request);
+        ChumbRadioResponse * serve(const ChumbRadioRequest &request);
 };
 
 #endif
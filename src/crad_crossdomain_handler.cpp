@@ -23,13 +23,11 @@
 #include <string.h>
 #include "crad_crossdomain_handler.h"
 
-chumby::HTTPResponse * ChumbRadioCrossDomainHandler::handleRequest(const chumby::HTTPRequest & request)
+ChumbRadioResponse * ChumbRadioCrossDomainHandler::serve(const ChumbRadioRequest &request)
 {
-    std::string uri = request.getRequestURI();
+    static const char *crossDomainURI = CRAD_URI_CROSSDOMAIN;
 
-    static const char *crossDomainURI = "/crossdomain.xml";
-
-    if(uri == crossDomainURI)
+    if(request.getRequestURI().equals(crossDomainURI))
     {
         static const char *crossDomainXML = 
             "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
@@ -38,10 +36,12 @@ chumby::HTTPResponse * ChumbRadioCrossDomainHandler::handleRequest(const chumby:
             "  <allow-access-from domain=\"*\"/>\n"
             "</cross-domain-policy>\n";
 
-        chumby::HTTPResponse *response = new chumby::HTTPResponse(chumby::HTTP_RESPONSE_CODE_OKAY);
+        ChumbRadioResponse *response = new ChumbRadioResponse(CRAD_HTTP_OK);
 
         response->setMimeType("text/xml");
-        response->addContent(crossDomainXML, strlen(crossDomainXML));
+
+        /*! the policy is a literal, so the response can point straight at it */
+        response->setStaticContent(crossDomainXML, strlen(crossDomainXML));
 
         return response;
     }
@@ -11,14 +11,17 @@
 #ifndef CRAD_CROSSDOMAIN_HANDLER_H
 #define CRAD_CROSSDOMAIN_HANDLER_H
 
-#include <chumby_httpd/chumby_http_server.h>
+#include "crad_http_handler.h"
+
+/*! Chumby Radio Cross Domain policy URI */
+#define CRAD_URI_CROSSDOMAIN        "/crossdomain.xml"
 
 /*! @brief Chumby Radio Cross Domain Handler */
-class ChumbRadioCrossDomainHandler : public chumby::HTTPContentHandler 
+class ChumbRadioCrossDomainHandler : public ChumbRadioHandler
 {
     public:
 
-        chumby::HTTPResponse * handleRequest(const chumby::HTTPRequest & request);
+        ChumbRadioResponse * serve(const ChumbRadioRequest &request);
 };
 
 #endif
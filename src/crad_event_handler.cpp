@@ -0,0 +1,60 @@
+/*
+    crad_event_handler.cpp
+
+    This file is part of chumbyradio.
+    Copyright (c) Chumby Industries, 2009
+
+    chumbyradio is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    chumbyradio is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with chumbyradio; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#include <stdlib.h>
+#include "crad_event_handler.h"
+#include "crad_event_source.h"
+
+ChumbRadioResponse * ChumbRadioEventHandler::serve(const ChumbRadioRequest &request)
+{
+    ChumbRadioSlice lastEventID = request.getHeader("last-event-id");
+    unsigned long after = 0, id = 0;
+    ChumbRadioResponse *response;
+    ChumbRadioBlob *record;
+
+    if(!request.getPath().equals(CRAD_URI_EVENTS)) { return NULL; }
+
+    /*! a reconnecting client picks up after the last record it saw */
+    if(!lastEventID.isNull())
+    {
+        after = strtoul(lastEventID.str().c_str(), NULL, 10);
+    }
+
+    response = new ChumbRadioResponse(CRAD_HTTP_OK);
+
+    response->setMimeType("text/event-stream");
+    response->addHeader("Cache-Control", "no-cache");
+
+    record = ChumbRadioEventSource::instance()->getEvent(after, id);
+
+    if(record != NULL)
+    {
+        response->setBlobContent(record);
+    }
+    else
+    {
+        id = after;
+    }
+
+    response->setEventStream(id);
+
+    return response;
+}
@@ -0,0 +1,29 @@
+/*
+ * crad_event_handler.h
+ *
+ * (c) Copyright Chumby Industries, 2009
+ * All rights reserved
+ *
+ * This header declares the handler for the /radio/events Server-Sent
+ * Events stream.  It answers with the first record; the event driven
+ * server then keeps the connection open and sends the rest as they are
+ * published.
+ */
+
+#ifndef CRAD_EVENT_HANDLER_H
+#define CRAD_EVENT_HANDLER_H
+
+#include "crad_http_handler.h"
+
+/*! Chumby Radio event stream URI */
+#define CRAD_URI_EVENTS             "/radio/events"
+
+/*! @brief Chumby Radio Event Stream Handler */
+class ChumbRadioEventHandler : public ChumbRadioHandler
+{
+    public:
+
+        ChumbRadioResponse * serve(const ChumbRadioRequest &request);
+};
+
+#endif
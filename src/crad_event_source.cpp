@@ -0,0 +1,380 @@
+/*
+    crad_event_source.cpp
+
+    This file is part of chumbyradio.
+    Copyright (c) Chumby Industries, 2009
+
+    chumbyradio is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    chumbyradio is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with chumbyradio; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "crad_event_source.h"
+
+extern crad_t *p_crad;
+
+static const char *heartbeatRecord = ": keep-alive\n\n";
+
+/*! append str as a quoted JSON string */
+static void appendString(std::string &out, const char *str)
+{
+    out += '"';
+
+    for(;*str != '\0';str++)
+    {
+        unsigned char c = (unsigned char)*str;
+
+        if( (c == '"') || (c == '\\') )
+        {
+            out += '\\';
+            out += c;
+        }
+        else if(c < 0x20)
+        {
+            char escaped[8];
+
+            snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+            out += escaped;
+        }
+        else
+        {
+            out += c;
+        }
+    }
+
+    out += '"';
+}
+
+/*! start a "name": member, after a comma if needed */
+static void appendName(std::string &out, const char *name)
+{
+    if(!out.empty()) { out += ','; }
+
+    out += '"';
+    out += name;
+    out += "\":";
+}
+
+/*! the RSSI wanders constantly, so it counts as changed only once it has
+ *  moved a whole bucket from the reading last reported; a reading that
+ *  sits on a bucket boundary would otherwise flip between the two */
+static int signalChanged(const crad_state_t &state, const crad_state_t *previous)
+{
+    return (previous == NULL) || (abs(state.strength - previous->strength) >= CRAD_EVENT_RSSI_BUCKET);
+}
+
+/*!
+
+  Append the fields of state that differ from previous as JSON members, or
+  all of them if there is no previous state.  Names follow the attributes
+  of status.xml.
+
+*/
+static void appendState(std::string &out, const crad_state_t &state, const crad_state_t *previous)
+{
+    char buff[64];
+
+    if( (previous == NULL) || (previous->channel != state.channel) )
+    {
+        snprintf(buff, sizeof(buff), "\"%d.%02d\"", state.channel / 100, state.channel % 100);
+        appendName(out, "station");
+        out += buff;
+    }
+
+    if( (previous == NULL) || (previous->stereo != state.stereo) )
+    {
+        appendName(out, "stereo");
+        out += state.stereo ? '1' : '0';
+    }
+
+    if(signalChanged(state, previous))
+    {
+        snprintf(buff, sizeof(buff), "%d", (state.strength / CRAD_EVENT_RSSI_BUCKET) * CRAD_EVENT_RSSI_BUCKET);
+        appendName(out, "signal");
+        out += buff;
+    }
+
+    if( (previous == NULL) || strcmp(previous->program_service_name, state.program_service_name) )
+    {
+        appendName(out, "programservice");
+        appendString(out, state.program_service_name);
+    }
+
+    if( (previous == NULL) || strcmp(previous->radiotext, state.radiotext) )
+    {
+        appendName(out, "radiotext");
+        appendString(out, state.radiotext);
+    }
+
+    if( (previous == NULL) || (previous->julian_date != state.julian_date) ||
+        (previous->hour_code != state.hour_code) || (previous->minute != state.minute) ||
+        (previous->localtime_hours != state.localtime_hours) || (previous->localtime_minutes != state.localtime_minutes) )
+    {
+        snprintf(buff, sizeof(buff), "{\"juliandate\":%d,\"hour\":%d,\"minute\":%d,\"localtime\":\"%d:%02d\"}",
+                 state.julian_date, state.hour_code, state.minute, state.localtime_hours, state.localtime_minutes);
+        appendName(out, "clock");
+        out += buff;
+    }
+}
+
+ChumbRadioEventSource * ChumbRadioEventSource::instance()
+{
+    static ChumbRadioEventSource source;
+
+    return &source;
+}
+
+ChumbRadioEventSource::ChumbRadioEventSource()
+{
+    pthread_mutex_init(&_mutex, NULL);
+    pthread_mutex_init(&_updateMutex, NULL);
+
+    _subscribers = 0;
+    _watchers = 0;
+    _listener = NULL;
+
+    /*! seed ids from the clock, so a Last-Event-ID from before a restart
+     *  is unlikely to name one of our records */
+    _lastId = (unsigned long)time(NULL);
+    _lastPublished = 0;
+
+    _snapshot = NULL;
+    _snapshotId = 0;
+
+    _latest = 0;
+
+    _sampled = 0;
+    _generation = 0;
+    memset(&_state, 0, sizeof(_state));
+}
+
+void ChumbRadioEventSource::setListener(ChumbRadioEventListener *listener)
+{
+    pthread_mutex_lock(&_mutex);
+    _listener = listener;
+    pthread_mutex_unlock(&_mutex);
+}
+
+void ChumbRadioEventSource::subscribe()
+{
+    pthread_mutex_lock(&_mutex);
+    _subscribers++;
+    pthread_mutex_unlock(&_mutex);
+
+    ChumbRadioStatusSampler::instance()->hold();
+}
+
+void ChumbRadioEventSource::unsubscribe()
+{
+    pthread_mutex_lock(&_mutex);
+    _subscribers--;
+    pthread_mutex_unlock(&_mutex);
+
+    ChumbRadioStatusSampler::instance()->release();
+}
+
+int ChumbRadioEventSource::watch(unsigned int generation)
+{
+    pthread_mutex_lock(&_mutex);
+    _watchers++;
+    pthread_mutex_unlock(&_mutex);
+
+    /*! an idle sampler doesn't follow the state, so it runs while anyone waits */
+    ChumbRadioStatusSampler::instance()->hold();
+
+    /*! a snapshot that landed between the handler's look and now would
+     *  otherwise not wake the request until it times out */
+    if(ChumbRadioStatusSampler::instance()->getGeneration() != generation)
+    {
+        unwatch();
+        return 0;
+    }
+
+    return 1;
+}
+
+void ChumbRadioEventSource::unwatch()
+{
+    pthread_mutex_lock(&_mutex);
+    _watchers--;
+    pthread_mutex_unlock(&_mutex);
+
+    ChumbRadioStatusSampler::instance()->release();
+}
+
+ChumbRadioBlob * ChumbRadioEventSource::getEvent(unsigned long after, unsigned long &id)
+{
+    ChumbRadioBlob *blob;
+    unsigned long first;
+
+    pthread_mutex_lock(&_mutex);
+
+    /*! nobody has listened yet, so there is no snapshot to start from */
+    if(_snapshot == NULL)
+    {
+        pthread_mutex_unlock(&_mutex);
+
+        ChumbRadioStatus *status = ChumbRadioStatusSampler::instance()->acquire();
+
+        if(status != NULL)
+        {
+            update(status);
+            status->unref();
+        }
+
+        pthread_mutex_lock(&_mutex);
+
+        if(_snapshot == NULL)
+        {
+            pthread_mutex_unlock(&_mutex);
+            return NULL;
+        }
+    }
+
+    if(after == _lastId)
+    {
+        pthread_mutex_unlock(&_mutex);
+        return NULL;
+    }
+
+    first = _lastId - _history.size() + 1;
+
+    if( (after + 1 >= first) && (after < _lastId) )
+    {
+        id = after + 1;
+        blob = _history[id - first];
+    }
+    else
+    {
+        id = _snapshotId;
+        blob = _snapshot;
+    }
+
+    blob->ref();
+
+    pthread_mutex_unlock(&_mutex);
+
+    return blob;
+}
+
+/*! publish whatever changed since the last snapshot, or a heartbeat if nothing has for a while */
+void ChumbRadioEventSource::update(ChumbRadioStatus *status)
+{
+    ChumbRadioEventListener *listener = NULL;
+    std::string changed, full;
+    int quiet;
+
+    pthread_mutex_lock(&_updateMutex);
+    pthread_mutex_lock(&_mutex);
+
+    /*! parked requests wait on any new generation, even one that
+     *  doesn't change what the event stream shows */
+    if( (status->getGeneration() != _latest) && (_watchers > 0) ) { listener = _listener; }
+
+    _latest = status->getGeneration();
+
+    /*! a snapshot taken for a field projection only has part of the state */
+    if( (status->getReads() == CRAD_STATUS_READ_ALL) && (!_sampled || (status->getGeneration() != _generation)) )
+    {
+        int strength = _state.strength;
+        int reported = signalChanged(status->getState(), _sampled ? &_state : NULL);
+
+        appendState(changed, status->getState(), _sampled ? &_state : NULL);
+
+        _state = status->getState();
+        if(!reported) { _state.strength = strength; }
+        _generation = status->getGeneration();
+        _sampled = 1;
+    }
+
+    if(!changed.empty()) { appendState(full, _state, NULL); }
+
+    pthread_mutex_unlock(&_mutex);
+
+    if(!changed.empty()) { publish(changed, full); }
+
+    pthread_mutex_lock(&_mutex);
+    quiet = (_subscribers > 0) && (time(NULL) - _lastPublished >= CRAD_EVENT_HEARTBEAT);
+    pthread_mutex_unlock(&_mutex);
+
+    if(quiet) { heartbeat(); }
+
+    pthread_mutex_unlock(&_updateMutex);
+
+    if(listener != NULL) { listener->stateChanged(); }
+}
+
+/*! serialize a change, and the state it leads to, once for every subscriber */
+void ChumbRadioEventSource::publish(const std::string &changed, const std::string &full)
+{
+    ChumbRadioEventListener *listener;
+    std::string record;
+    char header[64];
+
+    pthread_mutex_lock(&_mutex);
+
+    _lastId++;
+
+    snprintf(header, sizeof(header), "id: %lu\nevent: state\ndata: {", _lastId);
+
+    record = header + changed + "}\n\n";
+    _history.push_back(new ChumbRadioBlob(record.data(), record.size()));
+
+    /*! a snapshot also tells a (re)connecting client how soon to retry */
+    snprintf(header, sizeof(header), "retry: %d\nid: %lu\nevent: state\ndata: {", CRAD_EVENT_RETRY_MS, _lastId);
+
+    record = header + full + "}\n\n";
+    if(_snapshot != NULL) { _snapshot->unref(); }
+    _snapshot = new ChumbRadioBlob(record.data(), record.size());
+    _snapshotId = _lastId;
+
+    if(_history.size() > CRAD_EVENT_HISTORY)
+    {
+        _history.front()->unref();
+        _history.pop_front();
+    }
+
+    _lastPublished = time(NULL);
+    listener = _listener;
+
+    pthread_mutex_unlock(&_mutex);
+
+    if(listener != NULL) { listener->eventsPublished(); }
+}
+
+/*! keep quiet streams from being dropped by proxies, and notice departed clients */
+void ChumbRadioEventSource::heartbeat()
+{
+    ChumbRadioEventListener *listener;
+
+    pthread_mutex_lock(&_mutex);
+
+    _lastId++;
+    _history.push_back(new ChumbRadioBlob(heartbeatRecord, strlen(heartbeatRecord)));
+
+    if(_history.size() > CRAD_EVENT_HISTORY)
+    {
+        _history.front()->unref();
+        _history.pop_front();
+    }
+
+    _lastPublished = time(NULL);
+    listener = _listener;
+
+    pthread_mutex_unlock(&_mutex);
+
+    if(listener != NULL) { listener->eventsPublished(); }
+}
@@ -0,0 +1,126 @@
+/*
+ * crad_event_source.h
+ *
+ * (c) Copyright Chumby Industries, 2009
+ * All rights reserved
+ *
+ * This header declares the producer behind the /radio/events stream.  It
+ * is fed by the status sampler, and serializes each change once, as a
+ * Server-Sent Events record in a shared blob; every subscriber is sent the
+ * same blobs, so listeners cost a socket each rather than a polling loop
+ * each.
+ */
+
+#ifndef CRAD_EVENT_SOURCE_H
+#define CRAD_EVENT_SOURCE_H
+
+#include <deque>
+#include <string>
+#include <time.h>
+#include <pthread.h>
+#include "crad_blob.h"
+#include "crad_interface.h"
+#include "crad_status_sampler.h"
+
+/*! \name Event source settings */
+/*! \{ */
+#define CRAD_EVENT_HISTORY          64      /*!< records kept for Last-Event-ID resume and slow subscribers */
+#define CRAD_EVENT_HEARTBEAT        15      /*!< seconds of silence before a keep-alive comment */
+#define CRAD_EVENT_RSSI_BUCKET      16      /*!< RSSI change needed to count as a change */
+#define CRAD_EVENT_RETRY_MS         2000    /*!< reconnect delay suggested to clients */
+/*! \} */
+
+/*! @brief notified from the sampler thread whenever records are published */
+class ChumbRadioEventListener
+{
+    public:
+
+        virtual ~ChumbRadioEventListener() { }
+
+        virtual void eventsPublished() = 0;
+
+        /*! the state generation moved on while someone was watching it */
+        virtual void stateChanged() = 0;
+};
+
+/*! @brief Chumby Radio state change stream */
+class ChumbRadioEventSource
+{
+    public:
+
+        static ChumbRadioEventSource * instance();
+
+        /*! the listener is called without any lock held */
+        void setListener(ChumbRadioEventListener *listener);
+
+        /*! a subscriber joined or left; the sampler runs at its full rate while someone listens */
+        void subscribe();
+        void unsubscribe();
+
+        /*!
+
+          A parked request started or stopped waiting for the state to
+          move on from generation.  While anyone waits, the listener's
+          stateChanged() is called each time the sampler takes a snapshot
+          of a new generation.
+
+          @return 0 if the state has already moved on, and the watch was
+                  not started
+
+        */
+        int watch(unsigned int generation);
+        void unwatch();
+
+        /*!
+
+          Fetch the record following another.  A subscriber too far behind
+          (or new, or resuming from a record no longer kept) is given a
+          snapshot of the whole state instead, after which it continues
+          with the changes.
+
+          @param after (INP) - id of the last record the subscriber has, 0 if none
+          @param id (OUT) - id of the returned record
+          @return new reference to the record, or NULL if there is nothing newer
+
+        */
+        ChumbRadioBlob * getEvent(unsigned long after, unsigned long &id);
+
+        /*! called by the sampler with each snapshot it takes */
+        void update(ChumbRadioStatus *status);
+
+    private:
+
+        ChumbRadioEventSource();
+
+        /*! guards everything below */
+        pthread_mutex_t _mutex;
+
+        /*! serializes update() between the sampler and getEvent() */
+        pthread_mutex_t _updateMutex;
+
+        int _subscribers;
+        int _watchers;
+        ChumbRadioEventListener *_listener;
+
+        /*! recent records, oldest first, with consecutive ids ending at _lastId */
+        std::deque<ChumbRadioBlob *> _history;
+        unsigned long _lastId;
+        time_t _lastPublished;
+
+        /*! the whole state as of record _snapshotId */
+        ChumbRadioBlob *_snapshot;
+        unsigned long _snapshotId;
+
+        /*! generation of the last snapshot seen, for watchers */
+        unsigned int _latest;
+
+        /*! state the last record was built from, with the RSSI last reported */
+        int _sampled;
+        unsigned int _generation;
+        crad_state_t _state;
+
+        void publish(const std::string &changed, const std::string &full);
+        void heartbeat();
+};
+
+#endif
@@ -0,0 +1,180 @@
+/*
+    crad_executor.c
+
+    This file is part of chumbyradio.
+    Copyright (c) Chumby Industries, 2009
+
+    chumbyradio is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    chumbyradio is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with chumbyradio; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <sched.h>
+#include "crad_interface.h"
+#include "crad_executor.h"
+
+static void queue_init(crad_command_queue_t *p_queue) {
+    p_queue->stub.next = NULL;
+    p_queue->head = &p_queue->stub;
+    p_queue->tail = &p_queue->stub;
+}
+
+// Any thread.  The exchange orders the push against every other push; the
+// barrier in front of it publishes the command's fields before the
+// executor can reach it.
+static void queue_push(crad_command_queue_t *p_queue, crad_command_t *p_command) {
+    crad_command_t *p_prev;
+
+    p_command->next = NULL;
+    __sync_synchronize();
+    p_prev = __sync_lock_test_and_set(&p_queue->head, p_command);
+    p_prev->next = p_command;
+}
+
+// Executor thread only.  Returns NULL if the queue is empty, or if a push
+// is halfway through and the next command isn't linked in yet.
+static crad_command_t *queue_pop(crad_command_queue_t *p_queue) {
+    crad_command_t *p_tail = p_queue->tail;
+    crad_command_t *p_next = p_tail->next;
+
+    if(p_tail == &p_queue->stub) {
+        if(p_next == NULL) { return NULL; }
+        p_queue->tail = p_next;
+        p_tail = p_next;
+        p_next = p_next->next;
+    }
+
+    if(p_next != NULL) {
+        p_queue->tail = p_next;
+        return p_tail;
+    }
+
+    if(p_tail != p_queue->head) { return NULL; }
+
+    // p_tail is the last command; put the stub behind it so it can go.
+    queue_push(p_queue, &p_queue->stub);
+    p_next = p_tail->next;
+    if(p_next != NULL) {
+        p_queue->tail = p_next;
+        return p_tail;
+    }
+
+    return NULL;
+}
+
+static void *executor_thread(void *data) {
+    crad_executor_t *p_executor = (crad_executor_t *)data;
+
+    for(;;) {
+        crad_command_t *p_command = NULL;
+        int priority;
+
+        while(sem_wait(&p_executor->pending) != 0) { }
+
+        // The count says a command is queued; if its producer hasn't
+        // linked it in yet, give it the processor and look again.
+        for(;;) {
+            for(priority = 0; priority < CRAD_PRIORITY_COUNT; priority++) {
+                p_command = queue_pop(&p_executor->queues[priority]);
+                if(p_command != NULL) { break; }
+            }
+            if(p_command != NULL) { break; }
+            sched_yield();
+        }
+
+        if(p_command->run == NULL) {
+            sem_post(&p_command->done);
+            break;
+        }
+
+        p_command->result = p_command->run(p_executor->p_crad, p_command->arg);
+        p_executor->executed[priority]++;
+        sem_post(&p_command->done);
+    }
+
+    return NULL;
+}
+
+void crad_executor_init(crad_executor_t *p_executor, struct _crad_t *p_crad) {
+    int i;
+
+    memset(p_executor, 0, sizeof(*p_executor));
+    p_executor->p_crad = p_crad;
+    for(i = 0; i < CRAD_PRIORITY_COUNT; i++) { queue_init(&p_executor->queues[i]); }
+    sem_init(&p_executor->pending, 0, 0);
+}
+
+int crad_executor_start(crad_executor_t *p_executor) {
+    /*! sanity check - null ptr */
+    if(p_executor == 0) { return CRAD_INVALID_PARAM; }
+
+    /*! sanity check - already running */
+    if(p_executor->running) { return CRAD_INVALID_CALL; }
+
+    if(pthread_create(&p_executor->thread, NULL, executor_thread, p_executor)) {
+        perror("Unable to create executor thread");
+        return CRAD_FAIL;
+    }
+
+    p_executor->running = 1;
+
+    return CRAD_OK;
+}
+
+void crad_executor_stop(crad_executor_t *p_executor) {
+    if(!p_executor->running) { return; }
+
+    // Queued behind everything else, so what's already asked for still runs.
+    crad_execute(p_executor, CRAD_PRIORITY_COUNT - 1, NULL, NULL);
+    p_executor->running = 0;
+
+    pthread_join(p_executor->thread, NULL);
+}
+
+void crad_executor_destroy(crad_executor_t *p_executor) {
+    crad_executor_stop(p_executor);
+    sem_destroy(&p_executor->pending);
+}
+
+void crad_submit(crad_executor_t *p_executor, int priority, crad_command_t *p_command, crad_command_fn run, void *arg) {
+    if(priority < 0) { priority = 0; }
+    if(priority >= CRAD_PRIORITY_COUNT) { priority = CRAD_PRIORITY_COUNT - 1; }
+
+    p_command->run = run;
+    p_command->arg = arg;
+    p_command->result = CRAD_FAIL;
+    sem_init(&p_command->done, 0, 0);
+
+    queue_push(&p_executor->queues[priority], p_command);
+    sem_post(&p_executor->pending);
+}
+
+int crad_wait(crad_command_t *p_command) {
+    while(sem_wait(&p_command->done) != 0) { }
+    sem_destroy(&p_command->done);
+
+    return p_command->result;
+}
+
+int crad_execute(crad_executor_t *p_executor, int priority, crad_command_fn run, void *arg) {
+    crad_command_t command;
+
+    if(!p_executor->running || pthread_equal(pthread_self(), p_executor->thread)) {
+        return (run != NULL) ? run(p_executor->p_crad, arg) : CRAD_OK;
+    }
+
+    crad_submit(p_executor, priority, &command, run, arg);
+    return crad_wait(&command);
+}
@@ -0,0 +1,141 @@
+/*
+ * crad_executor.h
+ *
+ * (c) Copyright Chumby Industries, 2009
+ * All rights reserved
+ *
+ * This header declares the radio executor: the one thread allowed to talk
+ * to the tuner.  HTTP handlers, the status sampler and the RDS reader hand
+ * it commands through lock-free queues, one per priority class, and it
+ * runs them one at a time, highest class first.  A tune asked for while
+ * RDS polls are waiting goes ahead of them instead of interleaving its bus
+ * transfers with theirs.
+ */
+
+#ifndef CRAD_EXECUTOR_H
+#define CRAD_EXECUTOR_H
+
+#include <pthread.h>
+#include <semaphore.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct _crad_t;
+
+/*! \name Command priority classes, highest first */
+/*! \{ */
+#define CRAD_PRIORITY_INTERACTIVE   0   /*!< tune, seek and settings asked for by a client */
+#define CRAD_PRIORITY_STATUS        1   /*!< status samples */
+#define CRAD_PRIORITY_BACKGROUND    2   /*!< RDS polling and station scan steps */
+#define CRAD_PRIORITY_COUNT         3
+/*! \} */
+
+/*! runs on the executor thread; the return value is handed back by crad_execute() */
+typedef int (*crad_command_fn)(struct _crad_t *p_crad, void *arg);
+
+/*! @brief One queued command, owned by the thread waiting for it */
+typedef struct _crad_command_t
+{
+    struct _crad_command_t * volatile next;
+    crad_command_fn     run;        /*!< NULL asks the executor to stop */
+    void               *arg;
+    int                 result;
+    sem_t               done;
+}
+crad_command_t;
+
+/*!
+
+  @brief Multi-producer, single-consumer command queue
+
+  An intrusive linked list in the style of Dmitry Vyukov's MPSC queue:
+  producers swap themselves in at the head with one atomic exchange, and
+  the executor alone walks the tail.  A producer caught between its
+  exchange and its link makes the queue look empty for a moment; the
+  executor's semaphore count says there is more to come, so it just tries
+  again.
+
+*/
+
+typedef struct _crad_command_queue_t
+{
+    crad_command_t * volatile head;
+    crad_command_t     *tail;
+    crad_command_t      stub;
+}
+crad_command_queue_t;
+
+/*! @brief Radio executor */
+typedef struct _crad_executor_t
+{
+    crad_command_queue_t queues[CRAD_PRIORITY_COUNT];
+    sem_t               pending;    /*!< one count per queued command */
+    pthread_t           thread;
+    int                 running;
+    struct _crad_t     *p_crad;     /*!< passed to every command */
+    /*! commands run, per class */
+    unsigned long       executed[CRAD_PRIORITY_COUNT];
+}
+crad_executor_t;
+
+/*!
+
+ Set up an executor.  Until its thread is started, and after it is
+ stopped, crad_execute() runs commands on the calling thread.
+
+  @param p_executor (OUT) - executor
+  @param p_crad (INP) - instance handed to the commands
+
+*/
+
+extern void crad_executor_init(crad_executor_t *p_executor, struct _crad_t *p_crad);
+
+/*! start the executor thread; returns CRAD_OK for success, otherwise CRAD_ error code */
+extern int crad_executor_start(crad_executor_t *p_executor);
+
+/*! run the commands already queued, then stop the executor thread */
+extern void crad_executor_stop(crad_executor_t *p_executor);
+
+/*! stop the executor if it is running, and release it */
+extern void crad_executor_destroy(crad_executor_t *p_executor);
+
+/*!
+
+ Run a command on the executor thread and wait for it to finish.  Called
+ from the executor thread itself, e.g. by a command, it runs at once.
+
+  @param p_executor (INP) - executor
+  @param priority (INP) - CRAD_PRIORITY_ class
+  @param run (INP) - command
+  @param arg (INP) - passed to the command
+  @return the command's return value
+
+*/
+
+extern int crad_execute(crad_executor_t *p_executor, int priority, crad_command_fn run, void *arg);
+
+/*!
+
+ Queue a command on a running executor without waiting for it.  The
+ command must stay put until crad_wait() has returned.
+
+  @param p_executor (INP) - executor, which must be started
+  @param priority (INP) - CRAD_PRIORITY_ class
+  @param p_command (OUT) - command record
+  @param run (INP) - command
+  @param arg (INP) - passed to the command
+
+*/
+
+extern void crad_submit(crad_executor_t *p_executor, int priority, crad_command_t *p_command, crad_command_fn run, void *arg);
+
+/*! wait for a command queued by crad_submit() to finish; returns its return value */
+extern int crad_wait(crad_command_t *p_command);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,193 @@
+/*
+    crad_file_cache.cpp
+
+    This file is part of chumbyradio.
+    Copyright (c) Chumby Industries, 2009
+
+    chumbyradio is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    chumbyradio is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with chumbyradio; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "crad_file_cache.h"
+
+/*! guards every ChumbRadioFile reference count */
+static pthread_mutex_t ref_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/*! serializes building gzip variants */
+static pthread_mutex_t gzip_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+ChumbRadioFile::ChumbRadioFile(int fd, const struct stat &st)
+{
+    char etag[64];
+
+    _fd = fd;
+    _stat = st;
+
+    snprintf(etag, sizeof(etag), "\"%lx-%lx-%lx\"",
+             (unsigned long)st.st_ino, (unsigned long)st.st_size, (unsigned long)st.st_mtime);
+    _etag = etag;
+
+    snprintf(etag, sizeof(etag), "\"%lx-%lx-%lx-gz\"",
+             (unsigned long)st.st_ino, (unsigned long)st.st_size, (unsigned long)st.st_mtime);
+    _gzipETag = etag;
+
+    _gzip = NULL;
+    _gzipBuilt = 0;
+
+    _checked = time(NULL);
+    _refs = 1;
+}
+
+ChumbRadioFile::~ChumbRadioFile()
+{
+    if(_gzip != NULL) { _gzip->unref(); }
+
+    close(_fd);
+}
+
+ChumbRadioBlob * ChumbRadioFile::getGzip()
+{
+    ChumbRadioBlob *gzip;
+
+    pthread_mutex_lock(&gzip_mutex);
+
+    if(!_gzipBuilt && (_stat.st_size <= CRAD_FILE_CACHE_GZIP_MAX_SIZE))
+    {
+        std::string content;
+        off_t offs = 0;
+        ssize_t got;
+
+        content.resize(_stat.st_size);
+
+        while( (offs < _stat.st_size) && ((got = pread(_fd, &content[offs], _stat.st_size - offs, offs)) > 0) )
+        {
+            offs += got;
+        }
+
+        if(offs == _stat.st_size)
+        {
+            _gzip = ChumbRadioBlob::gzip(content.data(), content.size(), CRAD_GZIP_LEVEL_STATIC);
+        }
+    }
+
+    _gzipBuilt = 1;
+
+    gzip = _gzip;
+
+    if(gzip != NULL) { gzip->ref(); }
+
+    pthread_mutex_unlock(&gzip_mutex);
+
+    return gzip;
+}
+
+void ChumbRadioFile::ref()
+{
+    pthread_mutex_lock(&ref_mutex);
+    _refs++;
+    pthread_mutex_unlock(&ref_mutex);
+}
+
+void ChumbRadioFile::unref()
+{
+    int refs;
+
+    pthread_mutex_lock(&ref_mutex);
+    refs = --_refs;
+    pthread_mutex_unlock(&ref_mutex);
+
+    /*! responses still streaming an old version keep it open until they finish */
+    if(refs == 0) { delete this; }
+}
+
+ChumbRadioFileCache::ChumbRadioFileCache()
+{
+    pthread_mutex_init(&_mutex, NULL);
+}
+
+ChumbRadioFileCache * ChumbRadioFileCache::instance()
+{
+    static ChumbRadioFileCache cache;
+
+    return &cache;
+}
+
+/*! returns 1 if a stat() result describes a different file than the cached one */
+static int fileChanged(const struct stat &cached, const struct stat &current)
+{
+    return (cached.st_ino != current.st_ino) ||
+           (cached.st_dev != current.st_dev) ||
+           (cached.st_size != current.st_size) ||
+           (cached.st_mtime != current.st_mtime);
+}
+
+ChumbRadioFile * ChumbRadioFileCache::acquire(const char *path)
+{
+    std::map<std::string, ChumbRadioFile *>::iterator it;
+    ChumbRadioFile *file = NULL;
+    time_t now = time(NULL);
+    struct stat st;
+
+    pthread_mutex_lock(&_mutex);
+
+    it = _files.find(path);
+
+    if(it != _files.end())
+    {
+        file = it->second;
+
+        /*! revalidate against the file system at most once per interval */
+        if(now - file->_checked >= CRAD_FILE_CACHE_CHECK_INTERVAL)
+        {
+            if( (stat(path, &st) == -1) || fileChanged(file->_stat, st) )
+            {
+                _files.erase(it);
+                file->unref();
+                file = NULL;
+            }
+            else
+            {
+                file->_checked = now;
+            }
+        }
+    }
+
+    if(file == NULL)
+    {
+        int fd = open(path, O_RDONLY);
+
+        if(fd != -1)
+        {
+            if( (fstat(fd, &st) == -1) || !S_ISREG(st.st_mode) )
+            {
+                close(fd);
+            }
+            else
+            {
+                file = new ChumbRadioFile(fd, st);
+                _files[path] = file;
+            }
+        }
+    }
+
+    /*! one reference for the table, one for the caller */
+    if(file != NULL) { file->ref(); }
+
+    pthread_mutex_unlock(&_mutex);
+
+    return file;
+}
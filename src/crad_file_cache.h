@@ -0,0 +1,103 @@
+/*
+ * crad_file_cache.h
+ *
+ * (c) Copyright Chumby Industries, 2009
+ * All rights reserved
+ *
+ * This header declares the open file table used to serve static widget
+ * files.  Descriptors and stat data stay cached between requests, and an
+ * entry is replaced as soon as the file on disk changes.
+ */
+
+#ifndef CRAD_FILE_CACHE_H
+#define CRAD_FILE_CACHE_H
+
+#include <string>
+#include <map>
+#include <time.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include "crad_blob.h"
+
+/*! seconds between stat() checks of a cached file */
+#define CRAD_FILE_CACHE_CHECK_INTERVAL  1
+
+/*! files larger than this are always sent uncompressed */
+#define CRAD_FILE_CACHE_GZIP_MAX_SIZE   (1024*1024)
+
+/*! @brief Reference counted open file */
+class ChumbRadioFile
+{
+    public:
+
+        int getDescriptor() const { return _fd; }
+        const struct stat & getStat() const { return _stat; }
+        off_t getSize() const { return _stat.st_size; }
+
+        /*! strong entity tag derived from inode, size and mtime */
+        const std::string & getETag() const { return _etag; }
+
+        /*! entity tag of the gzip variant */
+        const std::string & getGzipETag() const { return _gzipETag; }
+
+        /*!
+
+          Returns the gzip variant of this file, compressing it the first
+          time it is asked for.  Since a changed file gets a new cache
+          entry, the variant is rebuilt whenever the file changes.
+
+          @return referenced blob (release with unref()), or NULL if the
+                  file doesn't compress well enough to be worth it
+
+        */
+        ChumbRadioBlob * getGzip();
+
+        void ref();
+        void unref();
+
+    private:
+
+        friend class ChumbRadioFileCache;
+
+        ChumbRadioFile(int fd, const struct stat &st);
+        ~ChumbRadioFile();
+
+        int             _fd;
+        struct stat     _stat;
+        std::string     _etag;
+        std::string     _gzipETag;
+        ChumbRadioBlob *_gzip;
+        int             _gzipBuilt;
+        time_t          _checked;   /*!< last time the path was stat()ed */
+        int             _refs;
+};
+
+/*! @brief Table of open files, keyed by path */
+class ChumbRadioFileCache
+{
+    public:
+
+        /*! the table shared by every file handler */
+        static ChumbRadioFileCache * instance();
+
+        /*!
+
+          Look up a file, opening it on first use or when it has changed
+          on disk since it was cached.
+
+          @param path (INP) - file system path
+          @return referenced file (release with unref()), or NULL if the
+                  file can't be opened
+
+        */
+        ChumbRadioFile * acquire(const char *path);
+
+    private:
+
+        ChumbRadioFileCache();
+
+        std::map<std::string, ChumbRadioFile *> _files;
+        pthread_mutex_t _mutex;
+};
+
+#endif
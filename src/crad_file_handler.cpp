@@ -0,0 +1,87 @@
+/*
+    crad_file_handler.cpp
+
+    This file is part of chumbyradio.
+    Copyright (c) Chumby Industries, 2009
+
+    chumbyradio is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    chumbyradio is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with chumbyradio; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#include "crad_file_handler.h"
+
+ChumbRadioFileHandler::ChumbRadioFileHandler(const char *path, const char *filePath, const char *mimeType)
+{
+    _path = path;
+    _filePath = filePath;
+    _mimeType = mimeType;
+
+    /*! build the compressed variant now rather than on the first request */
+    {
+        ChumbRadioFile *file = ChumbRadioFileCache::instance()->acquire(filePath);
+
+        if(file != NULL)
+        {
+            ChumbRadioBlob *gzip = file->getGzip();
+
+            if(gzip != NULL) { gzip->unref(); }
+
+            file->unref();
+        }
+    }
+}
+
+ChumbRadioResponse * ChumbRadioFileHandler::serve(const ChumbRadioRequest &request)
+{
+    ChumbRadioSlice path = request.getPath();
+    ChumbRadioResponse *response;
+    ChumbRadioFile *file;
+    ChumbRadioBlob *gzip = NULL;
+
+    if(!path.equals(_path.c_str())) { return NULL; }
+
+    file = ChumbRadioFileCache::instance()->acquire(_filePath.c_str());
+
+    if(file == NULL) { return NULL; }
+
+    if(request.acceptsGzip()) { gzip = file->getGzip(); }
+
+    response = new ChumbRadioResponse(CRAD_HTTP_OK);
+
+    response->setMimeType(_mimeType.c_str());
+    response->addHeader("Vary", "Accept-Encoding");
+    response->addHeader("ETag", (gzip != NULL) ? file->getGzipETag() : file->getETag());
+    response->setLastModified(file->getStat().st_mtime);
+
+    /*! a widget reload with a current copy costs a header-only reply */
+    if(request.isNotModified((gzip != NULL) ? file->getGzipETag() : file->getETag(), file->getStat().st_mtime))
+    {
+        response->setNotModified();
+        file->unref();
+
+        if(gzip != NULL) { gzip->unref(); }
+    }
+    else if(gzip != NULL)
+    {
+        response->addHeader("Content-Encoding", "gzip");
+        response->setBlobContent(gzip);
+        file->unref();
+    }
+    else
+    {
+        response->setFileContent(file);
+    }
+
+    return response;
+}
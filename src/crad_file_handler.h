@@ -0,0 +1,34 @@
+/*
+ * crad_file_handler.h
+ *
+ * (c) Copyright Chumby Industries, 2009
+ * All rights reserved
+ *
+ * This header declares the static file handler used for the widget HTML
+ * and SWF.  It replaces chumby::HTTPSimpleFileContentHandler, which reads
+ * the whole file into memory on every request.
+ */
+
+#ifndef CRAD_FILE_HANDLER_H
+#define CRAD_FILE_HANDLER_H
+
+#include <string>
+#include "crad_http_handler.h"
+
+/*! @brief Chumby Radio static file handler */
+class ChumbRadioFileHandler : public ChumbRadioHandler
+{
+    public:
+
+        ChumbRadioFileHandler(const char *path, const char *filePath, const char *mimeType);
+
+        ChumbRadioResponse * serve(const ChumbRadioRequest &request);
+
+    private:
+
+        std::string _path;
+        std::string _filePath;
+        std::string _mimeType;
+};
+
+#endif
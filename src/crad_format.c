@@ -0,0 +1,510 @@
+/*
+    crad_format.c
+
+    This file is part of chumbyradio.
+    Copyright (c) Chumby Industries, 2009
+
+    chumbyradio is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    chumbyradio is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with chumbyradio; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#include <string.h>
+#include "crad_format.h"
+
+#define FIELD(type, member) offsetof(type, member)
+
+static const crad_field_t status_fields[] = {
+    { "generation",         CRAD_FIELD_UINT,    FIELD(crad_status_t, generation),           CRAD_FIELD_KEY,      0 },
+    { "found",              CRAD_FIELD_BOOL,    FIELD(crad_status_t, found),                0,                   0 },
+    { "state",              CRAD_FIELD_STRING,  FIELD(crad_status_t, state),                CRAD_FIELD_KEY,      0 },
+    { "tuned",              CRAD_FIELD_BOOL,    FIELD(crad_status_t, tuned),                0,                   CRAD_STATUS_READ_SIGNAL },
+    { "station",            CRAD_FIELD_STATION, FIELD(crad_status_t, channel),              0,                   CRAD_STATUS_READ_CHANNEL },
+    { "stereo",             CRAD_FIELD_BOOL,    FIELD(crad_status_t, stereo),               0,                   CRAD_STATUS_READ_STEREO },
+    { "signal",             CRAD_FIELD_INT,     FIELD(crad_status_t, signal),               0,                   CRAD_STATUS_READ_SIGNAL },
+    { "signal_max",         CRAD_FIELD_INT,     FIELD(crad_status_t, signal_max),           0,                   0 },
+    { "seek_threshold",     CRAD_FIELD_INT,     FIELD(crad_status_t, seek_threshold),       0,                   0 },
+    { "seek_threshold_max", CRAD_FIELD_INT,     FIELD(crad_status_t, seek_threshold_max),   0,                   0 },
+    { "spacing",            CRAD_FIELD_INT,     FIELD(crad_status_t, spacing),              0,                   0 },
+    { "start",              CRAD_FIELD_FREQ,    FIELD(crad_status_t, start),                0,                   0 },
+    { "stop",               CRAD_FIELD_FREQ,    FIELD(crad_status_t, stop),                 0,                   0 },
+    { "band",               CRAD_FIELD_STRING,  FIELD(crad_status_t, band),                 0,                   0 },
+    { "callsign",           CRAD_FIELD_TEXT,    FIELD(crad_status_t, callsign),             CRAD_FIELD_OPTIONAL, CRAD_STATUS_READ_RDS },
+    { "programservice",     CRAD_FIELD_TEXT,    FIELD(crad_status_t, program_service_name), CRAD_FIELD_OPTIONAL, CRAD_STATUS_READ_RDS },
+    { "ptycode",            CRAD_FIELD_STRING,  FIELD(crad_status_t, program_type_code),    CRAD_FIELD_OPTIONAL, CRAD_STATUS_READ_RDS },
+    { "radiotext0",         CRAD_FIELD_TEXT,    FIELD(crad_status_t, radiotext[0]),         CRAD_FIELD_OPTIONAL, CRAD_STATUS_READ_RDS },
+    { "radiotext1",         CRAD_FIELD_TEXT,    FIELD(crad_status_t, radiotext[1]),         CRAD_FIELD_OPTIONAL, CRAD_STATUS_READ_RDS },
+    { "juliandate",         CRAD_FIELD_INT,     FIELD(crad_status_t, julian_date),          CRAD_FIELD_OPTIONAL, CRAD_STATUS_READ_RDS },
+    { "hour",               CRAD_FIELD_INT,     FIELD(crad_status_t, hour_code),            CRAD_FIELD_OPTIONAL, CRAD_STATUS_READ_RDS },
+    { "minute",             CRAD_FIELD_INT,     FIELD(crad_status_t, minute),               CRAD_FIELD_OPTIONAL, CRAD_STATUS_READ_RDS },
+    { "localtime",          CRAD_FIELD_CLOCK,   FIELD(crad_status_t, localtime_hours),      CRAD_FIELD_OPTIONAL, CRAD_STATUS_READ_RDS },
+};
+
+static const crad_field_t station_fields[] = {
+    { "freq",               CRAD_FIELD_FREQ,    FIELD(crad_station_t, freq),                0,                   0 },
+};
+
+static const crad_field_t result_fields[] = {
+    { "command",            CRAD_FIELD_STRING,  FIELD(crad_result_t, command),              0,                   0 },
+    { "status",             CRAD_FIELD_STRING,  FIELD(crad_result_t, status),               0,                   0 },
+    { "job",                CRAD_FIELD_UINT,    FIELD(crad_result_t, job),                  CRAD_FIELD_OPTIONAL, 0 },
+};
+
+static const crad_field_t job_fields[] = {
+    { "id",                 CRAD_FIELD_UINT,    FIELD(crad_job_t, id),                      0,                   0 },
+    { "command",            CRAD_FIELD_STRING,  FIELD(crad_job_t, command),                 0,                   0 },
+    { "state",              CRAD_FIELD_STRING,  FIELD(crad_job_t, state),                   0,                   0 },
+    { "progress",           CRAD_FIELD_INT,     FIELD(crad_job_t, progress),                0,                   0 },
+    { "station",            CRAD_FIELD_FREQ,    FIELD(crad_job_t, station),                 0,                   0 },
+};
+
+#define COUNT(array) ((int)(sizeof(array)/sizeof(array[0])))
+
+const crad_schema_t crad_station_schema     = { "station",     "stations", station_fields, COUNT(station_fields), -1,                         -1,                           NULL,  NULL };
+const crad_schema_t crad_status_schema      = { "radio",       NULL,       status_fields,  COUNT(status_fields),  FIELD(crad_status_t, rds), FIELD(crad_status_t, reads), "rds", &crad_station_schema };
+const crad_schema_t crad_result_schema      = { "result",      "results",  result_fields,  COUNT(result_fields),  FIELD(crad_result_t, job), -1,                           NULL,  NULL };
+const crad_schema_t crad_result_list_schema = { "result-list", NULL,       NULL,           0,                     -1,                         -1,                           NULL,  &crad_result_schema };
+const crad_schema_t crad_job_schema         = { "job",         NULL,       job_fields,     COUNT(job_fields),     -1,                         -1,                           NULL,  &crad_station_schema };
+
+static const char *format_names[CRAD_FORMAT_COUNT] = { "xml", "json", "cbor" };
+static const char *format_mime_types[CRAD_FORMAT_COUNT] = { "text/xml", "application/json", "application/cbor" };
+
+/*! \name CBOR major types */
+/*! \{ */
+#define CBOR_UINT       0x00
+#define CBOR_NEGINT     0x20
+#define CBOR_TEXT       0x60
+#define CBOR_ARRAY      0x80
+#define CBOR_MAP        0xa0
+#define CBOR_FALSE      0xf4
+#define CBOR_TRUE       0xf5
+#define CBOR_FLOAT32    0xfa
+/*! \} */
+
+/*! append a CBOR item head, with the argument in its shortest form */
+static void cbor_head(crad_buffer_t *p_buffer, int major, unsigned int value) {
+    unsigned char head[5];
+    int length;
+
+    if(value < 24) {
+        head[0] = major | value;
+        length = 1;
+    }
+    else if(value < 0x100) {
+        head[0] = major | 24;
+        head[1] = value;
+        length = 2;
+    }
+    else if(value < 0x10000) {
+        head[0] = major | 25;
+        head[1] = value >> 8;
+        head[2] = value;
+        length = 3;
+    }
+    else {
+        head[0] = major | 26;
+        head[1] = value >> 24;
+        head[2] = value >> 16;
+        head[3] = value >> 8;
+        head[4] = value;
+        length = 5;
+    }
+
+    crad_buffer_append(p_buffer, (const char *)head, length);
+}
+
+static void cbor_text(crad_buffer_t *p_buffer, const char *str, int length) {
+    cbor_head(p_buffer, CBOR_TEXT, length);
+    crad_buffer_append(p_buffer, str, length);
+}
+
+static void cbor_int(crad_buffer_t *p_buffer, int value) {
+    if(value < 0) { cbor_head(p_buffer, CBOR_NEGINT, -1 - value); }
+    else { cbor_head(p_buffer, CBOR_UINT, value); }
+}
+
+static void cbor_float(crad_buffer_t *p_buffer, float value) {
+    unsigned char item[5];
+    unsigned int bits;
+
+    memcpy(&bits, &value, sizeof(bits));
+
+    item[0] = CBOR_FLOAT32;
+    item[1] = bits >> 24;
+    item[2] = bits >> 16;
+    item[3] = bits >> 8;
+    item[4] = bits;
+
+    crad_buffer_append(p_buffer, (const char *)item, sizeof(item));
+}
+
+/*! append str as the inside of a JSON string */
+static void json_escaped(crad_buffer_t *p_buffer, const char *str) {
+    static const char hex[] = "0123456789abcdef";
+    const char *run;
+
+    if(!str) { return; }
+
+    /*! copy runs of plain characters in one go */
+    for(run = str; *str; str++) {
+        unsigned char c = (unsigned char)*str;
+        char escaped[6];
+
+        if(c >= 0x20 && c != '"' && c != '\\') { continue; }
+
+        crad_buffer_append(p_buffer, run, str - run);
+
+        if(c >= 0x20) {
+            escaped[0] = '\\';
+            escaped[1] = c;
+            crad_buffer_append(p_buffer, escaped, 2);
+        }
+        else {
+            memcpy(escaped, "\\u00", 4);
+            escaped[4] = hex[c >> 4];
+            escaped[5] = hex[c & 0xf];
+            crad_buffer_append(p_buffer, escaped, 6);
+        }
+
+        run = str + 1;
+    }
+
+    crad_buffer_append(p_buffer, run, str - run);
+}
+
+/*! append a channel, in 10 kHz units, as MHz with two decimals */
+static void append_frequency(crad_buffer_t *p_buffer, int channel) {
+    crad_buffer_append_int(p_buffer, channel/100, 0);
+    crad_buffer_append(p_buffer, ".", 1);
+    crad_buffer_append_int(p_buffer, channel%100, 2);
+}
+
+/*! append a field's value in the text formats; strings are left to the caller */
+static void append_text_value(crad_buffer_t *p_buffer, int format, const crad_field_t *p_field, const char *p_value) {
+    switch(p_field->type) {
+        case CRAD_FIELD_INT:
+            crad_buffer_append_int(p_buffer, *(const int *)p_value, 0);
+            break;
+
+        case CRAD_FIELD_UINT:
+            crad_buffer_append_uint(p_buffer, *(const unsigned int *)p_value, 0);
+            break;
+
+        case CRAD_FIELD_BOOL:
+            if(format == CRAD_FORMAT_XML) { crad_buffer_append_str(p_buffer, *(const int *)p_value ? "1" : "0"); }
+            else { crad_buffer_append_str(p_buffer, *(const int *)p_value ? "true" : "false"); }
+            break;
+
+        case CRAD_FIELD_STATION:
+            // The XML has always shown e.g. 88.5 MHz as "88.50" and 88.05 MHz as "88.5"
+            if(format == CRAD_FORMAT_XML) {
+                crad_buffer_append_int(p_buffer, *(const int *)p_value/100, 0);
+                crad_buffer_append(p_buffer, ".", 1);
+                crad_buffer_append_int(p_buffer, *(const int *)p_value%100, 0);
+                break;
+            }
+            /*! fall through */
+
+        case CRAD_FIELD_FREQ:
+            append_frequency(p_buffer, *(const int *)p_value);
+            break;
+
+        case CRAD_FIELD_CLOCK:
+            crad_buffer_append_int(p_buffer, ((const int *)p_value)[0], 0);
+            crad_buffer_append(p_buffer, ":", 1);
+            crad_buffer_append_int(p_buffer, ((const int *)p_value)[1], 2);
+            break;
+    }
+}
+
+/*! returns 1 if a field's text form needs quoting in JSON */
+static int json_quoted(const crad_field_t *p_field) {
+    return p_field->type == CRAD_FIELD_CLOCK || p_field->type == CRAD_FIELD_TEXT || p_field->type == CRAD_FIELD_STRING;
+}
+
+/*! returns the string value of a text or string field */
+static const char *string_value(const crad_field_t *p_field, const char *p_value) {
+    const char *str = (p_field->type == CRAD_FIELD_TEXT) ? p_value : *(const char * const *)p_value;
+
+    return str ? str : "";
+}
+
+/*! append a field as " name='value'" (XML), "name":value (JSON) or a key and value (CBOR) */
+static void append_field(crad_buffer_t *p_buffer, int format, const crad_field_t *p_field, const void *p_record) {
+    const char *p_value = (const char *)p_record + p_field->offset;
+    int string = (p_field->type == CRAD_FIELD_TEXT || p_field->type == CRAD_FIELD_STRING);
+
+    switch(format) {
+        case CRAD_FORMAT_XML:
+            crad_buffer_append(p_buffer, " ", 1);
+            crad_buffer_append_str(p_buffer, p_field->name);
+            crad_buffer_append(p_buffer, "='", 2);
+            if(string) { crad_buffer_append_escaped(p_buffer, string_value(p_field, p_value)); }
+            else { append_text_value(p_buffer, format, p_field, p_value); }
+            crad_buffer_append(p_buffer, "'", 1);
+            break;
+
+        case CRAD_FORMAT_JSON:
+            crad_buffer_append(p_buffer, "\"", 1);
+            crad_buffer_append_str(p_buffer, p_field->name);
+            crad_buffer_append(p_buffer, "\":", 2);
+            if(json_quoted(p_field)) { crad_buffer_append(p_buffer, "\"", 1); }
+            if(string) { json_escaped(p_buffer, string_value(p_field, p_value)); }
+            else { append_text_value(p_buffer, format, p_field, p_value); }
+            if(json_quoted(p_field)) { crad_buffer_append(p_buffer, "\"", 1); }
+            break;
+
+        case CRAD_FORMAT_CBOR:
+            cbor_text(p_buffer, p_field->name, strlen(p_field->name));
+
+            switch(p_field->type) {
+                case CRAD_FIELD_INT:
+                    cbor_int(p_buffer, *(const int *)p_value);
+                    break;
+
+                case CRAD_FIELD_UINT:
+                    cbor_head(p_buffer, CBOR_UINT, *(const unsigned int *)p_value);
+                    break;
+
+                case CRAD_FIELD_BOOL:
+                {
+                    char item = *(const int *)p_value ? CBOR_TRUE : CBOR_FALSE;
+
+                    crad_buffer_append(p_buffer, &item, 1);
+                }
+                break;
+
+                case CRAD_FIELD_FREQ:
+                case CRAD_FIELD_STATION:
+                    cbor_float(p_buffer, *(const int *)p_value / 100.0f);
+                    break;
+
+                case CRAD_FIELD_CLOCK:
+                {
+                    /*! "h:mm" is always shorter than 24 bytes, so its head
+                     *  is a single byte, patched once the length is known */
+                    int head = p_buffer->length;
+
+                    cbor_head(p_buffer, CBOR_TEXT, 0);
+                    append_text_value(p_buffer, format, p_field, p_value);
+                    if(!p_buffer->failed) { p_buffer->data[head] = CBOR_TEXT | (p_buffer->length - head - 1); }
+                }
+                break;
+
+                default:
+                {
+                    const char *str = string_value(p_field, p_value);
+
+                    cbor_text(p_buffer, str, strlen(str));
+                }
+                break;
+            }
+            break;
+    }
+}
+
+/*! returns 1 if a field of a record is shown */
+static int field_shown(const crad_schema_t *p_schema, int f, const void *p_record, unsigned int mask) {
+    const crad_field_t *p_field = &p_schema->fields[f];
+
+    if(!(mask & (1u << f)) && !(p_field->flags & CRAD_FIELD_KEY)) { return 0; }
+
+    // e.g. the station, before the chip is up to be asked
+    if(p_schema->reads >= 0 && (p_field->reads & ~*(const int *)((const char *)p_record + p_schema->reads))) { return 0; }
+
+    if(!(p_field->flags & CRAD_FIELD_OPTIONAL) || p_schema->present < 0) { return 1; }
+
+    return *(const int *)((const char *)p_record + p_schema->present);
+}
+
+/*! append the fields of a record, returning how many were shown */
+static int append_fields(crad_buffer_t *p_buffer, int format, const crad_schema_t *p_schema, const void *p_record, unsigned int mask) {
+    int f, shown = 0;
+
+    for(f = 0; f < p_schema->field_count; f++) {
+        if(!field_shown(p_schema, f, p_record, mask)) { continue; }
+
+        if(format == CRAD_FORMAT_JSON && shown) { crad_buffer_append(p_buffer, ",", 1); }
+
+        append_field(p_buffer, format, &p_schema->fields[f], p_record);
+        shown++;
+    }
+
+    return shown;
+}
+
+/*! returns the number of fields of a record that will be shown */
+static int count_fields(const crad_schema_t *p_schema, const void *p_record, unsigned int mask) {
+    int f, shown = 0;
+
+    for(f = 0; f < p_schema->field_count; f++) {
+        shown += field_shown(p_schema, f, p_record, mask);
+    }
+
+    return shown;
+}
+
+void crad_format_begin(struct _crad_buffer_t *p_buffer, int format, const crad_schema_t *p_schema, const void *p_record, unsigned int mask, int child_count) {
+    const char *list = p_schema->children->list;
+    int shown;
+
+    switch(format) {
+        case CRAD_FORMAT_XML:
+            crad_buffer_append_str(p_buffer, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<");
+            crad_buffer_append_str(p_buffer, p_schema->element);
+            append_fields(p_buffer, format, p_schema, p_record, mask);
+            crad_buffer_append(p_buffer, ">\n", 2);
+            break;
+
+        case CRAD_FORMAT_JSON:
+            crad_buffer_append(p_buffer, "{", 1);
+            shown = append_fields(p_buffer, format, p_schema, p_record, mask);
+            if(mask & CRAD_FIELDS_LIST) {
+                if(shown) { crad_buffer_append(p_buffer, ",", 1); }
+                crad_buffer_append(p_buffer, "\"", 1);
+                crad_buffer_append_str(p_buffer, list);
+                crad_buffer_append(p_buffer, "\":[", 3);
+            }
+            break;
+
+        case CRAD_FORMAT_CBOR:
+            cbor_head(p_buffer, CBOR_MAP, count_fields(p_schema, p_record, mask) + ((mask & CRAD_FIELDS_LIST) ? 1 : 0));
+            append_fields(p_buffer, format, p_schema, p_record, mask);
+            if(mask & CRAD_FIELDS_LIST) {
+                cbor_text(p_buffer, list, strlen(list));
+                cbor_head(p_buffer, CBOR_ARRAY, child_count);
+            }
+            break;
+    }
+}
+
+void crad_format_child(struct _crad_buffer_t *p_buffer, int format, const crad_schema_t *p_schema, const void *p_record, int index) {
+    switch(format) {
+        case CRAD_FORMAT_XML:
+            crad_buffer_append(p_buffer, "  <", 3);
+            crad_buffer_append_str(p_buffer, p_schema->element);
+            append_fields(p_buffer, format, p_schema, p_record, CRAD_FIELDS_ALL);
+            crad_buffer_append(p_buffer, "/>\n", 3);
+            break;
+
+        case CRAD_FORMAT_JSON:
+            crad_buffer_append_str(p_buffer, index ? ",{" : "{");
+            append_fields(p_buffer, format, p_schema, p_record, CRAD_FIELDS_ALL);
+            crad_buffer_append(p_buffer, "}", 1);
+            break;
+
+        case CRAD_FORMAT_CBOR:
+            cbor_head(p_buffer, CBOR_MAP, count_fields(p_schema, p_record, CRAD_FIELDS_ALL));
+            append_fields(p_buffer, format, p_schema, p_record, CRAD_FIELDS_ALL);
+            break;
+    }
+}
+
+void crad_format_end(struct _crad_buffer_t *p_buffer, int format, const crad_schema_t *p_schema, unsigned int mask) {
+    switch(format) {
+        case CRAD_FORMAT_XML:
+            crad_buffer_append(p_buffer, "</", 2);
+            crad_buffer_append_str(p_buffer, p_schema->element);
+            crad_buffer_append(p_buffer, ">\n", 2);
+            break;
+
+        case CRAD_FORMAT_JSON:
+            crad_buffer_append_str(p_buffer, (mask & CRAD_FIELDS_LIST) ? "]}" : "}");
+            break;
+    }
+}
+
+/*! returns the mask of the fields one name of a field list selects, or 0 */
+static unsigned int name_mask(const crad_schema_t *p_schema, const char *name, int length) {
+    int group = p_schema->group ? strlen(p_schema->group) : 0;
+    unsigned int mask = 0;
+    int f;
+
+    if(p_schema->children && length == (int)strlen(p_schema->children->list) && !strncmp(name, p_schema->children->list, length)) {
+        return CRAD_FIELDS_LIST;
+    }
+
+    /*! "rds" selects the whole group, "rds.radiotext" the ones starting "radiotext" */
+    if(group && length >= group && !strncmp(name, p_schema->group, group) && (length == group || name[group] == '.')) {
+        const char *prefix = name + group + 1;
+        int prefix_length = (length == group) ? 0 : length - group - 1;
+
+        for(f = 0; f < p_schema->field_count; f++) {
+            if((p_schema->fields[f].flags & CRAD_FIELD_OPTIONAL) && !strncmp(p_schema->fields[f].name, prefix, prefix_length)) {
+                mask |= 1u << f;
+            }
+        }
+
+        return mask;
+    }
+
+    for(f = 0; f < p_schema->field_count; f++) {
+        if(length == (int)strlen(p_schema->fields[f].name) && !strncmp(p_schema->fields[f].name, name, length)) {
+            return 1u << f;
+        }
+    }
+
+    return 0;
+}
+
+int crad_format_fields(const crad_schema_t *p_schema, const char *names, unsigned int *p_mask) {
+    unsigned int mask = 0;
+
+    while(*names) {
+        const char *end = strchr(names, ',');
+        int length = end ? end - names : (int)strlen(names);
+
+        if(length > 0) {
+            unsigned int selected = name_mask(p_schema, names, length);
+
+            if(!selected) { return CRAD_INVALID_PARAM; }
+
+            mask |= selected;
+        }
+
+        names += length;
+        if(*names == ',') { names++; }
+    }
+
+    *p_mask = mask;
+
+    return CRAD_OK;
+}
+
+int crad_format_reads(const crad_schema_t *p_schema, unsigned int mask) {
+    int f, reads = 0;
+
+    for(f = 0; f < p_schema->field_count; f++) {
+        if(mask & (1u << f)) { reads |= p_schema->fields[f].reads; }
+    }
+
+    return reads;
+}
+
+int crad_format_lookup(const char *name) {
+    int format;
+
+    for(format = 0; format < CRAD_FORMAT_COUNT; format++) {
+        if(!strcmp(name, format_names[format])) { return format; }
+    }
+
+    return -1;
+}
+
+const char *crad_format_name(int format) {
+    return format_names[format];
+}
+
+const char *crad_format_mime_type(int format) {
+    return format_mime_types[format];
+}
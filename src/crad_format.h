@@ -0,0 +1,178 @@
+/*
+ * crad_format.h
+ *
+ * (c) Copyright Chumby Industries, 2009
+ * All rights reserved
+ *
+ * This header declares the record schemas shared by the XML, JSON and CBOR
+ * renderings of the radio's responses.  Each record type is described once,
+ * as a table of fields, and one writer walks that table for every format,
+ * so the formats carry the same data by construction.
+ */
+
+#ifndef CRAD_FORMAT_H
+#define CRAD_FORMAT_H
+
+#include <stddef.h>
+#include "crad_interface.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*! \name Output formats */
+/*! \{ */
+#define CRAD_FORMAT_XML         0
+#define CRAD_FORMAT_JSON        1
+#define CRAD_FORMAT_CBOR        2   /*!< RFC 7049, definite lengths throughout */
+#define CRAD_FORMAT_COUNT       3
+/*! \} */
+
+/*! \name Field types */
+/*! \{ */
+#define CRAD_FIELD_INT          0   /*!< int */
+#define CRAD_FIELD_UINT         1   /*!< unsigned int */
+#define CRAD_FIELD_BOOL         2   /*!< int; XML '1'/'0', JSON and CBOR true/false */
+#define CRAD_FIELD_FREQ         3   /*!< int in 10 kHz units; MHz with two decimals (CBOR float) */
+#define CRAD_FIELD_STATION      4   /*!< as CRAD_FIELD_FREQ, but the XML keeps the legacy "%d.%d" form */
+#define CRAD_FIELD_CLOCK        5   /*!< two ints, hours then minutes; "h:mm" */
+#define CRAD_FIELD_TEXT         6   /*!< NUL terminated char array */
+#define CRAD_FIELD_STRING       7   /*!< const char *, NULL for empty */
+/*! \} */
+
+/*! \name Field flags */
+/*! \{ */
+#define CRAD_FIELD_OPTIONAL     0x0001  /*!< only present when the schema's present flag is set */
+#define CRAD_FIELD_KEY          0x0002  /*!< shown even when a field mask leaves it out */
+/*! \} */
+
+/*! \name Field masks: bit n selects field n of a schema */
+/*! \{ */
+#define CRAD_FIELDS_ALL         0xffffffff
+#define CRAD_FIELDS_LIST        0x80000000  /*!< the list of child records */
+/*! \} */
+
+/*! @brief One field of a record */
+typedef struct _crad_field_t
+{
+    const char *name;       /*!< XML attribute, JSON and CBOR key */
+    int         type;       /*!< CRAD_FIELD_ type */
+    size_t      offset;     /*!< offset of the value in the record */
+    int         flags;      /*!< CRAD_FIELD_ flags */
+    int         reads;      /*!< CRAD_STATUS_READ_ flags needed to fill the value in */
+}
+crad_field_t;
+
+/*! @brief Record schema */
+typedef struct _crad_schema_t
+{
+    const char         *element;    /*!< XML element name */
+    const char         *list;       /*!< JSON and CBOR key of a list of these records */
+    const crad_field_t *fields;
+    int                 field_count; /*!< at most 31, see CRAD_FIELDS_LIST */
+    int                 present;    /*!< offset of an int enabling the optional fields, or -1 */
+    int                 reads;      /*!< offset of the CRAD_STATUS_READ_ flags the record was
+                                         read with, or -1; fields needing a read that wasn't
+                                         taken are left out */
+    const char         *group;      /*!< name for the optional fields in a field list, e.g. "rds" */
+    const struct _crad_schema_t *children; /*!< schema of the child records */
+}
+crad_schema_t;
+
+/*! @brief One /radio/configure result, see crad_result_schema */
+typedef struct _crad_result_t
+{
+    const char *command;
+    const char *status;     /*!< "success" or "failure", "queued" for a job, or "initializing" if turned away until the chip is up */
+    unsigned int job;       /*!< id of the job running the command, 0 if it has run */
+}
+crad_result_t;
+
+/*! @brief A tune, seek or scan job, see crad_job_schema */
+typedef struct _crad_job_t
+{
+    unsigned int id;
+    const char *command;    /*!< the /radio/configure parameter that started it */
+    const char *state;      /*!< "queued", "running", "success", "failure" or "cancelled" */
+    int progress;           /*!< percent done */
+    int station;            /*!< tuned once it has finished, in 10 kHz units */
+}
+crad_job_t;
+
+/*! @brief One station found by a scan, see crad_station_schema */
+typedef struct _crad_station_t
+{
+    int freq;               /*!< in 10 kHz units */
+}
+crad_station_t;
+
+/*! \name Schemas */
+/*! \{ */
+extern const crad_schema_t crad_status_schema;      /*!< crad_status_t, with a list of stations */
+extern const crad_schema_t crad_station_schema;     /*!< crad_station_t */
+extern const crad_schema_t crad_result_list_schema; /*!< no fields, with a list of results */
+extern const crad_schema_t crad_result_schema;      /*!< crad_result_t */
+extern const crad_schema_t crad_job_schema;         /*!< crad_job_t, with the stations a scan found */
+/*! \} */
+
+/*!
+
+ Begin a document: a record holding a list of child records.
+
+  @param p_buffer (INP/OUT) - buffer to append to
+  @param format (INP) - CRAD_FORMAT_ format
+  @param p_schema (INP) - schema of the record
+  @param p_record (INP) - the record, or NULL if the schema has no fields
+  @param mask (INP) - fields to show, see crad_format_fields()
+  @param child_count (INP) - number of children that will follow
+
+*/
+
+extern void crad_format_begin(struct _crad_buffer_t *p_buffer, int format, const crad_schema_t *p_schema, const void *p_record, unsigned int mask, int child_count);
+
+/*!
+
+ Append one child record.  Nothing should be appended if the mask passed
+ to crad_format_begin() left out CRAD_FIELDS_LIST.
+
+  @param index (INP) - position of the child, starting at 0
+
+*/
+
+extern void crad_format_child(struct _crad_buffer_t *p_buffer, int format, const crad_schema_t *p_schema, const void *p_record, int index);
+
+/*! End the document begun by crad_format_begin(), with the same mask */
+extern void crad_format_end(struct _crad_buffer_t *p_buffer, int format, const crad_schema_t *p_schema, unsigned int mask);
+
+/*!
+
+ Parse a field list, such as "station,signal,rds.radiotext", into a mask.
+ Each name is a field, the key of the child list, the schema's group (all
+ of its optional fields), or the group, a dot and the start of the names
+ of some of them.
+
+  @param p_schema (INP) - schema the names refer to
+  @param names (INP) - comma separated field names
+  @param p_mask (OUT) - field mask
+  @return CRAD_OK for success, CRAD_INVALID_PARAM if a name matches nothing
+
+*/
+
+extern int crad_format_fields(const crad_schema_t *p_schema, const char *names, unsigned int *p_mask);
+
+/*! returns the CRAD_STATUS_READ_ flags needed to show the fields in mask */
+extern int crad_format_reads(const crad_schema_t *p_schema, unsigned int mask);
+
+/*! \name Format names and content types */
+/*! \{ */
+/*! returns the CRAD_FORMAT_ for a name ("xml", "json" or "cbor"), or -1 */
+extern int crad_format_lookup(const char *name);
+extern const char *crad_format_name(int format);
+extern const char *crad_format_mime_type(int format);
+/*! \} */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,51 @@
+/*
+    crad_http_handler.cpp
+
+    This file is part of chumbyradio.
+    Copyright (c) Chumby Industries, 2009
+
+    chumbyradio is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    chumbyradio is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with chumbyradio; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#include "crad_http_handler.h"
+
+chumby::HTTPResponse * ChumbRadioHandler::handleRequest(const chumby::HTTPRequest & request)
+{
+    ChumbRadioRequest native_request;
+    ChumbRadioResponse *native_response;
+    chumby::HTTPResponse *response;
+
+    /*! the threaded server only exposes the request URI */
+    native_request.setRequestURI(request.getRequestURI());
+
+    native_response = serve(native_request);
+
+    /*! a connection thread has nowhere to park, so serve it straight away */
+    if( (native_response != NULL) && (native_response->getParkTimeout() > 0) )
+    {
+        delete native_response;
+
+        native_request.setWaitExpired(1);
+        native_response = serve(native_request);
+    }
+
+    if(native_response == NULL) { return NULL; }
+
+    response = native_response->toHTTPResponse();
+
+    delete native_response;
+
+    return response;
+}
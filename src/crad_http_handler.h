@@ -0,0 +1,31 @@
+/*
+ * crad_http_handler.h
+ *
+ * (c) Copyright Chumby Industries, 2009
+ * All rights reserved
+ *
+ * This header declares the base class for handlers that produce a
+ * ChumbRadioResponse.  The event driven server calls serve() directly;
+ * the threaded server goes through handleRequest(), which converts the
+ * result to a chumby::HTTPResponse.
+ */
+
+#ifndef CRAD_HTTP_HANDLER_H
+#define CRAD_HTTP_HANDLER_H
+
+#include <chumby_httpd/chumby_http_content_handler.h>
+#include "crad_http_request.h"
+#include "crad_http_response.h"
+
+/*! @brief Chumby Radio native content handler */
+class ChumbRadioHandler : public chumby::HTTPContentHandler
+{
+    public:
+
+        /*! returns a new response, or NULL if this handler does not serve the request */
+        virtual ChumbRadioResponse * serve(const ChumbRadioRequest &request) = 0;
+
+        chumby::HTTPResponse * handleRequest(const chumby::HTTPRequest & request);
+};
+
+#endif
@@ -0,0 +1,449 @@
+/*
+    crad_http_request.cpp
+
+    This file is part of chumbyradio.
+    Copyright (c) Chumby Industries, 2009
+
+    chumbyradio is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    chumbyradio is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with chumbyradio; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include "crad_http_request.h"
+
+int ChumbRadioSlice::equals(const char *str) const
+{
+    return (data != NULL) && (strlen(str) == length) && !memcmp(data, str, length);
+}
+
+int ChumbRadioSlice::equalsIgnoreCase(const char *str) const
+{
+    return (data != NULL) && (strlen(str) == length) && !strncasecmp(data, str, length);
+}
+
+/*! utility function used to strip leading and trailing whitespace */
+static ChumbRadioSlice trim(const char *beg, const char *end)
+{
+    while( (beg < end) && ((*beg == ' ') || (*beg == '\t')) ) { beg++; }
+    while( (end > beg) && ((end[-1] == ' ') || (end[-1] == '\t') || (end[-1] == '\r')) ) { end--; }
+
+    return ChumbRadioSlice(beg, end - beg);
+}
+
+/*! utility function used to parse an HTTP-date (RFC 1123, RFC 850 or asctime form) */
+static time_t parseHTTPDate(ChumbRadioSlice date)
+{
+    static const char *formats[] = { "%a, %d %b %Y %H:%M:%S GMT", "%A, %d-%b-%y %H:%M:%S GMT", "%a %b %e %H:%M:%S %Y" };
+    char str[64];
+    unsigned int f;
+
+    if(date.length >= sizeof(str)) { return (time_t)-1; }
+
+    memcpy(str, date.data, date.length);
+    str[date.length] = '\0';
+
+    for(f=0;f<sizeof(formats)/sizeof(formats[0]);f++)
+    {
+        struct tm tm;
+
+        memset(&tm, 0, sizeof(tm));
+
+        if(strptime(str, formats[f], &tm) != NULL) { return timegm(&tm); }
+    }
+
+    return (time_t)-1;
+}
+
+/*! returns 1 if a comma separated If-None-Match list names etag (weak comparison) */
+static int matchETag(ChumbRadioSlice list, const std::string &etag)
+{
+    const char *beg = list.data;
+    const char *end = list.data + list.length;
+
+    while(beg < end)
+    {
+        const char *comma = (const char *)memchr(beg, ',', end - beg);
+        ChumbRadioSlice candidate;
+
+        if(comma == NULL) { comma = end; }
+
+        candidate = trim(beg, comma);
+
+        if(candidate.equals("*")) { return 1; }
+
+        if( (candidate.length >= 2) && !memcmp(candidate.data, "W/", 2) )
+        {
+            candidate.data += 2;
+            candidate.length -= 2;
+        }
+
+        if( (candidate.length == etag.size()) && !memcmp(candidate.data, etag.data(), etag.size()) ) { return 1; }
+
+        beg = comma + 1;
+    }
+
+    return 0;
+}
+
+/*! returns the q-value of one Accept-Encoding element ("gzip;q=0.5") */
+static double parseQValue(ChumbRadioSlice element)
+{
+    const char *end = element.data + element.length;
+    const char *q = (const char *)memchr(element.data, ';', element.length);
+    char str[16];
+
+    if(q == NULL) { return 1.0; }
+
+    q = trim(q + 1, end).data;
+
+    if( (end - q < 2) || (q[0] != 'q') || (q[1] != '=') ) { return 1.0; }
+
+    q += 2;
+
+    if(end - q >= (long)sizeof(str)) { return 1.0; }
+
+    memcpy(str, q, end - q);
+    str[end - q] = '\0';
+
+    return atof(str);
+}
+
+ChumbRadioRequest::ChumbRadioRequest()
+{
+    reset();
+}
+
+void ChumbRadioRequest::reset()
+{
+    _state = REQUEST_LINE;
+    _requestMethod = chumby::GET;
+    _httpVersion = chumby::HTTP_1_0;
+    _base = NULL;
+    _lineBegin = 0;
+    _scanned = 0;
+    _requestBegin = 0;
+    _uriBegin = 0;
+    _uriLength = 0;
+    _headersBegin = 0;
+    _headersEnd = 0;
+    _headEnd = 0;
+    _bodyLength = 0;
+    _waitExpired = 0;
+}
+
+long ChumbRadioRequest::parse(const char *data, long length)
+{
+    /*! the previous request was handed out; this is the next one */
+    if(_state == COMPLETE) { reset(); }
+
+    /*! request line and header fields, one line at a time */
+    while( (_state == REQUEST_LINE) || (_state == HEADER_LINES) )
+    {
+        const char *nl = (const char *)memchr(data + _scanned, '\n', length - _scanned);
+        size_t line_end;
+
+        if(nl == NULL)
+        {
+            _scanned = length;
+            return CRAD_HTTP_PARSE_INCOMPLETE;
+        }
+
+        /*! line without its CRLF (a bare LF is tolerated) */
+        line_end = nl - data;
+        _scanned = line_end + 1;
+
+        if( (line_end > _lineBegin) && (data[line_end - 1] == '\r') ) { line_end--; }
+
+        if(_state == REQUEST_LINE)
+        {
+            /*! ignore blank lines ahead of the request line */
+            if(line_end == _lineBegin)
+            {
+                _requestBegin = _scanned;
+            }
+            else if(!parseRequestLine(data, _lineBegin, line_end))
+            {
+                return CRAD_HTTP_PARSE_ERROR;
+            }
+            else if(_httpVersion == chumby::HTTP_0_9)
+            {
+                /*! a simple request has no header fields */
+                _headersBegin = _headersEnd = _headEnd = _scanned;
+                _state = BODY;
+            }
+            else
+            {
+                _headersBegin = _scanned;
+                _state = HEADER_LINES;
+            }
+        }
+        else if(line_end == _lineBegin)
+        {
+            /*! blank line ends the request head */
+            _headersEnd = _lineBegin;
+            _headEnd = _scanned;
+            _state = BODY;
+        }
+        else if(!parseHeaderLine(data, _lineBegin, line_end))
+        {
+            return CRAD_HTTP_PARSE_ERROR;
+        }
+
+        _lineBegin = _scanned;
+    }
+
+    if(_headEnd + _bodyLength > (size_t)length) { return CRAD_HTTP_PARSE_INCOMPLETE; }
+
+    _state = COMPLETE;
+    _base = data;
+
+    return _headEnd + _bodyLength;
+}
+
+/*! METHOD SP URI [SP VERSION] */
+int ChumbRadioRequest::parseRequestLine(const char *data, size_t begin, size_t end)
+{
+    const char *line = data + begin;
+    size_t length = end - begin;
+    const char *sp1 = (const char *)memchr(line, ' ', length);
+    const char *sp2;
+
+    if(sp1 == NULL) { return 0; }
+
+    if( (sp1 - line == 3) && !memcmp(line, "GET", 3) ) { _requestMethod = chumby::GET; }
+    else if( (sp1 - line == 4) && !memcmp(line, "HEAD", 4) ) { _requestMethod = chumby::HEAD; }
+    else if( (sp1 - line == 4) && !memcmp(line, "POST", 4) ) { _requestMethod = chumby::POST; }
+    else { return 0; }
+
+    sp2 = (const char *)memchr(sp1 + 1, ' ', line + length - sp1 - 1);
+
+    _uriBegin = sp1 + 1 - data;
+
+    if(sp2 == NULL)
+    {
+        _uriLength = line + length - sp1 - 1;
+        _httpVersion = chumby::HTTP_0_9;
+    }
+    else
+    {
+        _uriLength = sp2 - sp1 - 1;
+
+        if( (line + length - sp2 - 1 == 8) && !memcmp(sp2 + 1, "HTTP/1.1", 8) ) { _httpVersion = chumby::HTTP_1_1; }
+        else if( (line + length - sp2 - 1 == 8) && !memcmp(sp2 + 1, "HTTP/1.0", 8) ) { _httpVersion = chumby::HTTP_1_0; }
+        else { return 0; }
+    }
+
+    return (_uriLength > 0) ? 1 : 0;
+}
+
+/*! NAME ":" VALUE; only the fields that frame the body are looked at now */
+int ChumbRadioRequest::parseHeaderLine(const char *data, size_t begin, size_t end)
+{
+    const char *line = data + begin;
+    const char *colon = (const char *)memchr(line, ':', end - begin);
+    ChumbRadioSlice name, value;
+
+    if( (colon == NULL) || (colon == line) ) { return 0; }
+
+    name = ChumbRadioSlice(line, colon - line);
+
+    /*! we can't frame chunked request bodies */
+    if(name.equalsIgnoreCase("transfer-encoding")) { return 0; }
+
+    if(name.equalsIgnoreCase("content-length"))
+    {
+        size_t c;
+
+        value = trim(colon + 1, data + end);
+
+        if(value.length == 0) { return 0; }
+
+        _bodyLength = 0;
+
+        for(c=0;c<value.length;c++)
+        {
+            if( (value.data[c] < '0') || (value.data[c] > '9') ) { return 0; }
+
+            _bodyLength = _bodyLength * 10 + (value.data[c] - '0');
+
+            /*! anything this large can't fit in a receive buffer anyway */
+            if(_bodyLength > 0x7FFFFFF) { return 0; }
+        }
+    }
+
+    return 1;
+}
+
+ChumbRadioSlice ChumbRadioRequest::getRequestURI() const
+{
+    if(_base == NULL) { return ChumbRadioSlice(); }
+
+    return ChumbRadioSlice(_base + _uriBegin, _uriLength);
+}
+
+ChumbRadioSlice ChumbRadioRequest::getPath() const
+{
+    ChumbRadioSlice uri = getRequestURI();
+    const char *query;
+
+    if(uri.isNull()) { return uri; }
+
+    query = (const char *)memchr(uri.data, '?', uri.length);
+
+    if(query != NULL) { uri.length = query - uri.data; }
+
+    return uri;
+}
+
+ChumbRadioSlice ChumbRadioRequest::getQuery() const
+{
+    ChumbRadioSlice uri = getRequestURI();
+    const char *query;
+
+    if(uri.isNull()) { return uri; }
+
+    query = (const char *)memchr(uri.data, '?', uri.length);
+
+    if(query == NULL) { return ChumbRadioSlice(); }
+
+    return ChumbRadioSlice(query + 1, uri.data + uri.length - query - 1);
+}
+
+ChumbRadioSlice ChumbRadioRequest::getRawRequest() const
+{
+    if(_base == NULL) { return ChumbRadioSlice(); }
+
+    return ChumbRadioSlice(_base + _requestBegin, _headEnd + _bodyLength - _requestBegin);
+}
+
+void ChumbRadioRequest::setRequestURI(const std::string &uri)
+{
+    reset();
+
+    _storage = uri;
+    _base = _storage.data();
+    _uriBegin = 0;
+    _uriLength = _storage.size();
+    _state = COMPLETE;
+}
+
+ChumbRadioSlice ChumbRadioRequest::getHeader(const char *name) const
+{
+    size_t name_length = strlen(name);
+    const char *line, *end;
+
+    if(_base == NULL) { return ChumbRadioSlice(); }
+
+    line = _base + _headersBegin;
+    end = _base + _headersEnd;
+
+    while(line < end)
+    {
+        const char *nl = (const char *)memchr(line, '\n', end - line);
+        const char *colon;
+
+        if(nl == NULL) { nl = end; }
+
+        colon = (const char *)memchr(line, ':', nl - line);
+
+        if( (colon != NULL) && ((size_t)(colon - line) == name_length) && !strncasecmp(line, name, name_length) )
+        {
+            return trim(colon + 1, nl);
+        }
+
+        line = nl + 1;
+    }
+
+    return ChumbRadioSlice();
+}
+
+int ChumbRadioRequest::keepAlive() const
+{
+    ChumbRadioSlice connection = getHeader("connection");
+
+    if(_httpVersion == chumby::HTTP_1_1)
+    {
+        return connection.equalsIgnoreCase("close") ? 0 : 1;
+    }
+
+    if(_httpVersion == chumby::HTTP_1_0)
+    {
+        return connection.equalsIgnoreCase("keep-alive") ? 1 : 0;
+    }
+
+    return 0;
+}
+
+int ChumbRadioRequest::isNotModified(const std::string &etag, time_t lastModified) const
+{
+    ChumbRadioSlice if_none_match = getHeader("if-none-match");
+    ChumbRadioSlice if_modified_since;
+
+    if( (_requestMethod != chumby::GET) && (_requestMethod != chumby::HEAD) ) { return 0; }
+
+    /*! when both are sent, the entity tag decides */
+    if(!if_none_match.isNull())
+    {
+        return (!etag.empty() && matchETag(if_none_match, etag)) ? 1 : 0;
+    }
+
+    if_modified_since = getHeader("if-modified-since");
+
+    if(!if_modified_since.isNull() && (lastModified != 0))
+    {
+        time_t since = parseHTTPDate(if_modified_since);
+
+        return ( (since != (time_t)-1) && (lastModified <= since) ) ? 1 : 0;
+    }
+
+    return 0;
+}
+
+int ChumbRadioRequest::acceptsGzip() const
+{
+    ChumbRadioSlice accept_encoding = getHeader("accept-encoding");
+    const char *beg, *end;
+    double gzip = -1.0, any = -1.0;
+
+    if(accept_encoding.isNull()) { return 0; }
+
+    beg = accept_encoding.data;
+    end = accept_encoding.data + accept_encoding.length;
+
+    while(beg < end)
+    {
+        const char *comma = (const char *)memchr(beg, ',', end - beg);
+        const char *semicolon;
+        ChumbRadioSlice element, coding;
+
+        if(comma == NULL) { comma = end; }
+
+        element = trim(beg, comma);
+        semicolon = (const char *)memchr(element.data, ';', element.length);
+        coding = trim(element.data, (semicolon != NULL) ? semicolon : element.data + element.length);
+
+        if(coding.equalsIgnoreCase("gzip") || coding.equalsIgnoreCase("x-gzip")) { gzip = parseQValue(element); }
+        else if(coding.equals("*")) { any = parseQValue(element); }
+
+        beg = comma + 1;
+    }
+
+    /*! an explicit "gzip" entry overrides the wildcard */
+    if(gzip >= 0.0) { return (gzip > 0.0) ? 1 : 0; }
+
+    return (any > 0.0) ? 1 : 0;
+}
@@ -0,0 +1,147 @@
+/*
+ * crad_http_request.h
+ *
+ * (c) Copyright Chumby Industries, 2009
+ * All rights reserved
+ *
+ * This header declares the request parser used by the Chumby Radio HTTP
+ * server to frame requests on persistent connections.  The parser runs
+ * incrementally over the connection's receive buffer and refers to the
+ * request line and header fields in place, so typical requests are parsed
+ * without any heap allocation.
+ */
+
+#ifndef CRAD_HTTP_REQUEST_H
+#define CRAD_HTTP_REQUEST_H
+
+#include <string>
+#include <time.h>
+#include <chumby_httpd/chumby_http_request.h>
+
+/*! \name ChumbRadioRequest::parse results */
+/*! \{ */
+#define CRAD_HTTP_PARSE_INCOMPLETE      0   /*!< need more bytes */
+#define CRAD_HTTP_PARSE_ERROR          -1   /*!< malformed request */
+/*! \} */
+
+/*! @brief Unowned view of bytes, usually part of a receive buffer */
+struct ChumbRadioSlice
+{
+    const char *data;   /*!< NULL if the slice names nothing (e.g. a missing header) */
+    size_t      length;
+
+    ChumbRadioSlice() : data(NULL), length(0) { }
+    ChumbRadioSlice(const char *d, size_t l) : data(d), length(l) { }
+
+    int isNull() const { return data == NULL; }
+    int equals(const char *str) const;
+    int equalsIgnoreCase(const char *str) const;
+    std::string str() const { return (data != NULL) ? std::string(data, length) : std::string(); }
+};
+
+/*! @brief Chumby Radio HTTP request */
+class ChumbRadioRequest
+{
+    public:
+
+        ChumbRadioRequest();
+
+        /*!
+
+          Parse one request from the front of a receive buffer.  Parsing
+          resumes where the previous call stopped, so the buffer may grow
+          (and move) between calls as long as its contents are kept.  Once
+          a request is complete, the next call starts on a new request at
+          the front of the buffer.
+
+          The slices returned by the accessors point into the buffer passed
+          to the call that completed the request, and stay valid until
+          that buffer is modified.
+
+          @param data (INP) - received bytes
+          @param length (INP) - number of received bytes
+          @return number of bytes making up the request (head and body),
+                  CRAD_HTTP_PARSE_INCOMPLETE or CRAD_HTTP_PARSE_ERROR
+
+        */
+        long parse(const char *data, long length);
+
+        /*! forget any partially parsed request */
+        void reset();
+
+        chumby::RequestMethod getRequestMethod() const { return _requestMethod; }
+        chumby::HTTPVersion getHTTPVersion() const { return _httpVersion; }
+
+        ChumbRadioSlice getRequestURI() const;
+
+        /*! request URI up to the query string */
+        ChumbRadioSlice getPath() const;
+
+        /*! query string without the '?', or a null slice if there is none */
+        ChumbRadioSlice getQuery() const;
+
+        /*! the request as received, head and body */
+        ChumbRadioSlice getRawRequest() const;
+
+        /*! used when adapting a request received by the threaded server */
+        void setRequestURI(const std::string &uri);
+
+        /*! returns the named header (any case), or a null slice; headers are only searched when asked for */
+        ChumbRadioSlice getHeader(const char *name) const;
+
+        /*! returns 1 if the connection may be reused after this request */
+        int keepAlive() const;
+
+        /*!
+
+          Evaluate If-None-Match / If-Modified-Since against the current
+          validators of the requested resource.
+
+          @param etag (INP) - entity tag, quotes included
+          @param lastModified (INP) - modification time, or 0 if unknown
+          @return 1 if the client's copy is current and a 304 may be sent
+
+        */
+        int isNotModified(const std::string &etag, time_t lastModified) const;
+
+        /*! returns 1 if Accept-Encoding allows a gzip encoded response */
+        int acceptsGzip() const;
+
+        /*! set by the server when a parked request is served again because its wait ran out */
+        void setWaitExpired(int expired) { _waitExpired = expired; }
+        int isWaitExpired() const { return _waitExpired; }
+
+    private:
+
+        enum State { REQUEST_LINE, HEADER_LINES, BODY, COMPLETE };
+
+        State _state;
+        chumby::RequestMethod _requestMethod;
+        chumby::HTTPVersion _httpVersion;
+
+        /*! buffer holding the completed request */
+        const char *_base;
+
+        /*! \name parse progress, as offsets so the buffer may move */
+        /*! \{ */
+        size_t _lineBegin;      /*!< start of the line being parsed */
+        size_t _scanned;        /*!< bytes already searched for its end */
+        size_t _requestBegin;   /*!< leading blank lines are skipped */
+        size_t _uriBegin;
+        size_t _uriLength;
+        size_t _headersBegin;
+        size_t _headersEnd;
+        size_t _headEnd;
+        long _bodyLength;
+        /*! \} */
+
+        int _waitExpired;
+
+        /*! backing store for setRequestURI() */
+        std::string _storage;
+
+        int parseRequestLine(const char *data, size_t begin, size_t end);
+        int parseHeaderLine(const char *data, size_t begin, size_t end);
+};
+
+#endif
@@ -0,0 +1,232 @@
+/*
+    crad_http_response.cpp
+
+    This file is part of chumbyradio.
+    Copyright (c) Chumby Industries, 2009
+
+    chumbyradio is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    chumbyradio is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with chumbyradio; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#include <stdio.h>
+#include <unistd.h>
+#include "crad_http_response.h"
+
+ChumbRadioResponse::ChumbRadioResponse(int status)
+{
+    _status = status;
+    _file = NULL;
+    _blob = NULL;
+    _static = NULL;
+    _staticLength = 0;
+    _eventStream = 0;
+    _eventId = 0;
+    _parkTimeout = 0;
+    _parkGeneration = 0;
+}
+
+ChumbRadioResponse::~ChumbRadioResponse()
+{
+    if(_file != NULL) { _file->unref(); }
+    if(_blob != NULL) { _blob->unref(); }
+}
+
+void ChumbRadioResponse::addHeader(const char *name, const std::string &value)
+{
+    _headers.push_back(std::make_pair(std::string(name), value));
+}
+
+void ChumbRadioResponse::setMimeType(const char *mimeType)
+{
+    addHeader("Content-Type", mimeType);
+}
+
+void ChumbRadioResponse::setLastModified(time_t lastModified)
+{
+    char date[64];
+    struct tm tm;
+
+    gmtime_r(&lastModified, &tm);
+    strftime(date, sizeof(date), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+
+    addHeader("Last-Modified", date);
+}
+
+void ChumbRadioResponse::setNotModified()
+{
+    _status = CRAD_HTTP_NOT_MODIFIED;
+    _content.clear();
+    _static = NULL;
+    _staticLength = 0;
+
+    if(_file != NULL)
+    {
+        _file->unref();
+        _file = NULL;
+    }
+
+    if(_blob != NULL)
+    {
+        _blob->unref();
+        _blob = NULL;
+    }
+}
+
+void ChumbRadioResponse::addContent(const char *content, long length)
+{
+    _content.append(content, length);
+}
+
+void ChumbRadioResponse::addContent(const std::string &content)
+{
+    _content.append(content);
+}
+
+void ChumbRadioResponse::setFileContent(ChumbRadioFile *file)
+{
+    if(_file != NULL) { _file->unref(); }
+
+    _file = file;
+}
+
+void ChumbRadioResponse::setBlobContent(ChumbRadioBlob *blob)
+{
+    if(_blob != NULL) { _blob->unref(); }
+
+    _blob = blob;
+}
+
+void ChumbRadioResponse::setStaticContent(const char *content, size_t length)
+{
+    _static = content;
+    _staticLength = length;
+}
+
+void ChumbRadioResponse::setEventStream(unsigned long eventId)
+{
+    _eventStream = 1;
+    _eventId = eventId;
+}
+
+ChumbRadioBlob * ChumbRadioResponse::releaseBlob()
+{
+    ChumbRadioBlob *blob = _blob;
+
+    _blob = NULL;
+
+    return blob;
+}
+
+ChumbRadioFile * ChumbRadioResponse::releaseFile()
+{
+    ChumbRadioFile *file = _file;
+
+    _file = NULL;
+
+    return file;
+}
+
+off_t ChumbRadioResponse::getContentLength() const
+{
+    if(_file != NULL) { return _file->getSize(); }
+    if(_blob != NULL) { return (off_t)_blob->getSize(); }
+    if(_static != NULL) { return (off_t)_staticLength; }
+
+    return (off_t)_content.size();
+}
+
+void ChumbRadioResponse::getResponseHeader(std::string &head, int keepAlive) const
+{
+    char line[64];
+    size_t h;
+
+    snprintf(line, sizeof(line), "HTTP/1.1 %d %s\r\n", _status, getReasonPhrase(_status));
+    head.append(line);
+
+    for(h=0;h<_headers.size();h++)
+    {
+        head.append(_headers[h].first);
+        head.append(": ");
+        head.append(_headers[h].second);
+        head.append("\r\n");
+    }
+
+    /*! a 304 never has a body, so its length would describe the unsent
+     *  entity; an event stream is delimited by closing the connection */
+    if( (_status != CRAD_HTTP_NOT_MODIFIED) && !_eventStream )
+    {
+        snprintf(line, sizeof(line), "Content-Length: %lu\r\n", (unsigned long)getContentLength());
+        head.append(line);
+    }
+    head.append(keepAlive ? "Connection: keep-alive\r\n\r\n" : "Connection: close\r\n\r\n");
+}
+
+chumby::HTTPResponse * ChumbRadioResponse::toHTTPResponse() const
+{
+    chumby::HTTPResponse *response;
+    size_t h;
+
+    /*! the threaded server has no codes but 200 and 404, so anything
+     *  else has to go out as a 404 rather than pass for a success */
+    if(_status != CRAD_HTTP_OK) { return NULL; }
+
+    response = new chumby::HTTPResponse(chumby::HTTP_RESPONSE_CODE_OKAY);
+
+    for(h=0;h<_headers.size();h++)
+    {
+        response->addHeader(_headers[h].first.c_str(), _headers[h].second.c_str());
+    }
+
+    if(_file != NULL)
+    {
+        char buff[4096];
+        off_t offs = 0;
+        ssize_t got;
+
+        /*! pread leaves the shared descriptor's file offset alone */
+        while( (offs < _file->getSize()) && ((got = pread(_file->getDescriptor(), buff, sizeof(buff), offs)) > 0) )
+        {
+            response->addContent(buff, got);
+            offs += got;
+        }
+    }
+    else if(_blob != NULL)
+    {
+        response->addContent(_blob->getData(), _blob->getSize());
+    }
+    else if(_static != NULL)
+    {
+        response->addContent(_static, _staticLength);
+    }
+    else if(!_content.empty())
+    {
+        response->addContent(_content.data(), _content.size());
+    }
+
+    return response;
+}
+
+const char * ChumbRadioResponse::getReasonPhrase(int status)
+{
+    switch(status)
+    {
+        case CRAD_HTTP_OK:              return "OK";
+        case CRAD_HTTP_NOT_MODIFIED:    return "Not Modified";
+        case CRAD_HTTP_BAD_REQUEST:     return "Bad Request";
+        case CRAD_HTTP_NOT_FOUND:       return "Not Found";
+        case CRAD_HTTP_SERVICE_UNAVAILABLE: return "Service Unavailable";
+    }
+
+    return "Unknown";
+}
@@ -0,0 +1,137 @@
+/*
+ * crad_http_response.h
+ *
+ * (c) Copyright Chumby Industries, 2009
+ * All rights reserved
+ *
+ * This header declares the response type produced by native Chumby Radio
+ * handlers.  Unlike chumby::HTTPResponse, the body may be an open file,
+ * which the event driven server streams to the socket without copying it
+ * through user space.
+ */
+
+#ifndef CRAD_HTTP_RESPONSE_H
+#define CRAD_HTTP_RESPONSE_H
+
+#include <string>
+#include <vector>
+#include <time.h>
+#include <sys/types.h>
+#include <chumby_httpd/chumby_http_response.h>
+#include "crad_file_cache.h"
+#include "crad_blob.h"
+
+/*! \name HTTP status codes */
+/*! \{ */
+#define CRAD_HTTP_OK                    200
+#define CRAD_HTTP_NOT_MODIFIED          304
+#define CRAD_HTTP_BAD_REQUEST           400
+#define CRAD_HTTP_NOT_FOUND             404
+#define CRAD_HTTP_SERVICE_UNAVAILABLE   503
+/*! \} */
+
+/*! @brief Chumby Radio HTTP response */
+class ChumbRadioResponse
+{
+    public:
+
+        ChumbRadioResponse(int status = CRAD_HTTP_OK);
+        ~ChumbRadioResponse();
+
+        void addHeader(const char *name, const std::string &value);
+        void setMimeType(const char *mimeType);
+
+        /*! add a Last-Modified header */
+        void setLastModified(time_t lastModified);
+
+        /*! turn this into a 304, keeping the headers but dropping the body */
+        void setNotModified();
+
+        void setStatus(int status) { _status = status; }
+
+        void addContent(const char *content, long length);
+        void addContent(const std::string &content);
+
+        /*! send a file as the body; takes over the caller's reference */
+        void setFileContent(ChumbRadioFile *file);
+
+        /*! send a shared buffer as the body; takes over the caller's reference */
+        void setBlobContent(ChumbRadioBlob *blob);
+
+        /*! send memory that outlives the response (e.g. a string literal) as the body, without copying it */
+        void setStaticContent(const char *content, size_t length);
+
+        /*!
+
+          Keep the connection open after the body, and carry on with the
+          records of the event stream that follow eventId.  The body has no
+          length; it ends when either side closes the connection.
+
+        */
+        void setEventStream(unsigned long eventId);
+
+        /*!
+
+          Answer nothing yet.  The server holds the request, without a
+          thread, until the radio state moves on from generation or the
+          given time has passed, and then serves it again; see
+          ChumbRadioRequest::isWaitExpired().
+
+        */
+        void setParked(int seconds, unsigned int generation) { _parkTimeout = seconds; _parkGeneration = generation; }
+
+        int getStatus() const { return _status; }
+        const std::string & getContent() const { return _content; }
+        ChumbRadioFile * getFile() const { return _file; }
+        ChumbRadioBlob * getBlob() const { return _blob; }
+        const char * getStaticContent() const { return _static; }
+        int isEventStream() const { return _eventStream; }
+        unsigned long getEventId() const { return _eventId; }
+        int getParkTimeout() const { return _parkTimeout; }
+        unsigned int getParkGeneration() const { return _parkGeneration; }
+
+        /*! move the buffered body into content, leaving the response's empty */
+        void swapContent(std::string &content) { _content.swap(content); }
+
+        /*! hand the file reference to the caller */
+        ChumbRadioFile * releaseFile();
+
+        /*! hand the blob reference to the caller */
+        ChumbRadioBlob * releaseBlob();
+
+        /*! number of body bytes, whether buffered or in a file */
+        off_t getContentLength() const;
+
+        /*!
+
+          Build the status line and header block, including Content-Length
+          and Connection, ready to be written ahead of the body.
+
+          @param head (OUT) - header text is appended here
+          @param keepAlive (INP) - 1 if the connection stays open afterwards
+
+        */
+        void getResponseHeader(std::string &head, int keepAlive) const;
+
+        /*! convert to a buffered response for the threaded server, or NULL
+         *  (which it answers 404) for anything but a 200 */
+        chumby::HTTPResponse * toHTTPResponse() const;
+
+        static const char * getReasonPhrase(int status);
+
+    private:
+
+        int _status;
+        std::vector<std::pair<std::string, std::string> > _headers;
+        std::string _content;
+        ChumbRadioFile *_file;
+        ChumbRadioBlob *_blob;
+        const char *_static;
+        size_t _staticLength;
+        int _eventStream;
+        unsigned long _eventId;
+        int _parkTimeout;
+        unsigned int _parkGeneration;
+};
+
+#endif
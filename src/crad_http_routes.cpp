@@ -0,0 +1,173 @@
+/*
+    crad_http_routes.cpp
+
+    This file is part of chumbyradio.
+    Copyright (c) Chumby Industries, 2009
+
+    chumbyradio is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    chumbyradio is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with chumbyradio; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#include <string.h>
+#include "crad_http_routes.h"
+
+#define INITIAL_BUCKETS 16
+
+ChumbRadioRouteTable::ChumbRadioRouteTable()
+{
+    _exact.buckets.resize(INITIAL_BUCKETS, NULL);
+    _exact.count = 0;
+    _prefix.buckets.resize(INITIAL_BUCKETS, NULL);
+    _prefix.count = 0;
+}
+
+ChumbRadioRouteTable::~ChumbRadioRouteTable()
+{
+    clear(_exact);
+    clear(_prefix);
+}
+
+void ChumbRadioRouteTable::addRoute(const char *path, chumby::HTTPContentHandler *handler)
+{
+    insert(_exact, path, handler);
+}
+
+void ChumbRadioRouteTable::addPrefixRoute(const char *prefix, chumby::HTTPContentHandler *handler)
+{
+    insert(_prefix, prefix, handler);
+}
+
+chumby::HTTPContentHandler * ChumbRadioRouteTable::lookup(const char *path, size_t length) const
+{
+    chumby::HTTPContentHandler *handler = find(_exact, path, length);
+
+    if( (handler != NULL) || (_prefix.count == 0) ) { return handler; }
+
+    /*! try each "/"-terminated prefix of the path, longest first */
+    while(length > 0)
+    {
+        while( (length > 0) && (path[length-1] != '/') ) { length--; }
+
+        if(length == 0) { break; }
+
+        handler = find(_prefix, path, length);
+
+        if(handler != NULL) { return handler; }
+
+        length--;
+    }
+
+    return NULL;
+}
+
+/*! FNV-1a */
+unsigned int ChumbRadioRouteTable::hash(const char *str, size_t length)
+{
+    unsigned int h = 2166136261U;
+    size_t i;
+
+    for(i=0;i<length;i++)
+    {
+        h ^= (unsigned char)str[i];
+        h *= 16777619U;
+    }
+
+    return h;
+}
+
+void ChumbRadioRouteTable::insert(Table &table, const char *path, chumby::HTTPContentHandler *handler)
+{
+    size_t length = strlen(path);
+    unsigned int h = hash(path, length);
+    Route *route;
+
+    /*! re-registering a path replaces its handler */
+    for(route = table.buckets[h & (table.buckets.size() - 1)]; route != NULL; route = route->next)
+    {
+        if( (route->hash == h) && (route->path == path) )
+        {
+            route->handler = handler;
+            return;
+        }
+    }
+
+    /*! keep the load factor at or below one */
+    if(table.count + 1 > table.buckets.size())
+    {
+        std::vector<Route *> buckets(table.buckets.size() * 2, (Route *)NULL);
+        size_t b;
+
+        for(b=0;b<table.buckets.size();b++)
+        {
+            Route *next;
+
+            for(route = table.buckets[b]; route != NULL; route = next)
+            {
+                size_t slot = route->hash & (buckets.size() - 1);
+
+                next = route->next;
+                route->next = buckets[slot];
+                buckets[slot] = route;
+            }
+        }
+
+        table.buckets.swap(buckets);
+    }
+
+    route = new Route();
+    route->path = path;
+    route->hash = h;
+    route->handler = handler;
+    route->next = table.buckets[h & (table.buckets.size() - 1)];
+
+    table.buckets[h & (table.buckets.size() - 1)] = route;
+    table.count++;
+}
+
+chumby::HTTPContentHandler * ChumbRadioRouteTable::find(const Table &table, const char *path, size_t length)
+{
+    unsigned int h = hash(path, length);
+    Route *route;
+
+    for(route = table.buckets[h & (table.buckets.size() - 1)]; route != NULL; route = route->next)
+    {
+        if( (route->hash == h) && (route->path.size() == length) && !memcmp(route->path.data(), path, length) )
+        {
+            return route->handler;
+        }
+    }
+
+    return NULL;
+}
+
+void ChumbRadioRouteTable::clear(Table &table)
+{
+    size_t b;
+
+    for(b=0;b<table.buckets.size();b++)
+    {
+        Route *route = table.buckets[b];
+
+        while(route != NULL)
+        {
+            Route *next = route->next;
+            delete route;
+            route = next;
+        }
+
+        table.buckets[b] = NULL;
+    }
+
+    table.count = 0;
+}
@@ -0,0 +1,69 @@
+/*
+ * crad_http_routes.h
+ *
+ * (c) Copyright Chumby Industries, 2009
+ * All rights reserved
+ *
+ * This header declares the route table used by the Chumby Radio HTTP
+ * server to find the content handler for a request path.
+ */
+
+#ifndef CRAD_HTTP_ROUTES_H
+#define CRAD_HTTP_ROUTES_H
+
+#include <string>
+#include <vector>
+#include <chumby_httpd/chumby_http_content_handler.h>
+
+/*!
+
+  @brief Chumby Radio route table
+
+  Exact paths and path prefixes are kept in separate hash tables.  An exact
+  lookup costs one hash probe; a prefix lookup probes once per '/' in the
+  request path, longest prefix first.  Neither depends on how many handlers
+  have been registered.
+
+*/
+class ChumbRadioRouteTable
+{
+    public:
+
+        ChumbRadioRouteTable();
+        ~ChumbRadioRouteTable();
+
+        /*! route requests for exactly this path to handler */
+        void addRoute(const char *path, chumby::HTTPContentHandler *handler);
+
+        /*! route requests for any path below prefix (e.g. "/radio/jobs/") to handler */
+        void addPrefixRoute(const char *prefix, chumby::HTTPContentHandler *handler);
+
+        /*! returns the handler for a request path (query string excluded), or NULL */
+        chumby::HTTPContentHandler * lookup(const char *path, size_t length) const;
+
+    private:
+
+        struct Route
+        {
+            std::string                 path;
+            unsigned int                hash;
+            chumby::HTTPContentHandler *handler;
+            Route                      *next;
+        };
+
+        struct Table
+        {
+            std::vector<Route *>        buckets;
+            size_t                      count;
+        };
+
+        Table _exact;
+        Table _prefix;
+
+        static unsigned int hash(const char *str, size_t length);
+        static void insert(Table &table, const char *path, chumby::HTTPContentHandler *handler);
+        static chumby::HTTPContentHandler * find(const Table &table, const char *path, size_t length);
+        static void clear(Table &table);
+};
+
+#endif
@@ -0,0 +1,1110 @@
+/*
+    crad_http_server.cpp
+
+    This file is part of chumbyradio.
+    Copyright (c) Chumby Industries, 2009
+
+    chumbyradio is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    chumbyradio is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with chumbyradio; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/sendfile.h>
+#include <sys/resource.h>
+#include <time.h>
+#include <netinet/in.h>
+#include "crad_http_server.h"
+#include "crad_http_handler.h"
+
+#define MAX_EVENTS  64
+
+/*! put a descriptor into non-blocking mode */
+static int setNonBlocking(int fd)
+{
+    int flags = fcntl(fd, F_GETFL, 0);
+
+    if(flags == -1) { return -1; }
+
+    return fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+}
+
+/*! the default connection limit: what the descriptor limit leaves once the
+ *  daemon's own descriptors are set aside */
+static int defaultMaxConnections()
+{
+    struct rlimit limit;
+
+    if( (getrlimit(RLIMIT_NOFILE, &limit) == -1) || (limit.rlim_cur == RLIM_INFINITY) )
+    {
+        return CRAD_HTTP_MAX_CONNECTIONS;
+    }
+
+    if(limit.rlim_cur <= CRAD_HTTP_RESERVED_FDS) { return 1; }
+
+    if(limit.rlim_cur - CRAD_HTTP_RESERVED_FDS > CRAD_HTTP_MAX_CONNECTIONS) { return CRAD_HTTP_MAX_CONNECTIONS; }
+
+    return (int)(limit.rlim_cur - CRAD_HTTP_RESERVED_FDS);
+}
+
+/*! returns the current monotonic time, in timer ticks */
+unsigned long ChumbRadioHTTPServer::currentTick()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (unsigned long)ts.tv_sec * (1000 / CRAD_HTTP_TIMER_TICK_MS) + ts.tv_nsec / (CRAD_HTTP_TIMER_TICK_MS * 1000000);
+}
+
+ChumbRadioHTTPServer::ChumbRadioHTTPServer(int port, int pub, int workers) : _timers(currentTick())
+{
+    struct sockaddr_in local_in_addr;
+    int yes = 1;
+
+    _workers = (workers > 0) ? workers : 1;
+    _keepAliveTimeout = CRAD_HTTP_KEEPALIVE_TIMEOUT;
+    _firstByteTimeout = CRAD_HTTP_FIRST_BYTE_TIMEOUT;
+    _headerTimeout = CRAD_HTTP_HEADER_TIMEOUT;
+    _keepAliveRequests = CRAD_HTTP_KEEPALIVE_REQUESTS;
+    _queueDepth = CRAD_HTTP_DEFAULT_QUEUE_DEPTH;
+    _maxConnections = defaultMaxConnections();
+    _heldConnections = 0;
+    _contentManager = new chumby::HTTPContentManager();
+
+    pthread_mutex_init(&_pendingMutex, NULL);
+    pthread_cond_init(&_pendingCond, NULL);
+    pthread_mutex_init(&_completedMutex, NULL);
+
+    memset(&_stats, 0, sizeof(_stats));
+    _eventsPending = 0;
+    _statePending = 0;
+
+    _wakefd[0] = _wakefd[1] = -1;
+    _epollfd = -1;
+    _sparefd = open("/dev/null", O_RDONLY);
+
+    _socketfd = socket(AF_INET, SOCK_STREAM, 0);
+
+    if(_socketfd == -1)
+    {
+        perror("Unable to create server socket");
+        return;
+    }
+
+    setsockopt(_socketfd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+
+    memset(&local_in_addr, 0, sizeof(local_in_addr));
+    local_in_addr.sin_family = AF_INET;
+    local_in_addr.sin_port = htons(port);
+    local_in_addr.sin_addr.s_addr = htonl(pub ? INADDR_ANY : INADDR_LOOPBACK);
+
+    if(bind(_socketfd, (struct sockaddr *)&local_in_addr, sizeof(local_in_addr)) == -1)
+    {
+        perror("Unable to bind server socket");
+        close(_socketfd);
+        _socketfd = -1;
+        return;
+    }
+
+    if(listen(_socketfd, CRAD_HTTP_LISTEN_BACKLOG) == -1)
+    {
+        perror("Unable to listen on server socket");
+        close(_socketfd);
+        _socketfd = -1;
+        return;
+    }
+
+    setNonBlocking(_socketfd);
+
+    /*! dispatch threads hand finished responses back through this pipe */
+    if(pipe(_wakefd) == -1)
+    {
+        perror("Unable to create wakeup pipe");
+        return;
+    }
+
+    setNonBlocking(_wakefd[0]);
+    setNonBlocking(_wakefd[1]);
+
+    _epollfd = epoll_create(CRAD_HTTP_LISTEN_BACKLOG);
+
+    if(_epollfd == -1)
+    {
+        perror("Unable to create epoll instance");
+        return;
+    }
+
+    {
+        struct epoll_event ev;
+
+        memset(&ev, 0, sizeof(ev));
+        ev.events = EPOLLIN;
+        ev.data.ptr = &_socketfd;
+        epoll_ctl(_epollfd, EPOLL_CTL_ADD, _socketfd, &ev);
+
+        ev.data.ptr = &_wakefd[0];
+        epoll_ctl(_epollfd, EPOLL_CTL_ADD, _wakefd[0], &ev);
+    }
+}
+
+ChumbRadioHTTPServer::~ChumbRadioHTTPServer()
+{
+    ChumbRadioEventSource::instance()->setListener(NULL);
+
+    while(!_connections.empty())
+    {
+        closeConnection(_connections.front());
+    }
+
+    if(_socketfd != -1) { close(_socketfd); }
+    if(_epollfd != -1) { close(_epollfd); }
+    if(_wakefd[0] != -1) { close(_wakefd[0]); }
+    if(_wakefd[1] != -1) { close(_wakefd[1]); }
+    if(_sparefd != -1) { close(_sparefd); }
+
+    delete _contentManager;
+}
+
+void ChumbRadioHTTPServer::addRoute(const char *path, chumby::HTTPContentHandler *handler)
+{
+    _routes.addRoute(path, handler);
+}
+
+void ChumbRadioHTTPServer::addPrefixRoute(const char *prefix, chumby::HTTPContentHandler *handler)
+{
+    _routes.addPrefixRoute(prefix, handler);
+}
+
+void ChumbRadioHTTPServer::addContentHandler(chumby::HTTPContentHandler *handler)
+{
+    _contentManager->addContentHandler(handler);
+}
+
+void ChumbRadioHTTPServer::getStats(ChumbRadioHTTPStats &stats)
+{
+    pthread_mutex_lock(&_pendingMutex);
+    stats = _stats;
+    stats.queueLimit = _queueDepth;
+    stats.connectionLimit = _maxConnections;
+    pthread_mutex_unlock(&_pendingMutex);
+}
+
+void ChumbRadioHTTPServer::start()
+{
+    struct epoll_event events[MAX_EVENTS];
+    int w;
+
+    if( (_socketfd == -1) || (_epollfd == -1) || (_wakefd[0] == -1) )
+    {
+        fprintf(stderr, "Error: HTTP server was not initialized\n");
+        return;
+    }
+
+    ChumbRadioEventSource::instance()->setListener(this);
+
+    /*! spin up the dispatch threads */
+    for(w=0;w<_workers;w++)
+    {
+        pthread_t thread;
+
+        if(pthread_create(&thread, NULL, workerThread, this))
+        {
+            perror("Unable to create HTTP dispatch thread");
+            continue;
+        }
+
+        pthread_detach(thread);
+    }
+
+    for(;;)
+    {
+        /*! sleep until the next socket event, or the next deadline */
+        long ticks = _timers.getTimeout(currentTick());
+        int n = epoll_wait(_epollfd, events, MAX_EVENTS, (ticks < 0) ? -1 : ticks * CRAD_HTTP_TIMER_TICK_MS);
+        int e;
+
+        if(n == -1)
+        {
+            if(errno == EINTR) { continue; }
+            perror("epoll_wait failed");
+            return;
+        }
+
+        for(e=0;e<n;e++)
+        {
+            void *tag = events[e].data.ptr;
+
+            if(tag == &_socketfd)
+            {
+                acceptConnections();
+            }
+            else if(tag == &_wakefd[0])
+            {
+                drainCompleted();
+            }
+            else
+            {
+                Connection *conn = (Connection *)tag;
+
+                if(events[e].events & (EPOLLERR | EPOLLHUP | EPOLLRDHUP))
+                {
+                    closeConnection(conn);
+                }
+                else if(events[e].events & EPOLLOUT)
+                {
+                    writeConnection(conn);
+                }
+                else if(events[e].events & EPOLLIN)
+                {
+                    readConnection(conn);
+                }
+            }
+        }
+
+        expireTimers();
+    }
+}
+
+void ChumbRadioHTTPServer::watch(Connection *conn, unsigned int events)
+{
+    struct epoll_event ev;
+
+    memset(&ev, 0, sizeof(ev));
+    ev.events = events;
+    ev.data.ptr = conn;
+
+    epoll_ctl(_epollfd, conn->watched ? EPOLL_CTL_MOD : EPOLL_CTL_ADD, conn->fd, &ev);
+    conn->watched = 1;
+}
+
+void ChumbRadioHTTPServer::unwatch(Connection *conn)
+{
+    if(conn->watched)
+    {
+        epoll_ctl(_epollfd, EPOLL_CTL_DEL, conn->fd, NULL);
+        conn->watched = 0;
+    }
+}
+
+void ChumbRadioHTTPServer::acceptConnections()
+{
+    for(;;)
+    {
+        int fd = accept(_socketfd, NULL, NULL);
+
+        /*! out of descriptors, which held connections can get to; the
+         *  listening socket would stay readable, so free the spare for long
+         *  enough to answer the client 503 */
+        if( (fd == -1) && ((errno == EMFILE) || (errno == ENFILE)) && (_sparefd != -1) )
+        {
+            close(_sparefd);
+            fd = accept(_socketfd, NULL, NULL);
+
+            if(fd != -1) { refuse(fd); }
+
+            _sparefd = open("/dev/null", O_RDONLY);
+
+            if(fd != -1) { continue; }
+        }
+
+        if(fd == -1)
+        {
+            if( (errno != EAGAIN) && (errno != EWOULDBLOCK) && (errno != EINTR) )
+            {
+                perror("Unable to accept connection");
+            }
+            return;
+        }
+
+        /*! over the limit, answer straight away rather than take on more state;
+         *  event streams and parked requests hold a socket but no thread, and
+         *  the dispatch queue sheds load on its own, so they don't count */
+        if(_connections.size() - _heldConnections >= (size_t)_maxConnections)
+        {
+            refuse(fd);
+            continue;
+        }
+
+        setNonBlocking(fd);
+
+        Connection *conn = new Connection();
+
+        conn->fd = fd;
+        conn->watched = 0;
+        conn->busy = 0;
+        conn->keepAlive = 0;
+        conn->requests = 0;
+        conn->receiving = 0;
+        conn->finished = 0;
+        conn->streaming = 0;
+        conn->eventId = 0;
+        conn->parked = 0;
+        conn->parkTimeout = 0;
+        conn->parkGeneration = 0;
+        conn->timer.owner = conn;
+        conn->consumed = 0;
+        conn->blob = NULL;
+        conn->length = 0;
+        conn->sent = 0;
+        conn->file = NULL;
+        conn->fileOffset = 0;
+        conn->fileEnd = 0;
+        conn->link = _connections.insert(_connections.end(), conn);
+
+        pthread_mutex_lock(&_pendingMutex);
+        _stats.connections = _connections.size();
+        pthread_mutex_unlock(&_pendingMutex);
+
+        arm(conn, _firstByteTimeout);
+        watch(conn, EPOLLIN);
+    }
+}
+
+void ChumbRadioHTTPServer::readConnection(Connection *conn)
+{
+    char buff[2048];
+
+    for(;;)
+    {
+        ssize_t got = recv(conn->fd, buff, sizeof(buff), 0);
+
+        if(got > 0)
+        {
+            /*! nothing more is expected from an event stream's client */
+            if(conn->streaming) { continue; }
+
+            conn->buffer.append(buff, got);
+
+            /*! the limit is on the request being received; once a whole one
+             *  is in, anything behind it waits in the socket until it is answered */
+            if(conn->buffer.size() > CRAD_HTTP_MAX_REQUEST_SIZE)
+            {
+                long used = conn->request.parse(conn->buffer.data(), conn->buffer.size());
+
+                if( (used <= 0) || (used > CRAD_HTTP_MAX_REQUEST_SIZE) )
+                {
+                    closeConnection(conn);
+                    return;
+                }
+                break;
+            }
+            continue;
+        }
+
+        if( (got == -1) && (errno == EINTR) ) { continue; }
+
+        if( (got == -1) && ((errno == EAGAIN) || (errno == EWOULDBLOCK)) ) { break; }
+
+        /*! the client is done sending, but what it sent is still answered */
+        if( (got == 0) && !conn->streaming && !conn->buffer.empty() )
+        {
+            conn->finished = 1;
+            break;
+        }
+
+        /*! peer closed the connection, or the socket failed */
+        closeConnection(conn);
+        return;
+    }
+
+    if(conn->streaming) { return; }
+
+    processBuffer(conn);
+}
+
+/*! start on the next buffered request, if one has fully arrived */
+void ChumbRadioHTTPServer::processBuffer(Connection *conn)
+{
+    long used = conn->request.parse(conn->buffer.data(), conn->buffer.size());
+
+    if(used == CRAD_HTTP_PARSE_ERROR)
+    {
+        closeConnection(conn);
+        return;
+    }
+
+    if(used == CRAD_HTTP_PARSE_INCOMPLETE)
+    {
+        /*! no more of it is coming */
+        if(conn->finished)
+        {
+            closeConnection(conn);
+            return;
+        }
+
+        /*! the header deadline runs from a request's first byte, and is
+         *  not pushed back by the bytes that follow it */
+        if(conn->buffer.empty())
+        {
+            arm(conn, (conn->requests == 0) ? _firstByteTimeout : _keepAliveTimeout);
+        }
+        else if(!conn->receiving)
+        {
+            conn->receiving = 1;
+            arm(conn, _headerTimeout);
+        }
+
+        watch(conn, EPOLLIN);
+        return;
+    }
+
+    /*! nothing is waited on from the client until the response is sent */
+    _timers.cancel(&conn->timer);
+    conn->receiving = 0;
+
+    /*! the request is parsed in place, so it (and any pipelined requests
+     *  behind it) stays in the buffer until it has been answered */
+    conn->consumed = used;
+    conn->requests++;
+    conn->keepAlive = conn->request.keepAlive() && (conn->requests < _keepAliveRequests);
+
+    dispatch(conn);
+}
+
+void ChumbRadioHTTPServer::writeConnection(Connection *conn)
+{
+    for(;;)
+    {
+        while(conn->sent < conn->length)
+        {
+            struct iovec iov[2];
+            struct msghdr msg;
+            size_t skip = conn->sent;
+            int s, n = 0;
+
+            /*! gather whatever is left of the head and body segments */
+            for(s=0;s<2;s++)
+            {
+                if(skip >= conn->segments[s].iov_len)
+                {
+                    skip -= conn->segments[s].iov_len;
+                    continue;
+                }
+
+                iov[n].iov_base = (char *)conn->segments[s].iov_base + skip;
+                iov[n].iov_len = conn->segments[s].iov_len - skip;
+                skip = 0;
+                n++;
+            }
+
+            memset(&msg, 0, sizeof(msg));
+            msg.msg_iov = iov;
+            msg.msg_iovlen = n;
+
+            /*! hold back a partial frame if the file body follows straight after */
+            ssize_t put = sendmsg(conn->fd, &msg, MSG_NOSIGNAL | ((conn->file != NULL) ? MSG_MORE : 0));
+
+            if(put > 0)
+            {
+                conn->sent += put;
+                continue;
+            }
+
+            if( (put == -1) && (errno == EINTR) ) { continue; }
+
+            if( (put == -1) && ((errno == EAGAIN) || (errno == EWOULDBLOCK)) )
+            {
+                watch(conn, EPOLLOUT);
+                return;
+            }
+
+            closeConnection(conn);
+            return;
+        }
+
+        /*! stream the file body straight from the page cache */
+        while( (conn->file != NULL) && (conn->fileOffset < conn->fileEnd) )
+        {
+            ssize_t put = sendfile(conn->fd, conn->file->getDescriptor(), &conn->fileOffset,
+                                   conn->fileEnd - conn->fileOffset);
+
+            if(put > 0) { continue; }
+
+            if( (put == -1) && (errno == EINTR) ) { continue; }
+
+            if( (put == -1) && ((errno == EAGAIN) || (errno == EWOULDBLOCK)) )
+            {
+                watch(conn, EPOLLOUT);
+                return;
+            }
+
+            /*! the file shrank underneath us, so the advertised length can't be met */
+            closeConnection(conn);
+            return;
+        }
+
+        resetResponse(conn);
+
+        /*! an event stream carries on with its next record, or waits for one */
+        if(!conn->streaming) { break; }
+
+        if(!nextEvent(conn))
+        {
+            watch(conn, EPOLLIN);
+            return;
+        }
+    }
+
+    if(!conn->keepAlive)
+    {
+        char buff[512];
+
+        /*! as refuse() does: pipelined requests left unread would make the
+         *  close reset the connection, and could lose the reply with it */
+        shutdown(conn->fd, SHUT_WR);
+        while(recv(conn->fd, buff, sizeof(buff), MSG_DONTWAIT) > 0) { }
+
+        closeConnection(conn);
+        return;
+    }
+
+    conn->buffer.erase(0, conn->consumed);
+    conn->consumed = 0;
+
+    /*! answer the next pipelined request, or wait for one */
+    processBuffer(conn);
+}
+
+void ChumbRadioHTTPServer::closeConnection(Connection *conn)
+{
+    _connections.erase(conn->link);
+    _timers.cancel(&conn->timer);
+
+    if(conn->parked)
+    {
+        _parked.erase(conn->parkedLink);
+        _heldConnections--;
+        ChumbRadioEventSource::instance()->unwatch();
+    }
+
+    /*! a stream joins the subscribers once its dispatch thread is done */
+    if(conn->streaming && !conn->busy)
+    {
+        _subscribers.erase(conn->subscriberLink);
+        _heldConnections--;
+        ChumbRadioEventSource::instance()->unsubscribe();
+    }
+
+    pthread_mutex_lock(&_pendingMutex);
+    _stats.connections = _connections.size();
+    pthread_mutex_unlock(&_pendingMutex);
+
+    resetResponse(conn);
+
+    /*! closing the descriptor also removes it from the epoll set */
+    close(conn->fd);
+    delete conn;
+}
+
+/*! drop the response just sent, and any references it held */
+void ChumbRadioHTTPServer::resetResponse(Connection *conn)
+{
+    if(conn->file != NULL)
+    {
+        conn->file->unref();
+        conn->file = NULL;
+    }
+
+    if(conn->blob != NULL)
+    {
+        conn->blob->unref();
+        conn->blob = NULL;
+    }
+
+    conn->head.clear();
+    conn->body.clear();
+    conn->length = 0;
+    conn->sent = 0;
+}
+
+/*! point the write segments at the head and a body, which may live anywhere */
+void ChumbRadioHTTPServer::setSegments(Connection *conn, const char *body, size_t length)
+{
+    conn->segments[0].iov_base = (void *)conn->head.data();
+    conn->segments[0].iov_len = conn->head.size();
+    conn->segments[1].iov_base = (void *)body;
+    conn->segments[1].iov_len = length;
+    conn->length = conn->head.size() + length;
+    conn->sent = 0;
+}
+
+void ChumbRadioHTTPServer::eventsPublished()
+{
+    pthread_mutex_lock(&_completedMutex);
+    _eventsPending = 1;
+    pthread_mutex_unlock(&_completedMutex);
+
+    write(_wakefd[1], "", 1);
+}
+
+void ChumbRadioHTTPServer::stateChanged()
+{
+    pthread_mutex_lock(&_completedMutex);
+    _statePending = 1;
+    pthread_mutex_unlock(&_completedMutex);
+
+    write(_wakefd[1], "", 1);
+}
+
+/*!
+
+  Hold a request whose handler asked to wait.  It keeps its connection,
+  buffer and parsed request but no thread; only a hang up is watched for,
+  so anything pipelined behind it stays in the socket until it is served.
+
+*/
+void ChumbRadioHTTPServer::park(Connection *conn)
+{
+    int seconds = conn->parkTimeout;
+
+    conn->parkTimeout = 0;
+
+    if(!ChumbRadioEventSource::instance()->watch(conn->parkGeneration))
+    {
+        dispatch(conn, 1);
+        return;
+    }
+
+    conn->parked = 1;
+    conn->parkedLink = _parked.insert(_parked.end(), conn);
+    _heldConnections++;
+
+    arm(conn, seconds);
+    watch(conn, EPOLLRDHUP);
+}
+
+/*! serve a parked request again, because the state changed or its wait ran out */
+void ChumbRadioHTTPServer::unpark(Connection *conn, int expired)
+{
+    _parked.erase(conn->parkedLink);
+    _heldConnections--;
+    ChumbRadioEventSource::instance()->unwatch();
+
+    _timers.cancel(&conn->timer);
+    conn->parked = 0;
+
+    conn->request.setWaitExpired(expired);
+    dispatch(conn, 1);
+}
+
+/*! start sending new records to every event stream that is caught up */
+void ChumbRadioHTTPServer::feedSubscribers()
+{
+    std::list<Connection *>::iterator it = _subscribers.begin();
+
+    while(it != _subscribers.end())
+    {
+        Connection *conn = *it++;
+
+        /*! streams still sending pick up the new records when they finish */
+        if(conn->length == 0) { writeConnection(conn); }
+    }
+}
+
+/*! queue the record after the last one sent; returns 0 if there is none yet */
+int ChumbRadioHTTPServer::nextEvent(Connection *conn)
+{
+    ChumbRadioBlob *record = ChumbRadioEventSource::instance()->getEvent(conn->eventId, conn->eventId);
+
+    if(record == NULL) { return 0; }
+
+    conn->blob = record;
+    setSegments(conn, record->getData(), record->getSize());
+
+    return 1;
+}
+
+/*! (re)start the connection's deadline */
+void ChumbRadioHTTPServer::arm(Connection *conn, int seconds)
+{
+    unsigned long ticks = (unsigned long)seconds * (1000 / CRAD_HTTP_TIMER_TICK_MS);
+    long behind = (long)(currentTick() - _timers.getTick());
+
+    /*! the wheel only moves on in expireTimers(), after the events, so it
+     *  is as far behind as the reactor slept; count from now, not from then */
+    if(behind > 0) { ticks += behind; }
+
+    _timers.schedule(&conn->timer, ticks);
+}
+
+/*! close every connection whose client missed its deadline */
+void ChumbRadioHTTPServer::expireTimers()
+{
+    unsigned long now = currentTick();
+    ChumbRadioTimer *timer;
+
+    while( (timer = _timers.expire(now)) != NULL )
+    {
+        Connection *conn = (Connection *)timer->owner;
+
+        if(conn->parked)
+        {
+            unpark(conn, 1);
+        }
+        else
+        {
+            closeConnection(conn);
+        }
+    }
+}
+
+void ChumbRadioHTTPServer::dispatch(Connection *conn, int admitted)
+{
+    pthread_mutex_lock(&_pendingMutex);
+
+    /*! the dispatch threads are already behind, so shed the request now
+     *  rather than let the backlog (and the wait for it) keep growing;
+     *  parked requests coming back were let in once already */
+    if(!admitted && (_pending.size() >= (size_t)_queueDepth))
+    {
+        _stats.rejected++;
+        pthread_mutex_unlock(&_pendingMutex);
+
+        reject(conn);
+        return;
+    }
+
+    /*! the reactor stops watching the socket while a dispatch thread owns it */
+    unwatch(conn);
+    conn->busy = 1;
+
+    _pending.push_back(conn);
+    _stats.dispatched++;
+    _stats.queueDepth = _pending.size();
+    if(_stats.queueDepth > _stats.queuePeak) { _stats.queuePeak = _stats.queueDepth; }
+
+    pthread_cond_signal(&_pendingCond);
+    pthread_mutex_unlock(&_pendingMutex);
+}
+
+/*! answer a request 503 from the reactor thread, then close the connection */
+void ChumbRadioHTTPServer::reject(Connection *conn)
+{
+    ChumbRadioResponse response(CRAD_HTTP_SERVICE_UNAVAILABLE);
+    char retry_after[16];
+
+    snprintf(retry_after, sizeof(retry_after), "%d", CRAD_HTTP_RETRY_AFTER);
+    response.addHeader("Retry-After", retry_after);
+
+    conn->keepAlive = 0;
+
+    prepareResponse(conn, &response);
+    writeConnection(conn);
+}
+
+/*! answer a connection accepted over the limit 503, without reading its request */
+void ChumbRadioHTTPServer::refuse(int fd)
+{
+    char buff[512];
+    int length;
+
+    length = snprintf(buff, sizeof(buff),
+        "HTTP/1.1 503 Service Unavailable\r\n"
+        "Retry-After: %d\r\n"
+        "Content-Length: 0\r\n"
+        "Connection: close\r\n"
+        "\r\n", CRAD_HTTP_RETRY_AFTER);
+
+    send(fd, buff, length, MSG_DONTWAIT | MSG_NOSIGNAL);
+
+    /*! discard anything already received, so the close doesn't reset the
+     *  connection before the client has read the reply */
+    while(recv(fd, buff, sizeof(buff), MSG_DONTWAIT) > 0) { }
+
+    close(fd);
+
+    pthread_mutex_lock(&_pendingMutex);
+    _stats.refused++;
+    pthread_mutex_unlock(&_pendingMutex);
+}
+
+void ChumbRadioHTTPServer::drainCompleted()
+{
+    char buff[64];
+    int events;
+
+    while(read(_wakefd[0], buff, sizeof(buff)) > 0) { }
+
+    for(;;)
+    {
+        Connection *conn = NULL;
+
+        pthread_mutex_lock(&_completedMutex);
+        if(!_completed.empty())
+        {
+            conn = _completed.front();
+            _completed.pop_front();
+        }
+        pthread_mutex_unlock(&_completedMutex);
+
+        if(conn == NULL) { break; }
+
+        conn->busy = 0;
+
+        if(conn->parkTimeout > 0)
+        {
+            park(conn);
+            continue;
+        }
+
+        /*! the stream's first record went out with the response; it joins
+         *  the subscribers for the rest */
+        if(conn->streaming)
+        {
+            conn->subscriberLink = _subscribers.insert(_subscribers.end(), conn);
+            _heldConnections++;
+            ChumbRadioEventSource::instance()->subscribe();
+        }
+
+        writeConnection(conn);
+    }
+
+    pthread_mutex_lock(&_completedMutex);
+    events = _eventsPending;
+    _eventsPending = 0;
+    pthread_mutex_unlock(&_completedMutex);
+
+    if(events) { feedSubscribers(); }
+
+    pthread_mutex_lock(&_completedMutex);
+    events = _statePending;
+    _statePending = 0;
+    pthread_mutex_unlock(&_completedMutex);
+
+    /*! every parked request is served again; handlers that find the
+     *  state they were waiting on unchanged simply park again */
+    while(events && !_parked.empty())
+    {
+        unpark(_parked.front(), 0);
+    }
+}
+
+/*!
+
+  Rewrite a response produced by the content handlers so that it can be
+  sent on a persistent connection: the status line is upgraded to HTTP/1.1,
+  the body is framed with an exact Content-Length, and the Connection
+  header reflects whether we intend to keep the socket open.
+
+*/
+void ChumbRadioHTTPServer::frameResponse(Connection *conn, const char *response, size_t length)
+{
+    const char *end = response + length;
+    const char *line = response;
+    const char *body = end;
+    char content_length[64];
+
+    /*! status line */
+    {
+        const char *line_end = (const char *)memchr(line, '\n', end - line);
+        const char *status = (const char *)memchr(line, ' ', end - line);
+
+        if( (line_end == NULL) || (status == NULL) || (status > line_end) )
+        {
+            conn->body.assign(response, length);
+            conn->keepAlive = 0;
+            setSegments(conn, conn->body.data(), conn->body.size());
+            return;
+        }
+
+        conn->head.append("HTTP/1.1");
+        conn->head.append(status, line_end + 1 - status);
+        line = line_end + 1;
+    }
+
+    /*! header fields, minus the ones we are about to replace */
+    while(line < end)
+    {
+        const char *line_end = (const char *)memchr(line, '\n', end - line);
+
+        if(line_end == NULL) { line_end = end - 1; }
+
+        if( (*line == '\r') || (*line == '\n') )
+        {
+            body = line_end + 1;
+            break;
+        }
+
+        if( strncasecmp(line, "Content-Length:", 15) && strncasecmp(line, "Connection:", 11) )
+        {
+            conn->head.append(line, line_end + 1 - line);
+        }
+
+        line = line_end + 1;
+    }
+
+    snprintf(content_length, sizeof(content_length), "Content-Length: %lu\r\n", (unsigned long)(end - body));
+
+    conn->head.append(content_length);
+    conn->head.append(conn->keepAlive ? "Connection: keep-alive\r\n\r\n" : "Connection: close\r\n\r\n");
+
+    /*! HEAD responses carry the length of the body, but not the body; the
+     *  library frees its buffer as soon as we return, so the body is copied */
+    if(conn->request.getRequestMethod() != chumby::HEAD)
+    {
+        conn->body.assign(body, end - body);
+    }
+
+    setSegments(conn, conn->body.data(), conn->body.size());
+}
+
+/*!
+
+  Queue a native response.  Only the header block is built here; the body
+  is sent from wherever it already lives (a shared blob, static memory, or
+  the handler's own buffer, which is taken over rather than copied), or
+  streamed from its file after the header.
+
+*/
+void ChumbRadioHTTPServer::prepareResponse(Connection *conn, ChumbRadioResponse *response)
+{
+    /*! an event stream ends when the connection does */
+    if(response->isEventStream()) { conn->keepAlive = 0; }
+
+    response->getResponseHeader(conn->head, conn->keepAlive);
+
+    /*! HEAD responses carry the length of the body, but not the body */
+    if(conn->request.getRequestMethod() == chumby::HEAD)
+    {
+        setSegments(conn, NULL, 0);
+        return;
+    }
+
+    if(response->isEventStream())
+    {
+        conn->streaming = 1;
+        conn->eventId = response->getEventId();
+    }
+
+    if(response->getFile() != NULL)
+    {
+        conn->file = response->releaseFile();
+        conn->fileOffset = 0;
+        conn->fileEnd = conn->file->getSize();
+        setSegments(conn, NULL, 0);
+    }
+    else if(response->getBlob() != NULL)
+    {
+        conn->blob = response->releaseBlob();
+        setSegments(conn, conn->blob->getData(), conn->blob->getSize());
+    }
+    else if(response->getStaticContent() != NULL)
+    {
+        setSegments(conn, response->getStaticContent(), response->getContentLength());
+    }
+    else
+    {
+        response->swapContent(conn->body);
+        setSegments(conn, conn->body.data(), conn->body.size());
+    }
+}
+
+void *ChumbRadioHTTPServer::workerThread(void *arg)
+{
+    ChumbRadioHTTPServer *server = (ChumbRadioHTTPServer *)arg;
+
+    for(;;)
+    {
+        Connection *conn;
+
+        pthread_mutex_lock(&server->_pendingMutex);
+        while(server->_pending.empty())
+        {
+            pthread_cond_wait(&server->_pendingCond, &server->_pendingMutex);
+        }
+        conn = server->_pending.front();
+        server->_pending.pop_front();
+        server->_stats.queueDepth = server->_pending.size();
+        pthread_mutex_unlock(&server->_pendingMutex);
+
+        /*! look up the handler for the request path, then run it */
+        {
+            ChumbRadioSlice path = conn->request.getPath();
+            chumby::HTTPContentHandler *handler;
+            ChumbRadioHandler *native;
+
+            handler = server->_routes.lookup(path.data, path.length);
+
+            /*! native handlers skip the chumby::HTTPResponse round trip */
+            native = dynamic_cast<ChumbRadioHandler *>(handler);
+
+            if(native != NULL)
+            {
+                ChumbRadioResponse *native_response = native->serve(conn->request);
+
+                if(native_response == NULL)
+                {
+                    native_response = new ChumbRadioResponse(CRAD_HTTP_NOT_FOUND);
+                }
+
+                /*! parked requests are answered later, by another dispatch */
+                if(native_response->getParkTimeout() > 0)
+                {
+                    conn->parkTimeout = native_response->getParkTimeout();
+                    conn->parkGeneration = native_response->getParkGeneration();
+                }
+                else
+                {
+                    prepareResponse(conn, native_response);
+                }
+
+                delete native_response;
+            }
+            else
+            {
+                std::string raw_request = conn->request.getRawRequest().str();
+                chumby::HTTPRequest request(raw_request);
+                chumby::HTTPResponse *response = NULL;
+
+                if(handler != NULL)
+                {
+                    response = handler->handleRequest(request);
+                }
+                else
+                {
+                    response = server->_contentManager->handleRequest(request);
+                }
+
+                if(response == NULL)
+                {
+                    response = new chumby::HTTPResponse(chumby::HTTP_RESPONSE_CODE_NOT_FOUND);
+                }
+
+                char *response_str = response->getResponseString();
+
+                frameResponse(conn, response_str, response->getResponseLength());
+
+                delete [] response_str;
+                delete response;
+            }
+        }
+
+        pthread_mutex_lock(&server->_completedMutex);
+        server->_completed.push_back(conn);
+        pthread_mutex_unlock(&server->_completedMutex);
+
+        /*! wake the reactor so it can send the response */
+        write(server->_wakefd[1], "", 1);
+    }
+
+    return NULL;
+}
@@ -0,0 +1,220 @@
+/*
+ * crad_http_server.h
+ *
+ * (c) Copyright Chumby Industries, 2009
+ * All rights reserved
+ *
+ * This header declares the event driven HTTP server used by chumbradiod.
+ * A single epoll reactor multiplexes every client socket, and a small
+ * fixed set of dispatch threads runs the content handlers, so memory use
+ * no longer grows with the number of connected widgets.  Slow and silent
+ * clients are timed out from a single timer wheel.
+ */
+
+#ifndef CRAD_HTTP_SERVER_H
+#define CRAD_HTTP_SERVER_H
+
+#include <string>
+#include <deque>
+#include <list>
+#include <time.h>
+#include <pthread.h>
+#include <sys/uio.h>
+#include <chumby_httpd/chumby_http_server.h>
+#include "crad_http_request.h"
+#include "crad_http_response.h"
+#include "crad_http_routes.h"
+#include "crad_timer_wheel.h"
+#include "crad_event_source.h"
+
+/*! \name HTTP server defaults */
+/*! \{ */
+#define CRAD_HTTP_DEFAULT_WORKERS       2       /*!< dispatch threads */
+#define CRAD_HTTP_MAX_REQUEST_SIZE      8192    /*!< request header + body limit */
+#define CRAD_HTTP_LISTEN_BACKLOG        64
+#define CRAD_HTTP_KEEPALIVE_TIMEOUT     15      /*!< idle seconds before close */
+#define CRAD_HTTP_FIRST_BYTE_TIMEOUT    5       /*!< seconds from accept to the first request byte */
+#define CRAD_HTTP_HEADER_TIMEOUT        10      /*!< seconds from a request's first byte to its end */
+#define CRAD_HTTP_TIMER_TICK_MS         100     /*!< timeout resolution */
+#define CRAD_HTTP_KEEPALIVE_REQUESTS    100     /*!< requests per connection */
+#define CRAD_HTTP_DEFAULT_QUEUE_DEPTH   16      /*!< requests waiting for a dispatch thread */
+#define CRAD_HTTP_MAX_CONNECTIONS       1024    /*!< client sockets being served, at most */
+#define CRAD_HTTP_RESERVED_FDS          32      /*!< descriptors the connection limit leaves for the daemon */
+#define CRAD_HTTP_RETRY_AFTER           2       /*!< seconds a shed client is asked to wait */
+/*! \} */
+
+/*! @brief load counters, see ChumbRadioHTTPServer::getStats() */
+struct ChumbRadioHTTPStats
+{
+    unsigned long queueDepth;       /*!< requests waiting for a dispatch thread now */
+    unsigned long queuePeak;        /*!< most requests ever waiting at once */
+    unsigned long queueLimit;
+    unsigned long connections;      /*!< open client sockets */
+    unsigned long connectionLimit;
+    unsigned long dispatched;       /*!< requests handed to a dispatch thread */
+    unsigned long rejected;         /*!< requests answered 503 because the queue was full */
+    unsigned long refused;          /*!< connections answered 503 because too many were open */
+};
+
+/*! @brief Chumby Radio event driven HTTP server */
+class ChumbRadioHTTPServer : public ChumbRadioEventListener
+{
+    public:
+
+        ChumbRadioHTTPServer(int port, int pub, int workers = CRAD_HTTP_DEFAULT_WORKERS);
+        ~ChumbRadioHTTPServer();
+
+        /*! serve requests forever from the calling thread */
+        void start();
+
+        /*! serve requests for exactly this path with handler */
+        void addRoute(const char *path, chumby::HTTPContentHandler *handler);
+
+        /*! serve requests for any path below prefix with handler */
+        void addPrefixRoute(const char *prefix, chumby::HTTPContentHandler *handler);
+
+        /*! handlers added here are only tried for paths without a route */
+        void addContentHandler(chumby::HTTPContentHandler *handler);
+
+        /*! idle seconds before a persistent connection is closed */
+        void setKeepAliveTimeout(int seconds) { _keepAliveTimeout = seconds; }
+
+        /*! seconds a new connection may take to start its first request */
+        void setFirstByteTimeout(int seconds) { _firstByteTimeout = seconds; }
+
+        /*! seconds a request may take to arrive in full, once started */
+        void setHeaderTimeout(int seconds) { _headerTimeout = seconds; }
+
+        /*! requests served on one connection before it is closed */
+        void setKeepAliveRequests(int requests) { _keepAliveRequests = requests; }
+
+        /*! requests allowed to wait for a dispatch thread; more are answered 503 */
+        void setQueueDepth(int depth) { _queueDepth = (depth > 0) ? depth : 1; }
+
+        /*! client sockets allowed open at once, not counting event streams and
+         *  parked requests; more are answered 503 and closed.  By default,
+         *  what RLIMIT_NOFILE leaves after CRAD_HTTP_RESERVED_FDS, up to
+         *  CRAD_HTTP_MAX_CONNECTIONS */
+        void setMaxConnections(int connections) { _maxConnections = (connections > 0) ? connections : 1; }
+
+        /*! take a consistent copy of the load counters; safe from any thread */
+        void getStats(ChumbRadioHTTPStats &stats);
+
+        /*! called by the event source when there are records for the event streams */
+        void eventsPublished();
+
+        /*! called by the event source when parked requests should be served again */
+        void stateChanged();
+
+    private:
+
+        /*! @brief per-socket state, owned by the reactor thread */
+        struct Connection
+        {
+            int                 fd;
+            int                 watched;    /*!< registered with epoll */
+            int                 busy;       /*!< request is out with a dispatch thread */
+            int                 keepAlive;  /*!< reuse after the current response */
+            int                 requests;   /*!< requests served so far */
+            int                 receiving;  /*!< part of a request has arrived */
+            int                 finished;   /*!< client has shut down its side */
+            int                 streaming;  /*!< the response is an event stream */
+            unsigned long       eventId;    /*!< last event stream record queued */
+            int                 parked;     /*!< request is held until the state changes */
+            int                 parkTimeout;/*!< seconds, as asked for by the handler */
+            unsigned int        parkGeneration;
+            ChumbRadioTimer     timer;      /*!< armed while waiting on the client */
+            std::string         buffer;     /*!< received bytes, starting with the current request */
+            ChumbRadioRequest   request;    /*!< request being served, parsed in place */
+            long                consumed;   /*!< bytes of buffer making up that request */
+            std::string         head;       /*!< status line and header fields */
+            std::string         body;       /*!< body owned by the connection */
+            ChumbRadioBlob     *blob;       /*!< shared body, referenced until sent */
+            struct iovec        segments[2];/*!< head and body, wherever the body lives */
+            size_t              length;     /*!< total bytes in segments, 0 when idle */
+            size_t              sent;       /*!< bytes of segments already sent */
+            ChumbRadioFile     *file;       /*!< body streamed with sendfile() after segments */
+            off_t               fileOffset;
+            off_t               fileEnd;
+            std::list<Connection *>::iterator link;
+            std::list<Connection *>::iterator subscriberLink;  /*!< valid while streaming */
+            std::list<Connection *>::iterator parkedLink;      /*!< valid while parked */
+        };
+
+        int                             _socketfd;
+        int                             _epollfd;
+        int                             _wakefd[2];
+        int                             _workers;
+        int                             _keepAliveTimeout;
+        int                             _firstByteTimeout;
+        int                             _headerTimeout;
+        int                             _keepAliveRequests;
+        int                             _queueDepth;
+        int                             _maxConnections;
+
+        /*! event streams and parked requests, which _maxConnections leaves out */
+        int                             _heldConnections;
+
+        /*! given back when descriptors run out, to answer the next client 503 */
+        int                             _sparefd;
+        ChumbRadioRouteTable            _routes;
+        chumby::HTTPContentManager     *_contentManager;
+
+        /*! every open connection */
+        std::list<Connection *>         _connections;
+
+        /*! connections receiving an event stream */
+        std::list<Connection *>         _subscribers;
+
+        /*! records were published since the event streams were last fed */
+        int                             _eventsPending;
+
+        /*! requests waiting for the radio state to change */
+        std::list<Connection *>         _parked;
+
+        /*! the state changed since parked requests were last resumed */
+        int                             _statePending;
+
+        /*! first byte, header and keep-alive deadlines; reactor thread only */
+        ChumbRadioTimerWheel            _timers;
+
+        /*! requests waiting for a dispatch thread */
+        std::deque<Connection *>        _pending;
+        pthread_mutex_t                 _pendingMutex;
+        pthread_cond_t                  _pendingCond;
+
+        /*! load counters, guarded by _pendingMutex */
+        ChumbRadioHTTPStats             _stats;
+
+        /*! responses waiting to be handed back to the reactor */
+        std::deque<Connection *>        _completed;
+        pthread_mutex_t                 _completedMutex;
+
+        void acceptConnections();
+        void readConnection(Connection *conn);
+        void writeConnection(Connection *conn);
+        void closeConnection(Connection *conn);
+        void processBuffer(Connection *conn);
+        void drainCompleted();
+        void expireTimers();
+        void feedSubscribers();
+        void park(Connection *conn);
+        void unpark(Connection *conn, int expired);
+        int nextEvent(Connection *conn);
+        void arm(Connection *conn, int seconds);
+        void watch(Connection *conn, unsigned int events);
+        void unwatch(Connection *conn);
+
+        void dispatch(Connection *conn, int admitted = 0);
+        void reject(Connection *conn);
+        void refuse(int fd);
+
+        static void frameResponse(Connection *conn, const char *response, size_t length);
+        static void prepareResponse(Connection *conn, ChumbRadioResponse *response);
+        static void setSegments(Connection *conn, const char *body, size_t length);
+        static void resetResponse(Connection *conn);
+        static void *workerThread(void *arg);
+        static unsigned long currentTick();
+};
+
+#endif
@@ -42,11 +42,16 @@
 #include <asm/types.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <time.h>
 #include <linux/hiddev.h>
 #include <alsa/asoundlib.h>
 
 #include "qndriver.h"
+#include "qnsim.h"
 #include "crad_interface.h"
+#include "crad_format.h"
+#include "crad_scan.h"
+#include "crad_cache.h"
 //#include "crad_internal.h"
 
 // 50 ms input- and output- buffer length
@@ -63,10 +68,12 @@ static int get_radio_station(crad_t *p_crad);
 static char *get_radio_name(crad_t *p_crad);
 extern void set_radio_volume(crad_t *p_crad,int volume);
 extern void dump_radio_xml(crad_t *p_crad);
-char *get_radio_stations(crad_t *p_crad);
+extern UINT8 QND_ReadRegs(UINT8 adr, UINT8 *buf, UINT8 n);
 int crad_refresh_station_list(crad_t *p_crad);
 int crad_set_power(crad_t *p_crad, int power);
 int crad_set_rds(crad_t *p_crad, int rds);
+/*! advance the state generation after anything in the status XML changed */
+static void crad_state_changed(crad_t *p_crad);
 
 /*! exported for chumbyradio cmd line (kinda hacky) */
 struct hiddev_devinfo g_device_info;
@@ -77,27 +84,55 @@ int i2c_file = 0;
 
 
 
+/*! RDS reader's poll, see rds_poll() */
+struct rds_poll_t {
+    int  status;        // RDS_RXUPD as last seen
+    int  updated;       // set if it toggled, and raw holds the new group
+    char raw[8];
+};
+
+// Runs on the executor, behind any tune or seek that's waiting.
+static int rds_poll(crad_t *p_crad, void *arg) {
+    struct rds_poll_t *poll = (struct rds_poll_t *)arg;
+    int status = QND_ReadReg(STATUS3)&RDS_RXUPD;
+
+    poll->updated = (status != poll->status);
+    if(poll->updated) {
+        poll->status = status;
+        // Read the registers from the FM chip.
+        QND_RDSLoadData((UINT8 *)poll->raw, 0);
+    }
+    return CRAD_OK;
+}
+
+static int rds_enable(crad_t *p_crad, void *arg) {
+    QND_RDSEnable(*(int *)arg ? QND_RDS_ON : QND_RDS_OFF);
+    return CRAD_OK;
+}
+
 static void *rds_reader(void *data) {
     struct _crad_t *p_crad = (struct _crad_t *)data;
     struct rds_data *rds_data = &(p_crad->rds_data);
-    int rds_status = 0;
-    int this_rds_status;
-    int last_callsign_hash;
+    struct rds_poll_t poll;
+    int last_callsign_hash = 0;
     int callsign_hash_change_count = 0;
+    int on = 1;
+
+    memset(&poll, 0, sizeof(poll));
 
-    QND_RDSEnable(QND_RDS_ON);
+    crad_execute(&p_crad->executor, CRAD_PRIORITY_BACKGROUND, rds_enable, &on);
     while(p_crad->rds_thread_running) {
         int callsign_hash;
-        char raw_rds_data[8];
         int waited = 0;
 
         // Wait for the RDS signal to toggle.
-        while(this_rds_status == rds_status) {
+        do {
             waited++;
             // Sleep value derived from the fact that 50.4 packets/sec are
-            // permissible, 
-            usleep(20000);
-            this_rds_status = QND_ReadReg(STATUS3)&RDS_RXUPD;
+            // permissible.  On the driver's clock, so a simulated chip can
+            // run it on virtual time.
+            QND_Sleep(20000);
+            crad_execute(&p_crad->executor, CRAD_PRIORITY_BACKGROUND, rds_poll, &poll);
 
             // If we wait more than 100 times, reset RDS data, because it
             // probably means we've changed to a station that doesn't
@@ -106,19 +141,30 @@ static void *rds_reader(void *data) {
                 pthread_mutex_lock(&p_crad->rds_mutex);
                 bzero(rds_data, sizeof(struct rds_data));
                 pthread_mutex_unlock(&p_crad->rds_mutex);
+                crad_state_changed(p_crad);
 
                 callsign_hash_change_count = 0;
             }
-        }
-        rds_status = this_rds_status;
+        } while(!poll.updated && p_crad->rds_thread_running);
 
-        // Read the registers from the FM chip.
-        QND_RDSLoadData(raw_rds_data, 0);
+        if(!poll.updated)
+            break;
 
+        {
+            struct rds_data previous;
+            int changed;
 
-        pthread_mutex_lock(&p_crad->rds_mutex);
-        crad_decode_rds(rds_data, raw_rds_data);
-        pthread_mutex_unlock(&p_crad->rds_mutex);
+            pthread_mutex_lock(&p_crad->rds_mutex);
+            previous = *rds_data;
+            crad_decode_rds(rds_data, poll.raw);
+            changed = memcmp(&previous, rds_data, sizeof(previous));
+            pthread_mutex_unlock(&p_crad->rds_mutex);
+
+            // Most groups repeat what we already have, so only
+            // advance the generation if the decoder learned something.
+            if(changed)
+                crad_state_changed(p_crad);
+        }
 
         // Convert the RDS data to an integer.  This works because it's
         // four characters (or less).  If the callsign is different,
@@ -137,12 +183,14 @@ static void *rds_reader(void *data) {
             pthread_mutex_lock(&p_crad->rds_mutex);
             bzero(rds_data, sizeof(struct rds_data));
             pthread_mutex_unlock(&p_crad->rds_mutex);
+            crad_state_changed(p_crad);
 
             last_callsign_hash = callsign_hash;
             callsign_hash_change_count = 0;
         }
     }
-    QND_RDSEnable(QND_RDS_OFF);
+    on = 0;
+    crad_execute(&p_crad->executor, CRAD_PRIORITY_BACKGROUND, rds_enable, &on);
 
     fprintf(stderr, "Quitting RDS thread...\n");
     pthread_exit(NULL);
@@ -197,7 +245,13 @@ int read_kernel_memory(long offset) {
 }   
 
 int write_kernel_memory(long offset, long value) {
-    int old_value = read_kernel_memory(offset);
+    int old_value;
+
+    // There's no board around a simulated chip to poke at.
+    if(!QND_GetBus()->hardware)
+        return 0;
+
+    old_value = read_kernel_memory(offset);
     int scaled_offset = (offset-(offset & 0xFFFF0000L));
     if(regutil_mem)
         regutil_mem[scaled_offset/sizeof(long)] = value;
@@ -520,13 +574,106 @@ error:
 
 extern UINT8 chumby_XCLK;
 
+/*! chip bring-up for crad_create(), see bring_up() */
+struct bring_up_t {
+    crad_t *p_crad;
+    crad_command_t command;         // async only, see crad_submit()
+    sem_t submitted;                // async only, posted once command is queued
+    int cached;                     // restore the calibration in cache, else measure it and scan
+    crad_cache_t cache;             // to save, once a scan has filled it in
+};
+
+static void publish_stations(crad_t *p_crad, const crad_scan_t *p_scan);
+
+// QND_Init() and friends sleep for seconds in all, and without a cache
+// there's a scan to do as well.  With an async crad_create() this is the
+// first command on the executor, so whatever is asked of the chip
+// meanwhile queues up behind it, and no tune can cut the scan short.
+static int bring_up(crad_t *p_crad, void *arg) {
+    struct bring_up_t *p_bring_up = (struct bring_up_t *)arg;
+
+    if(p_bring_up->cached) {
+        fprintf(stderr, "Initializing from %s...\n", p_crad->cache_path);
+        QND_InitCalibrated(p_bring_up->cache.rssinarray, p_bring_up->cache.rssin, p_bring_up->cache.clearchannel);
+    }
+    else {
+        fprintf(stderr, "Initializing...\n");
+        QND_Init();
+    }
+
+    fprintf(stderr, "Setting system mode...\n");
+    QND_SetSysMode(QND_MODE_FM|QND_MODE_RX);
+
+    fprintf(stderr, "Setting country...\n");
+    QND_SetCountry(p_bring_up->cached ? p_bring_up->cache.country : COUNTRY_USA);
+
+    if(!p_bring_up->cached) {
+        int station = get_radio_station(p_crad);
+        int mute_status = QND_ReadReg(REG_PD2);
+        crad_scan_t scan;
+
+        // Refresh the list of known-available channels.  This can take a
+        // while, so we do it during init.
+        fprintf(stderr, "Refreshing station list...\n");
+        crad_scan_begin(&scan, CRAD_SCAN_DEFAULT, 0);
+        while(crad_scan_step(&scan)) { }
+        crad_scan_end(&scan);
+
+        publish_stations(p_crad, &scan);
+        crad_cache_capture(&p_bring_up->cache);
+
+        tune_radio(p_crad, station);
+        QND_WriteReg(REG_PD2, mute_status);
+        fprintf(stderr, "Done with refresh.\n");
+    }
+
+    p_crad->initializing = 0;
+    crad_state_changed(p_crad);
+    return CRAD_OK;
+}
+
+// The command record has to outlive crad_create(), so this waits for
+// bring_up() to finish and cleans up after it.  It is started before the
+// command is queued, so that nothing is on the executor if it can't be.
+static void *bring_up_thread(void *arg) {
+    struct bring_up_t *p_bring_up = (struct bring_up_t *)arg;
+    crad_t *p_crad = p_bring_up->p_crad;
+
+    while(sem_wait(&p_bring_up->submitted) != 0) { }
+    sem_destroy(&p_bring_up->submitted);
+
+    crad_wait(&p_bring_up->command);
+
+    if(!p_bring_up->cached && p_crad->cache_path != NULL) {
+        crad_cache_save(p_crad->cache_path, &p_bring_up->cache);
+    }
+
+    free(p_bring_up);
+    return NULL;
+}
+
 int crad_create(struct _crad_info_t *p_crad_info, struct _crad_t **pp_crad)
 {
+    struct bring_up_t *p_bring_up;
+    int i, ret;
+
     /*! sanity check - null ptr */
     if(pp_crad == 0) { return CRAD_INVALID_PARAM; }
 
+    // Swap the chip for the model, if asked to.  A scene that won't load
+    // fails the call before there's anything to clean up.
+    if(p_crad_info != NULL && p_crad_info->simulate != NULL) {
+        if(!*p_crad_info->simulate)
+            QNS_DefaultScene();
+        else if(QNS_LoadScene(p_crad_info->simulate) < 0)
+            return CRAD_FAIL;
+        QND_SetBus(&qns_bus);
+        fprintf(stderr, "Simulating the radio\n");
+    }
+
     /*! allocate associated context */
     crad_t *p_crad = (crad_t*)malloc(sizeof(crad_t));
+    if(p_crad == NULL) { return CRAD_OUT_OF_MEMORY; }
 
     /*! return allocated context */
     *pp_crad = p_crad;
@@ -536,9 +683,28 @@ int crad_create(struct _crad_info_t *p_crad_info, struct _crad_t **pp_crad)
     /*! default state - invalid file */
     p_crad->device_file = -1;
 
+    pthread_mutex_init(&p_crad->stations_mutex, NULL);
+    for(i = 0; i < CRAD_FORMAT_COUNT; i++) { crad_buffer_init(&p_crad->stations[i]); }
+
+    /*! seed the generation from the clock, so that a generation handed out
+     *  before a restart is unlikely to name a different state afterwards */
+    pthread_mutex_init(&p_crad->state_mutex, NULL);
+    pthread_cond_init(&p_crad->state_cond, NULL);
+    p_crad->generation = (unsigned int)time(NULL);
+    p_crad->sampled_channel = -1;
+    p_crad->sampled_status1 = -1;
+    p_crad->sampled_strength = -1;
+
+    /*! the RDS reader comes and goes, but its lock lasts as long as p_crad */
+    pthread_mutex_init(&p_crad->rds_mutex, NULL);
+    pthread_mutex_init(&p_crad->rds_control_mutex, NULL);
+
+    /*! commands run on the calling thread until the executor is started */
+    crad_executor_init(&p_crad->executor, p_crad);
+
     // Enable PWM3 of the CPU to run at 24 MHz.
     {
-        int fd = open("/psp/fmradio_xclk", O_RDONLY);
+        int fd = QND_GetBus()->hardware ? open("/psp/fmradio_xclk", O_RDONLY) : -1;
         if(fd > 0) {
             chumby_XCLK = 1;
             write_kernel_memory(0x80018138, 0x0c000000); // Change pin to PWM3 from GPIO.
@@ -548,29 +714,92 @@ int crad_create(struct _crad_info_t *p_crad_info, struct _crad_t **pp_crad)
         }
     }
 
-    fprintf(stderr, "Initializing...\n");
-    QND_Init();
+    if(p_crad_info != NULL) { p_crad->cache_path = p_crad_info->cache; }
 
-    fprintf(stderr, "Setting system mode...\n");
-    QND_SetSysMode(QND_MODE_FM|QND_MODE_RX);
+    p_bring_up = (struct bring_up_t *)malloc(sizeof(struct bring_up_t));
+    if(p_bring_up == NULL) {
+        ret = CRAD_OUT_OF_MEMORY;
+        goto error;
+    }
+    p_bring_up->p_crad = p_crad;
+
+    // A cache from the last run saves calibrating and scanning; the list
+    // is marked stale for the caller to rescan once it's serving requests.
+    p_bring_up->cached = p_crad->cache_path != NULL &&
+                         CRAD_SUCCESS(crad_cache_load(p_crad->cache_path, &p_bring_up->cache)) &&
+                         p_bring_up->cache.xclk == chumby_XCLK;
+    if(p_bring_up->cached) {
+        for(chCount = 0; chCount < p_bring_up->cache.count; chCount++) {
+            chList[chCount] = p_bring_up->cache.channels[chCount];
+        }
+        p_crad->stations_stale = 1;
+    }
 
-    fprintf(stderr, "Setting country...\n");
-    QND_SetCountry(COUNTRY_USA);
+    // The band doesn't need the chip, so status reads have it while
+    // bring_up() is still going.
+    QND_SetCountry(p_bring_up->cached ? p_bring_up->cache.country : COUNTRY_USA);
+
+    if(p_crad_info != NULL && p_crad_info->async) {
+        pthread_t thread;
+
+        // From here on, only the executor talks to the chip.
+        p_crad->initializing = 1;
+        ret = crad_executor_start(&p_crad->executor);
+        if(CRAD_FAILED(ret)) {
+            free(p_bring_up);
+            goto error;
+        }
+
+        sem_init(&p_bring_up->submitted, 0, 0);
+        if(pthread_create(&thread, NULL, bring_up_thread, p_bring_up)) {
+            perror("Unable to create bring-up thread");
+            sem_destroy(&p_bring_up->submitted);
+            free(p_bring_up);
+            ret = CRAD_FAIL;
+            goto error;
+        }
+        pthread_detach(thread);
+
+        // Queued before anyone else can get at the executor.
+        crad_submit(&p_crad->executor, CRAD_PRIORITY_INTERACTIVE, &p_bring_up->command, bring_up, p_bring_up);
+        sem_post(&p_bring_up->submitted);
+        return CRAD_OK;
+    }
 
-    // Refresh the list of known-available channels.  This can take a
-    // while, so we do it during init.
-    fprintf(stderr, "Refreshing station list...\n");
-    crad_refresh_station_list(p_crad);
-    fprintf(stderr, "Done with refresh.\n");
+    bring_up(p_crad, p_bring_up);
+
+    if(!p_bring_up->cached && p_crad->cache_path != NULL) {
+        crad_cache_save(p_crad->cache_path, &p_bring_up->cache);
+    }
+    free(p_bring_up);
+
+    // From here on, only the executor talks to the chip.
+    ret = crad_executor_start(&p_crad->executor);
+    if(CRAD_FAILED(ret)) { goto error; }
 
     return CRAD_OK;
+
+error:
+    // Nothing has been queued, so this only stops the executor if it was
+    // started, and releases p_crad.
+    crad_close(p_crad);
+    *pp_crad = NULL;
+    return ret;
 }
 
 int crad_close(struct _crad_t *p_crad)
 {
+    int i;
+
     /*! sanity check - null ptr */
     if(p_crad == 0) { return CRAD_INVALID_PARAM; }
 
+    /*! the RDS reader uses the executor, so it goes first */
+    crad_set_rds(p_crad, 0);
+
+    /*! let queued commands finish */
+    crad_executor_destroy(&p_crad->executor);
+
     /*! cleanup device file */
     if(p_crad->device_file != -1)
     {
@@ -578,6 +807,15 @@ int crad_close(struct _crad_t *p_crad)
         close(p_crad->device_file);
     }
 
+    pthread_mutex_destroy(&p_crad->rds_control_mutex);
+    pthread_mutex_destroy(&p_crad->rds_mutex);
+
+    pthread_cond_destroy(&p_crad->state_cond);
+    pthread_mutex_destroy(&p_crad->state_mutex);
+
+    for(i = 0; i < CRAD_FORMAT_COUNT; i++) { crad_buffer_free(&p_crad->stations[i]); }
+    pthread_mutex_destroy(&p_crad->stations_mutex);
+
     /*! free associated context */
     free(p_crad);
 
@@ -598,167 +836,406 @@ int crad_refresh(struct _crad_t *p_crad, char *device_path)
     return CRAD_OK;
 }
 
-static char *html_escape(char *output, int size, char *input) {
-    int offset = 0;
-    char *base = output;
-    bzero(output, size);
+void crad_buffer_init(struct _crad_buffer_t *p_buffer) {
+    p_buffer->data = NULL;
+    p_buffer->length = 0;
+    p_buffer->capacity = 0;
+    p_buffer->failed = 0;
+}
+
+void crad_buffer_free(struct _crad_buffer_t *p_buffer) {
+    free(p_buffer->data);
+    crad_buffer_init(p_buffer);
+}
+
+void crad_buffer_clear(struct _crad_buffer_t *p_buffer) {
+    p_buffer->length = 0;
+    p_buffer->failed = 0;
+    if(p_buffer->data) { p_buffer->data[0] = '\0'; }
+}
 
-    // If the user passed us an empty string, just return an empty string.
-    if(!input) {
-        *output = '\0';
-        return base;
+/*! make room for length more bytes plus a terminator, doubling as needed */
+static int crad_buffer_reserve(struct _crad_buffer_t *p_buffer, int length) {
+    int capacity = p_buffer->capacity ? p_buffer->capacity : 256;
+    char *data;
+
+    if(p_buffer->failed) { return 0; }
+
+    if(p_buffer->length + length < p_buffer->capacity) { return 1; }
+
+    while(p_buffer->length + length >= capacity) { capacity *= 2; }
+
+    data = (char *)realloc(p_buffer->data, capacity);
+    if(!data) {
+        p_buffer->failed = 1;
+        return 0;
     }
 
-    while(offset < size && *input) {
-        if(*input == '&') {
-            strncpy(output, "&amp;", size-offset);
-            offset += strlen("&amp;");
-        }
-        else if(*input == '"') {
-            strncpy(output, "&quot;", size-offset);
-            offset += strlen("&quot;");
-        }
-        else if(*input == '\'') {
-            strncpy(output, "&apos;", size-offset);
-            offset += strlen("&apos;");
-        }
-        else if(*input == '<') {
-            strncpy(output, "&lt;", size-offset);
-            offset += strlen("&lt;");
-        }
-        else if(*input == '>') {
-            strncpy(output, "&gt;", size-offset);
-            offset += strlen("&gt;");
+    p_buffer->data = data;
+    p_buffer->capacity = capacity;
+
+    return 1;
+}
+
+void crad_buffer_append(struct _crad_buffer_t *p_buffer, const char *data, int length) {
+    if(!crad_buffer_reserve(p_buffer, length)) { return; }
+
+    memcpy(p_buffer->data + p_buffer->length, data, length);
+    p_buffer->length += length;
+    p_buffer->data[p_buffer->length] = '\0';
+}
+
+void crad_buffer_append_str(struct _crad_buffer_t *p_buffer, const char *str) {
+    crad_buffer_append(p_buffer, str, strlen(str));
+}
+
+/*! append a magnitude in decimal, with an optional sign, zero padded to width characters */
+static void append_decimal(crad_buffer_t *p_buffer, unsigned int magnitude, int negative, int width) {
+    char digits[16];
+    char *p = digits + sizeof(digits);
+
+    /*! the sign counts towards the width, as with printf("%0*d") */
+    if(negative) { width--; }
+
+    do {
+        *--p = '0' + magnitude % 10;
+        magnitude /= 10;
+        width--;
+    } while(magnitude);
+
+    while(width-- > 0) { *--p = '0'; }
+
+    if(negative) { *--p = '-'; }
+
+    crad_buffer_append(p_buffer, p, digits + sizeof(digits) - p);
+}
+
+void crad_buffer_append_int(struct _crad_buffer_t *p_buffer, int value, int width) {
+    if(value < 0) { append_decimal(p_buffer, -(unsigned int)value, 1, width); }
+    else { append_decimal(p_buffer, (unsigned int)value, 0, width); }
+}
+
+void crad_buffer_append_uint(struct _crad_buffer_t *p_buffer, unsigned int value, int width) {
+    append_decimal(p_buffer, value, 0, width);
+}
+
+void crad_buffer_append_escaped(struct _crad_buffer_t *p_buffer, const char *str) {
+    const char *run;
+
+    if(!str) { return; }
+
+    /*! copy runs of plain characters in one go */
+    for(run = str; *str; str++) {
+        const char *entity;
+
+        switch(*str) {
+            case '&':  entity = "&amp;";  break;
+            case '"':  entity = "&quot;"; break;
+            case '\'': entity = "&apos;"; break;
+            case '<':  entity = "&lt;";   break;
+            case '>':  entity = "&gt;";   break;
+            default:   continue;
         }
-        else {
-            *output = *input;
-            offset++;
+
+        crad_buffer_append(p_buffer, run, str - run);
+        crad_buffer_append_str(p_buffer, entity);
+        run = str + 1;
+    }
+
+    crad_buffer_append(p_buffer, run, str - run);
+}
+
+/*! append the status record and, if the mask asks for it, the list of stations, rendering the list only after a rescan */
+static void append_status(crad_t *p_crad, const crad_status_t *p_status, int format, unsigned int mask, crad_buffer_t *p_buffer) {
+    if(!(mask & CRAD_FIELDS_LIST)) {
+        crad_format_begin(p_buffer, format, &crad_status_schema, p_status, mask, 0);
+        return;
+    }
+
+    pthread_mutex_lock(&p_crad->stations_mutex);
+
+    if(!(p_crad->stations_valid & (1 << format))) {
+        crad_buffer_t *p_stations = &p_crad->stations[format];
+        crad_station_t station;
+        int current_channel;
+
+        crad_buffer_clear(p_stations);
+
+        for(current_channel=0; current_channel<chCount; current_channel++) {
+            station.freq = chList[current_channel];
+            crad_format_child(p_stations, format, &crad_station_schema, &station, current_channel);
         }
-        input++;
-        output = base + offset;
+
+        p_crad->stations_count = chCount;
+
+        if(!p_stations->failed) { p_crad->stations_valid |= 1 << format; }
+    }
+
+    /*! the list's head (in CBOR, its length) comes before the cached items */
+    crad_format_begin(p_buffer, format, &crad_status_schema, p_status, mask, p_crad->stations_count);
+
+    if(p_crad->stations_valid & (1 << format)) {
+        crad_buffer_append(p_buffer, p_crad->stations[format].data, p_crad->stations[format].length);
+    }
+    else {
+        p_buffer->failed = 1;
     }
-    return base;
+
+    pthread_mutex_unlock(&p_crad->stations_mutex);
 }
 
-static char rds_string[2048];
-static char psnescaped[256];
-static char ptcescaped[256];
-static char rt0escaped[256];
-static char rt1escaped[256];
+/*! tuner readings taken by read_tuner() */
+struct tuner_readings_t {
+    int reads;
+    int channel;
+    int status1;
+    int strength;
+};
+
+static int read_tuner(crad_t *p_crad, void *arg) {
+    struct tuner_readings_t *p_readings = (struct tuner_readings_t *)arg;
+    int reads = p_readings->reads;
+
+    // Only go to the chip for what was asked for; each of these is a
+    // bus transaction.
+    if(reads & CRAD_STATUS_READ_CHANNEL) { p_readings->channel = get_radio_station(p_crad); }
+
+    // STATUS1, STATUS3 and RSSISIG are adjacent, so both readings come
+    // back in one burst.
+    if((reads & CRAD_STATUS_READ_STEREO) && (reads & CRAD_STATUS_READ_SIGNAL)) {
+        UINT8 regs[3];
+
+        if(!QND_ReadRegs(STATUS1, regs, sizeof(regs))) { memset(regs, 0, sizeof(regs)); }
+
+        p_readings->status1  = regs[0]&1;
+        p_readings->strength = regs[RSSISIG - STATUS1];
+    }
+    else {
+        if(reads & CRAD_STATUS_READ_STEREO)  { p_readings->status1  = QND_ReadReg(STATUS1)&1; }
+        if(reads & CRAD_STATUS_READ_SIGNAL)  { p_readings->strength = QND_ReadReg(RSSISIG); }
+    }
+    return CRAD_OK;
+}
+
+int crad_read_status(struct _crad_t *p_crad, int reads, struct _crad_status_t *p_status) {
+    struct tuner_readings_t readings;
+    int status1, strength, channel, changed = 0;
 
-int crad_get_status_xml(struct _crad_t *p_crad, char *xml_str, int max_size) {
     /*! sanity check - null ptr */
-    if(p_crad == 0) { return CRAD_INVALID_PARAM; }
+    if(p_crad == 0 || p_status == 0) { return CRAD_INVALID_PARAM; }
 
     /*! sanity check - initialization */
     if(!p_crad->is_initialized) { return CRAD_INVALID_CALL; }
 
-    /*! write XML header */
-    strncpy(xml_str, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>", max_size);
-
-    int status1     = QND_ReadReg(STATUS1);
-    int strength    = QND_ReadReg(RSSISIG);
-    int step        = QND_ReadReg(CH_STEP);
-    struct rds_data data_copy;
-    int radio_station = get_radio_station(p_crad);
+    memset(p_status, 0, sizeof(*p_status));
 
+    // Until the chip is up, there's nothing to read and a read would wait
+    // for seconds behind bring_up().
+    if(p_crad->initializing) {
+        reads &= ~(CRAD_STATUS_READ_CHANNEL|CRAD_STATUS_READ_STEREO|CRAD_STATUS_READ_SIGNAL);
+    }
+    p_status->state = p_crad->initializing ? "initializing" : "ready";
 
-    // If the RDS thread isn't running, make the RDS string be empty.
-    // Otherwise, fill it in.
-    if(!p_crad->rds_thread_running) {
-        rds_string[0] = '\0';
+    memset(&readings, 0, sizeof(readings));
+    readings.reads = reads;
+    if(reads & (CRAD_STATUS_READ_CHANNEL|CRAD_STATUS_READ_STEREO|CRAD_STATUS_READ_SIGNAL)) {
+        crad_execute(&p_crad->executor, CRAD_PRIORITY_STATUS, read_tuner, &readings);
     }
-    else {
+    channel  = readings.channel;
+    status1  = readings.status1;
+    strength = readings.strength;
+
+    // The tuned/stereo flags, signal strength and channel come straight
+    // from the chip, so nothing tells us when they move.  Compare what
+    // was read with the readings the generation was taken with.
+    pthread_mutex_lock(&p_crad->state_mutex);
+    if((reads & CRAD_STATUS_READ_CHANNEL) && channel != p_crad->sampled_channel) {
+        p_crad->sampled_channel = channel;
+        changed = 1;
+    }
+    if((reads & CRAD_STATUS_READ_STEREO) && status1 != p_crad->sampled_status1) {
+        p_crad->sampled_status1 = status1;
+        changed = 1;
+    }
+    // The RSSI jitters, so it only counts once it has moved a step from
+    // the reading the generation was taken with, or crossed into or out
+    // of "tuned".
+    if((reads & CRAD_STATUS_READ_SIGNAL) &&
+       (p_crad->sampled_strength < 0 ||
+        abs(strength - p_crad->sampled_strength) >= CRAD_STATUS_SIGNAL_STEP ||
+        (strength > CRAD_STATUS_TUNED_SIGNAL) != (p_crad->sampled_strength > CRAD_STATUS_TUNED_SIGNAL))) {
+        p_crad->sampled_strength = strength;
+        changed = 1;
+    }
+    if(changed) {
+        p_crad->generation++;
+        pthread_cond_broadcast(&p_crad->state_cond);
+    }
+    p_status->generation = p_crad->generation;
+    pthread_mutex_unlock(&p_crad->state_mutex);
+
+    p_status->reads = reads;
+    p_status->found = 1;
+
+    // tuned in or not?
+    p_status->tuned = (strength > CRAD_STATUS_TUNED_SIGNAL);
+
+    // Current station frequency
+    p_status->channel = channel;
 
+    // Whether we're in stereo or not.  (Inverted bit, 0 = stereo.)
+    p_status->stereo = (reads & CRAD_STATUS_READ_STEREO) && !status1;
+
+    // Signal strength (in mysterious moon-units?)
+    p_status->signal = strength;
+    p_status->signal_max = 256;
+
+    // Seek threshold (?)
+    p_status->seek_threshold = 0;
+    p_status->seek_threshold_max = 255;
+
+    // Channel spacing, and start and stop frequencies
+    p_status->spacing = steparray[QND_CH_STEP]*10;
+    p_status->start = QND_CH_START;
+    p_status->stop = QND_CH_STOP;
+
+    // Current band setting
+    p_status->band = (qnd_Country==COUNTRY_CHINA?"China":
+                       (qnd_Country==COUNTRY_USA?"US":
+                         (qnd_Country==COUNTRY_JAPAN?"Japan":"Europe")));
+
+    // If we're monitoring RDS data, copy that over.
+    if((reads & CRAD_STATUS_READ_RDS) && p_crad->rds_thread_running) {
         pthread_mutex_lock(&p_crad->rds_mutex);
-        data_copy = p_crad->rds_data;
-        html_escape(psnescaped, sizeof(psnescaped), data_copy.program_service_name),
-        html_escape(ptcescaped, sizeof(ptcescaped), data_copy.program_type_code),
-        html_escape(rt0escaped, sizeof(rt0escaped), data_copy.radiotext_filled[0]),
-        html_escape(rt1escaped, sizeof(rt1escaped), data_copy.radiotext_filled[1]),
+        memcpy(p_status->callsign, p_crad->rds_data.callsign, sizeof(p_status->callsign));
+        memcpy(p_status->program_service_name, p_crad->rds_data.program_service_name, sizeof(p_status->program_service_name));
+        p_status->program_type_code = p_crad->rds_data.program_type_code;
+        memcpy(p_status->radiotext, p_crad->rds_data.radiotext_filled, sizeof(p_status->radiotext));
+        p_status->julian_date = p_crad->rds_data.julian_date;
+        p_status->hour_code = p_crad->rds_data.hour_code;
+        p_status->minute = p_crad->rds_data.minute;
+        p_status->localtime_hours = p_crad->rds_data.localtime_hours;
+        p_status->localtime_minutes = p_crad->rds_data.localtime_minutes;
         pthread_mutex_unlock(&p_crad->rds_mutex);
-
-        snprintf(rds_string, sizeof(rds_string), 
-                "callsign='%s' "
-                "programservice='%s' "
-                "ptycode='%s' "
-                "radiotext0='%s' "
-                "radiotext1='%s' "
-                "juliandate='%d' "
-                "hour='%d' "
-                "minute='%d' "
-                "localtime='%d:%02d' "
-                ,
-                data_copy.callsign,
-                psnescaped,
-                ptcescaped,
-                rt0escaped,
-                rt1escaped,
-                data_copy.julian_date,
-                data_copy.hour_code,
-                data_copy.minute,
-                data_copy.localtime_hours,
-                data_copy.localtime_minutes
-        );
-    }
-
-
-    snprintf(xml_str, max_size, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
-        "<radio found='1' tuned='%c' station='%d.%d' stereo='%c' "
-        "signal='%d' signal_max='256' "
-        "seek_threshold='%d' seek_threshold_max='255' "
-        "spacing='%d' "
-        "start='%d.%02d' stop='%d.%02d' "
-        "band='%s' "
-        "%s"
-        ">\n"
-        "%s"
-        "</radio>\n"
-        ,
-
-        // tuned in or not?
-        (strength>85?'1':'0'),
-
-        // Current station frequency
-        radio_station/100,
-        radio_station-(100*(radio_station/100)),
-
-        // Whether we're in stereo or not.  (Inverted bit, 0 = stereo.)
-        (status1&1?'0':'1'),
-
-        // Signal strength (in mysterious moon-units?)
-        (strength),
-
-        // Seek threshold (?)
-        (0),
-
-        // Channel spacing
-        steparray[QND_CH_STEP]*10,
-
-        // Start and stop frequencies
-        QND_CH_START/100, QND_CH_START%100,
-        QND_CH_STOP/100,  QND_CH_STOP%100,
-
-        // Current band setting
-        (qnd_Country==COUNTRY_CHINA?"China":
-         (qnd_Country==COUNTRY_USA?"US":
-           (qnd_Country==COUNTRY_JAPAN?"Japan":"Europe"))),
-
-        // If we're monitoring RDS data, copy that over.
-        rds_string,
-
-        // Append the list of stations we've found.
-        get_radio_stations(p_crad)
-
-    );
-
-    /*! if we didn't have room for a null terminator, we should just 
-     *  fail instead of risking corrupting the XML with one */
-    if(xml_str[max_size-1] != '\0') { return CRAD_FAIL; }
+        p_status->rds = 1;
+    }
 
     return CRAD_OK;
 }
 
+int crad_write_status(struct _crad_t *p_crad, const struct _crad_status_t *p_status, int format, unsigned int mask, struct _crad_buffer_t *p_buffer) {
+    /*! sanity check - null ptr */
+    if(p_crad == 0 || p_status == 0 || p_buffer == 0) { return CRAD_INVALID_PARAM; }
+
+    /*! sanity check - format */
+    if(format < 0 || format >= CRAD_FORMAT_COUNT) { return CRAD_INVALID_PARAM; }
+
+    append_status(p_crad, p_status, format, mask, p_buffer);
+
+    crad_format_end(p_buffer, format, &crad_status_schema, mask);
+
+    return p_buffer->failed ? CRAD_OUT_OF_MEMORY : CRAD_OK;
+}
+
+int crad_get_status_xml(struct _crad_t *p_crad, char *xml_str, int max_size) {
+    crad_status_t status;
+    crad_buffer_t buffer;
+    int ret;
+
+    crad_buffer_init(&buffer);
+
+    ret = crad_read_status(p_crad, CRAD_STATUS_READ_ALL, &status);
+    if(CRAD_SUCCESS(ret)) { ret = crad_write_status(p_crad, &status, CRAD_FORMAT_XML, CRAD_FIELDS_ALL, &buffer); }
+
+    if(CRAD_SUCCESS(ret)) {
+        /*! if we don't have room for a null terminator, we should just
+         *  fail instead of risking corrupting the XML with one */
+        if(buffer.length >= max_size) { ret = CRAD_FAIL; }
+        else { memcpy(xml_str, buffer.data, buffer.length + 1); }
+    }
+
+    crad_buffer_free(&buffer);
+
+    return ret;
+}
+
+static void crad_state_changed(crad_t *p_crad) {
+    pthread_mutex_lock(&p_crad->state_mutex);
+    p_crad->generation++;
+    pthread_cond_broadcast(&p_crad->state_cond);
+    pthread_mutex_unlock(&p_crad->state_mutex);
+}
+
+unsigned int crad_wait_generation(struct _crad_t *p_crad, unsigned int generation, int timeout_ms) {
+    struct timespec deadline;
+    unsigned int wakeups;
+
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec  += timeout_ms / 1000;
+    deadline.tv_nsec += (timeout_ms % 1000) * 1000000;
+    if(deadline.tv_nsec >= 1000000000) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000;
+    }
+
+    pthread_mutex_lock(&p_crad->state_mutex);
+    wakeups = p_crad->wakeups;
+    while(p_crad->generation == generation && p_crad->wakeups == wakeups) {
+        if(pthread_cond_timedwait(&p_crad->state_cond, &p_crad->state_mutex, &deadline))
+            break;
+    }
+    generation = p_crad->generation;
+    pthread_mutex_unlock(&p_crad->state_mutex);
+
+    return generation;
+}
+
+void crad_wake_waiters(struct _crad_t *p_crad) {
+    pthread_mutex_lock(&p_crad->state_mutex);
+    p_crad->wakeups++;
+    pthread_cond_broadcast(&p_crad->state_cond);
+    pthread_mutex_unlock(&p_crad->state_mutex);
+}
+
+/*! copy an RDS text field, dropping the padding at the end */
+static void copy_rds_text(char *output, int size, const char *input) {
+    int length = strnlen(input, size - 1);
+
+    memcpy(output, input, length);
+    output[length] = '\0';
+
+    while(length > 0 && output[length - 1] == ' ')
+        output[--length] = '\0';
+}
+
+void crad_status_to_state(const struct _crad_status_t *p_status, struct _crad_state_t *p_state)
+{
+    memset(p_state, 0, sizeof(*p_state));
+
+    p_state->channel  = p_status->channel;
+    p_state->stereo   = p_status->stereo;
+    p_state->strength = p_status->signal;
+
+    if(p_status->rds) {
+        p_state->rds = 1;
+
+        copy_rds_text(p_state->program_service_name, sizeof(p_state->program_service_name),
+                      p_status->program_service_name);
+        copy_rds_text(p_state->radiotext, sizeof(p_state->radiotext), p_status->radiotext[0]);
+        if(p_state->radiotext[0] == '\0')
+            copy_rds_text(p_state->radiotext, sizeof(p_state->radiotext), p_status->radiotext[1]);
+        p_state->julian_date       = p_status->julian_date;
+        p_state->hour_code         = p_status->hour_code;
+        p_state->minute            = p_status->minute;
+        p_state->localtime_hours   = p_status->localtime_hours;
+        p_state->localtime_minutes = p_status->localtime_minutes;
+    }
+}
+
+static int tune_command(crad_t *p_crad, void *arg) {
+    return (tune_radio(p_crad, *(int *)arg) == 1) ? CRAD_OK : CRAD_FAIL;
+}
+
 int crad_tune_radio(struct _crad_t *p_crad, double station)
 {
     /*! sanity check - null ptr */
@@ -773,8 +1250,18 @@ int crad_tune_radio(struct _crad_t *p_crad, double station)
     /*! check range of station */
     if( (station < 87.5) || (station > 108.0) ) { return CRAD_INVALID_CALL; }
 
-    if(tune_radio(p_crad, station*100) != 1) { return CRAD_FAIL; }
+    {
+        int channel = (int)(station*100 + 0.5);
+
+        __sync_fetch_and_add(&p_crad->tunes, 1);
 
+        return crad_execute(&p_crad->executor, CRAD_PRIORITY_INTERACTIVE, tune_command, &channel);
+    }
+}
+
+/*! arg is { up, strength } */
+static int seek_command(crad_t *p_crad, void *arg) {
+    seek_radio(p_crad, ((int *)arg)[0], ((int *)arg)[1]);
     return CRAD_OK;
 }
 
@@ -789,9 +1276,16 @@ int crad_seek_radio(struct _crad_t *p_crad, int direction, int strength)
     /*! santiy check - device file handle */
 //    if(p_crad->device_file == -1) { return CRAD_INVALID_CALL; }
 
-    seek_radio(p_crad, (direction == CRAD_SEEK_DIR_UP) ? 1 : 0, strength);
+    {
+        int args[2];
+
+        args[0] = (direction == CRAD_SEEK_DIR_UP) ? 1 : 0;
+        args[1] = strength;
 
-    return CRAD_OK;
+        __sync_fetch_and_add(&p_crad->tunes, 1);
+
+        return crad_execute(&p_crad->executor, CRAD_PRIORITY_INTERACTIVE, seek_command, args);
+    }
 }
 
 int crad_set_radio_volume(struct _crad_t *p_crad, int volume)
@@ -936,6 +1430,7 @@ int tune_radio(crad_t *p_crad, int station) {
     QND_TuneToCH(station);
     QND_WriteReg(REG_PD2,  UNMUTE);
     p_crad->frequency = station;
+    crad_state_changed(p_crad);
     return 1;
 }
 
@@ -987,48 +1482,131 @@ void set_radio_volume(crad_t *p_crad,int volume) {
 #endif
 }
 
-void dump_radio_registers(crad_t *p_crad) {
+static int dump_registers(crad_t *p_crad, void *) {
     int i;
     for (i=0;i<0x4f;i++) {
         printf("%s (%2d): 0x%04hx\n","register", i, QND_ReadReg(i));
     }
+    return CRAD_OK;
 }
 
+void dump_radio_registers(crad_t *p_crad) {
+    crad_execute(&p_crad->executor, CRAD_PRIORITY_INTERACTIVE, dump_registers, NULL);
+}
 
 
-char *get_radio_stations(crad_t *p_crad) {
-    // A static structure to hold all possible available stations.  A
-    // worst-case scenario of all stations available shows that 2980
-    // bytes will be required for this structure.
-    static char radio_stations_xml[4096];
-    char *xml_offset = radio_stations_xml;
-    int channel_count, current_channel;
 
-    bzero(radio_stations_xml, sizeof(radio_stations_xml));
+/*! make a finished scan's stations the list; status renders see either the old list or the new one */
+static void publish_stations(crad_t *p_crad, const crad_scan_t *p_scan) {
+    pthread_mutex_lock(&p_crad->stations_mutex);
+    for(chCount = 0; chCount < p_scan->count; chCount++) {
+        chList[chCount] = p_scan->channels[chCount];
+    }
+    p_crad->stations_valid = 0;
+    p_crad->stations_stale = 0;
+    pthread_mutex_unlock(&p_crad->stations_mutex);
+}
+
+/*! a station scan in progress, see crad_scan_stations() */
+struct scan_t {
+    unsigned int tunes;             // p_crad->tunes when the scan began
+    int strategy;
+    int current_station;
+    int mute_status;
+    int more;
+    int cancelled;
+    crad_scan_t scan;
+    crad_cache_t cache;             // the state to save, once the scan is done
+};
+
+static int scan_begin(crad_t *p_crad, void *arg) {
+    struct scan_t *p_scan = (struct scan_t *)arg;
+
+    // A tune that got in while this was queued leaves nothing to restore.
+    if(p_crad->tunes != p_scan->tunes) { return CRAD_CANCELLED; }
+
+    p_scan->current_station = get_radio_station(p_crad);
+    p_scan->mute_status = QND_ReadReg(REG_PD2);
+    p_scan->more = 1;
+
+    crad_scan_begin(&p_scan->scan, p_scan->strategy, 0);
+    return CRAD_OK;
+}
 
+static int scan_step(crad_t *p_crad, void *arg) {
+    struct scan_t *p_scan = (struct scan_t *)arg;
 
-    channel_count = chCount;
-    for(current_channel=0; current_channel<channel_count; current_channel++) {
-        xml_offset += snprintf(xml_offset, 
-                sizeof(radio_stations_xml)-(xml_offset-radio_stations_xml),
-                "    <station freq=\"%3.2f\"/>\n", chList[current_channel]/100.0);
-    }
+    if(p_crad->tunes != p_scan->tunes) { return CRAD_CANCELLED; }
 
+    p_scan->more = crad_scan_step(&p_scan->scan);
+    return CRAD_OK;
+}
+
+static int scan_end(crad_t *p_crad, void *arg) {
+    struct scan_t *p_scan = (struct scan_t *)arg;
+
+    crad_scan_end(&p_scan->scan);
+
+    // Whatever tune cancelled the scan has set the tuner up already.
+    if(p_crad->tunes != p_scan->tunes) { return CRAD_CANCELLED; }
+
+    if(!p_scan->cancelled) {
+        publish_stations(p_crad, &p_scan->scan);
+
+        // The scan measured the noise floor afresh, too.
+        crad_cache_capture(&p_scan->cache);
+    }
 
-    return radio_stations_xml;
+    tune_radio(p_crad, p_scan->current_station);
+    QND_WriteReg(REG_PD2, p_scan->mute_status);
+    return p_scan->cancelled ? CRAD_CANCELLED : CRAD_OK;
 }
 
+int crad_scan_stations(crad_t *p_crad, int strategy, crad_scan_fn progress, void *context) {
+    struct scan_t scan;
+    int ret;
+
+    /*! sanity check - null ptr */
+    if(p_crad == 0) { return CRAD_INVALID_PARAM; }
+
+    /*! sanity check - strategy */
+    if(crad_scan_name(strategy) == NULL) { return CRAD_INVALID_PARAM; }
+
+    scan.tunes = p_crad->tunes;
+    scan.strategy = strategy;
+    scan.cancelled = 0;
+
+    ret = crad_execute(&p_crad->executor, CRAD_PRIORITY_BACKGROUND, scan_begin, &scan);
+    if(CRAD_FAILED(ret)) { return ret; }
+
+    while(scan.more) {
+        if(progress && progress(context, crad_scan_percent(&scan.scan), scan.scan.channels, scan.scan.count)) {
+            scan.cancelled = 1;
+            break;
+        }
+
+        // Each step is its own background command, so tunes and status
+        // reads go ahead of the rest of the scan.
+        if(CRAD_FAILED(crad_execute(&p_crad->executor, CRAD_PRIORITY_BACKGROUND, scan_step, &scan))) {
+            scan.cancelled = 1;
+            break;
+        }
+    }
+
+    if(progress && !scan.cancelled) { progress(context, 100, scan.scan.channels, scan.scan.count); }
+
+    ret = crad_execute(&p_crad->executor, CRAD_PRIORITY_BACKGROUND, scan_end, &scan);
+
+    // Off the executor, so the file write doesn't hold up the tuner.
+    if(ret == CRAD_OK && p_crad->cache_path != NULL) {
+        crad_cache_save(p_crad->cache_path, &scan.cache);
+    }
+
+    return ret;
+}
 
 int crad_refresh_station_list(crad_t *p_crad) {
-    int current_station = get_radio_station(p_crad);
-    int mute_status = QND_ReadReg(REG_PD2);
-//    QND_Init();
-//    QND_SetSysMode(QND_MODE_FM|QND_MODE_RX);
-//    QND_SetCountry(COUNTRY_USA);
-    QND_RXSeekCHAll(QND_CH_START, QND_CH_STOP, QND_CH_STEP, 0, 1);
-    tune_radio(p_crad, current_station);
-    QND_WriteReg(REG_PD2, mute_status);
-    return CRAD_OK;
+    return crad_scan_stations(p_crad, CRAD_SCAN_DEFAULT, NULL, NULL);
 }
 
 
@@ -1093,41 +1671,49 @@ int crad_set_power(crad_t *p_crad, int power) {
 
 
 int crad_set_rds(crad_t *p_crad, int rds) {
-    
+    int ret = CRAD_OK;
+
+    pthread_mutex_lock(&p_crad->rds_control_mutex);
+
     // If the user wants to turn on RDS, and we don't already have a thread
-    // running, detach one and send it on its way.
+    // running, start one.
     if(rds && !p_crad->rds_thread_running) {
 
         p_crad->rds_thread_running = 1;
-        if(pthread_mutex_init(&p_crad->rds_mutex, NULL)) {
-            perror("Unable to create RDS lock");
-            return CRAD_FAIL;
-        }
 
         // Create the thread object that'll be used to read RDS data.
         fprintf(stderr, "Creating new RDS thread\n");
         if(pthread_create(&p_crad->rds_thread, NULL, rds_reader, p_crad)) {
             perror("Unable to create RDS thread");
             p_crad->rds_thread_running = 0;
-            pthread_mutex_destroy(&p_crad->rds_mutex);
-            return CRAD_FAIL;
+            ret = CRAD_FAIL;
+        }
+        else {
+            crad_state_changed(p_crad);
         }
-        // Let pthreads know it can destroy the thread when it exits.
-        pthread_detach(p_crad->rds_thread);
     }
 
+    // The reader may be holding rds_mutex, or be part way through a
+    // command on the executor, so wait for it to see the flag and quit.
     else if(!rds && p_crad->rds_thread_running) {
         p_crad->rds_thread_running = 0;
-        pthread_mutex_destroy(&p_crad->rds_mutex);
+        pthread_join(p_crad->rds_thread, NULL);
+        crad_state_changed(p_crad);
     }
 
+    pthread_mutex_unlock(&p_crad->rds_control_mutex);
 
+    return ret;
+}
 
+static int set_country(crad_t *p_crad, void *arg) {
+    QND_SetCountry(*(int *)arg);
     return CRAD_OK;
 }
 
 int crad_set_country(crad_t *p_crad, int country) {
-    QND_SetCountry(country);
+    crad_execute(&p_crad->executor, CRAD_PRIORITY_INTERACTIVE, set_country, &country);
+    crad_state_changed(p_crad);
     return CRAD_OK;
 }
 
@@ -1136,6 +1722,10 @@ int crad_get_locked(crad_t *p_crad) {
     return p_crad->lock_locked;
 }
 
+int crad_get_initializing(crad_t *p_crad) {
+    return p_crad->initializing;
+}
+
 int crad_set_locked(crad_t *p_crad, int locked) {
     p_crad->lock_locked = locked;
     return CRAD_OK;
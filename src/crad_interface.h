@@ -12,6 +12,7 @@
 #define CRAD_INTERFACE_H
 
 #include <pthread.h>
+#include "crad_executor.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -21,6 +22,9 @@ extern "C" {
 /*! \{ */
 struct _crad_info_t;
 struct _crad_t;
+struct _crad_state_t;
+struct _crad_buffer_t;
+struct _crad_status_t;
 /*! \} */
 
 /*!
@@ -72,6 +76,113 @@ extern int crad_refresh(struct _crad_t *p_crad, char *device_path);
 
 extern int crad_get_status_xml(struct _crad_t *p_crad, char *xml_str, int max_size);
 
+/*! \name crad_read_status() reads */
+/*! \{ */
+#define CRAD_STATUS_READ_CHANNEL    0x0001  /*!< tuned frequency */
+#define CRAD_STATUS_READ_STEREO     0x0002  /*!< STATUS1 */
+#define CRAD_STATUS_READ_SIGNAL     0x0004  /*!< RSSISIG, which also gives "tuned" */
+#define CRAD_STATUS_READ_RDS        0x0008  /*!< the RDS decoder's fields */
+#define CRAD_STATUS_READ_ALL        0x000f
+/*! \} */
+
+/*! RSSI change that makes a new generation; the reading jitters by a few
+ *  units from one sample to the next */
+#define CRAD_STATUS_SIGNAL_STEP     16
+
+/*! RSSISIG above which a station counts as tuned in */
+#define CRAD_STATUS_TUNED_SIGNAL    85
+
+/*!
+
+ Read the status of Chumby Radio from the chip and the RDS decoder.  Only
+ the readings asked for are taken; the others are left zero.  The state
+ generation moves on if any of the chip readings differ from those it was
+ last taken with, and the record is tagged with the result.
+
+  @param p_crad (INP) - Chumby Radio instance
+  @param reads (INP) - CRAD_STATUS_READ_ flags, see crad_format_reads()
+  @param p_status (OUT) - status record
+  @return CRAD_OK for success, otherwise CRAD_ error code
+
+*/
+
+extern int crad_read_status(struct _crad_t *p_crad, int reads, struct _crad_status_t *p_status);
+
+/*!
+
+ Append a status record, with the list of stations found by the last scan,
+ to a buffer.  This is reentrant, and renders the document in one pass;
+ the station list is kept rendered (in each format) between rescans.
+
+  @param p_crad (INP) - Chumby Radio instance
+  @param p_status (INP) - status record, from crad_read_status()
+  @param format (INP) - CRAD_FORMAT_ format, see crad_format.h
+  @param mask (INP) - fields to show, CRAD_FIELDS_ALL for the full document
+  @param p_buffer (INP/OUT) - buffer to append to
+  @return CRAD_OK for success, otherwise CRAD_ error code
+
+*/
+
+extern int crad_write_status(struct _crad_t *p_crad, const struct _crad_status_t *p_status, int format, unsigned int mask, struct _crad_buffer_t *p_buffer);
+
+/*!
+
+ Growable buffer helpers.  A buffer that fails to grow drops everything
+ appended afterwards and remembers the failure, so a sequence of appends
+ only needs checking once at the end.
+
+*/
+
+extern void crad_buffer_init(struct _crad_buffer_t *p_buffer);
+extern void crad_buffer_free(struct _crad_buffer_t *p_buffer);
+/*! empty the buffer (and forget a failure), keeping its memory */
+extern void crad_buffer_clear(struct _crad_buffer_t *p_buffer);
+extern void crad_buffer_append(struct _crad_buffer_t *p_buffer, const char *data, int length);
+extern void crad_buffer_append_str(struct _crad_buffer_t *p_buffer, const char *str);
+/*! decimal, zero padded (after any sign) to at least width characters */
+extern void crad_buffer_append_int(struct _crad_buffer_t *p_buffer, int value, int width);
+extern void crad_buffer_append_uint(struct _crad_buffer_t *p_buffer, unsigned int value, int width);
+/*! XML attribute text; a NULL string appends nothing */
+extern void crad_buffer_append_escaped(struct _crad_buffer_t *p_buffer, const char *str);
+
+/*!
+
+ Wait for the state generation to move on from the one given.  Only changes
+ made through the interface (tuning, RDS, country, ...) end the wait early;
+ readings taken straight from the chip are noticed by crad_read_status().
+
+  @param p_crad (INP) - Chumby Radio instance
+  @param generation (INP) - last generation seen by the caller
+  @param timeout_ms (INP) - longest time to wait, in milliseconds
+  @return current state generation
+
+*/
+
+extern unsigned int crad_wait_generation(struct _crad_t *p_crad, unsigned int generation, int timeout_ms);
+
+/*!
+
+ End every crad_wait_generation() call in progress early, without changing
+ the generation.
+
+  @param p_crad (INP) - Chumby Radio instance
+
+*/
+
+extern void crad_wake_waiters(struct _crad_t *p_crad);
+
+/*!
+
+ Extract the tuner and RDS state shown to listeners from a status record,
+ so both come from the same chip readings.
+
+  @param p_status (INP) - status record, from crad_read_status()
+  @param p_state (OUT) - State snapshot
+
+*/
+
+extern void crad_status_to_state(const struct _crad_status_t *p_status, struct _crad_state_t *p_state);
+
 /*!
 
  Tune Chumby Radio to the specified station.
@@ -145,6 +256,35 @@ extern int crad_set_radio_led(struct _crad_t *p_crad, int led_value);
 */
 extern int crad_refresh_station_list(struct _crad_t *p_crad);
 
+/*!
+
+ Called before each step of a station scan, and with 100 percent once the
+ whole band has been searched.
+
+  @param context (INP) - as passed to crad_scan_stations()
+  @param percent (INP) - how much of the band has been searched
+  @param channels (INP) - stations found so far, in 10 kHz units
+  @param count (INP) - number of stations found so far
+  @return non-zero to cancel the scan
+
+*/
+typedef int (*crad_scan_fn)(void *context, int percent, const int *channels, int count);
+
+/*!
+
+ Refresh the list of tunable stations a step at a time, so that status
+ reads and tunes get the tuner between steps.  A tune or
+ seek asked for while the scan runs cancels it; the previous list is kept.
+
+  @param p_crad (INP) - Chumby Radio instance
+  @param strategy (INP) - CRAD_SCAN_ strategy and flags, see crad_scan.h
+  @param progress (INP) - called before each step, or NULL
+  @param context (INP) - passed to progress
+  @return CRAD_OK for success, CRAD_CANCELLED if cancelled, otherwise CRAD_ error code
+
+*/
+extern int crad_scan_stations(struct _crad_t *p_crad, int strategy, crad_scan_fn progress, void *context);
+
 
 
 /*!
@@ -223,6 +363,20 @@ extern int crad_set_locked(struct _crad_t *p_crad, int locked);
 extern int crad_get_locked(struct _crad_t *p_crad);
 
 
+/*!
+
+  Determines whether the chip is still being brought up.  Until it is,
+  anything that talks to the chip waits behind the bring-up.
+
+  @param p_crad (INP) - Chumby Radio instance
+  @return true while initializing, or false once the radio is ready.
+
+*/
+
+
+extern int crad_get_initializing(struct _crad_t *p_crad);
+
+
 /*! 
 
   @brief Chumby Radio instance
@@ -231,6 +385,23 @@ extern int crad_get_locked(struct _crad_t *p_crad);
 
 */
 
+/*!
+
+  @brief Chumby Radio output buffer
+
+  Grows as needed; see crad_buffer_init().
+
+*/
+
+typedef struct _crad_buffer_t
+{
+    char   *data;       /*!< contents, NUL terminated once anything is appended */
+    int     length;     /*!< bytes of content, not counting the terminator */
+    int     capacity;   /*!< bytes allocated */
+    int     failed;     /*!< set if an append could not grow the buffer */
+}
+crad_buffer_t;
+
 struct rds_data {
     char name[5];
     char radiotext[2][65];
@@ -285,11 +456,108 @@ typedef struct _crad_t
 
     pthread_t           rds_thread;
     pthread_mutex_t     rds_mutex;
+    pthread_mutex_t     rds_control_mutex;  /*!< serializes crad_set_rds() */
     int                 rds_thread_running;
     struct rds_data     rds_data;
+
+    /*! state generation, see crad_read_status() */
+    pthread_mutex_t     state_mutex;
+    pthread_cond_t      state_cond;
+    /*! bumped by crad_wake_waiters() */
+    unsigned int        wakeups;
+    unsigned int        generation;
+    /*! tuner readings the current generation was taken with */
+    int                 sampled_channel;
+    int                 sampled_status1;
+    int                 sampled_strength;
+
+    /*! rendered station list in each format, rebuilt after a rescan changes chList */
+    pthread_mutex_t     stations_mutex;
+    crad_buffer_t       stations[3];        /*!< indexed by CRAD_FORMAT_, see crad_format.h */
+    int                 stations_count;
+    int                 stations_valid;     /*!< bit per format */
+
+    /*! bumped by every tune and seek, so a scan begun before one gives up */
+    volatile unsigned int tunes;
+
+    /*! station cache written after each complete scan, or NULL, see crad_cache.h */
+    const char         *cache_path;
+    /*! 1 until a scan has run, when startup left the list as cached or empty */
+    int                 stations_stale;
+
+    /*! 1 while an async crad_create() is still bringing the chip up */
+    volatile int        initializing;
+
+    /*! the only thread that talks to the tuner once crad_create() is done */
+    crad_executor_t     executor;
 }
 crad_t;
 
+/*!
+
+  @brief Chumby Radio state snapshot
+
+  Filled in by crad_status_to_state().  The RDS fields are empty while RDS is
+  disabled or nothing has been decoded yet.
+
+*/
+
+typedef struct _crad_state_t
+{
+    int  channel;                   /*!< tuned frequency, in 10 kHz units */
+    int  stereo;                    /*!< 1 if the pilot tone is detected */
+    int  strength;                  /*!< RSSI, 0-255 */
+    int  rds;                       /*!< 1 if the RDS thread is running */
+    char program_service_name[9];
+    char radiotext[65];             /*!< 2A radiotext if sent, else 2B, trailing spaces removed */
+    int  julian_date;               /*!< RDS clock: modified Julian day (0 if none received) */
+    int  hour_code;                 /*!< RDS clock: UTC hour */
+    int  minute;                    /*!< RDS clock: UTC minute */
+    int  localtime_hours;           /*!< RDS clock: local time offset */
+    int  localtime_minutes;
+}
+crad_state_t;
+
+/*!
+
+  @brief Chumby Radio status record
+
+  Filled in by crad_read_status(), and rendered by crad_write_status()
+  through crad_status_schema.  The RDS fields are only shown while RDS is
+  enabled.
+
+*/
+
+typedef struct _crad_status_t
+{
+    unsigned int generation;
+    int  reads;                     /*!< CRAD_STATUS_READ_ flags the record was read with */
+    int  found;
+    const char *state;              /*!< "initializing" until the chip is up, then "ready" */
+    int  tuned;                     /*!< 1 if the signal is strong enough to listen to */
+    int  channel;                   /*!< tuned frequency, in 10 kHz units */
+    int  stereo;
+    int  signal;                    /*!< RSSI */
+    int  signal_max;
+    int  seek_threshold;
+    int  seek_threshold_max;
+    int  spacing;                   /*!< channel spacing, in kHz */
+    int  start;                     /*!< band edges, in 10 kHz units */
+    int  stop;
+    const char *band;
+    int  rds;                       /*!< 1 if the RDS fields below are valid */
+    char callsign[5];
+    char program_service_name[9];
+    const char *program_type_code;
+    char radiotext[2][65];
+    int  julian_date;
+    int  hour_code;
+    int  minute;
+    int  localtime_hours;
+    int  localtime_minutes;
+}
+crad_status_t;
+
 /*! 
 
   @brief Chumby Radio information
@@ -301,7 +569,18 @@ crad_t;
 
 typedef struct _crad_info_t
 {
-    int dummy; /*!< temporary placeholder */
+    /*! RF scene for the simulated QN8005: a scene file (see QNS_LoadScene()),
+     *  "" for the built-in scene, or NULL to drive the chip on /dev/i2c-0 */
+    const char *simulate;
+
+    /*! station cache to start from and keep up to date (see crad_cache.h),
+     *  or NULL to calibrate and scan at every start; must outlive the instance */
+    const char *cache;
+
+    /*! 1 to bring the chip up on the executor thread and return at once;
+     *  status reads say "initializing", without the tuner readings, and
+     *  commands queue until it's up */
+    int async;
 }
 crad_info_t;
 
@@ -330,11 +609,12 @@ crad_info_t;
 #define CRAD_OUT_OF_MEMORY          0x0004  /*!< Out of memory */
 #define CRAD_ACCESS_DENIED          0x0005  /*!< Access denied */
 #define CRAD_INVALID_CALL           0x0006  /*!< Invalid call */
+#define CRAD_CANCELLED              0x0007  /*!< Cancelled before it finished */
 /*! \} */
 
 /*! \name Chumby Radio return code lookup table, for convienence */
 /*! \{ */
-extern char *CRAD_RETURN_CODE_LOOKUP[0x07];
+extern char *CRAD_RETURN_CODE_LOOKUP[0x08];
 /*! \} */
 
 /*! \name Chumby Radio return code helper functions */
@@ -0,0 +1,324 @@
+/*
+    crad_job_manager.cpp
+
+    This file is part of chumbyradio.
+    Copyright (c) Chumby Industries, 2009
+
+    chumbyradio is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    chumbyradio is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with chumbyradio; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#include <stdio.h>
+#include "crad_job_manager.h"
+#include "crad_format.h"
+
+extern crad_t *p_crad;
+
+/*! \name Job states */
+/*! \{ */
+#define JOB_QUEUED      0
+#define JOB_RUNNING     1
+#define JOB_SUCCESS     2
+#define JOB_FAILURE     3
+#define JOB_CANCELLED   4
+/*! \} */
+
+static const char *command_names[] = { "station", "seek_up", "seek_down", "rescan" };
+static const char *state_names[] = { "queued", "running", "success", "failure", "cancelled" };
+
+ChumbRadioJobManager * ChumbRadioJobManager::instance()
+{
+    static ChumbRadioJobManager manager;
+
+    return &manager;
+}
+
+ChumbRadioJobManager::ChumbRadioJobManager()
+{
+    pthread_mutex_init(&_mutex, NULL);
+    pthread_cond_init(&_cond, NULL);
+
+    _started = 0;
+    _lastID = 0;
+}
+
+unsigned int ChumbRadioJobManager::submit(int command, double station, int strength, int strategy)
+{
+    unsigned int j;
+    Job *job;
+
+    if( (command < CRAD_JOB_TUNE) || (command > CRAD_JOB_RESCAN) ) { return 0; }
+
+    pthread_mutex_lock(&_mutex);
+
+    if(!_started)
+    {
+        pthread_t thread;
+
+        if(pthread_create(&thread, NULL, workerThread, this))
+        {
+            perror("Unable to create job thread");
+            pthread_mutex_unlock(&_mutex);
+            return 0;
+        }
+
+        pthread_detach(thread);
+        _started = 1;
+    }
+
+    /*! a scan would only tune back to where the radio was before this */
+    if(command != CRAD_JOB_RESCAN)
+    {
+        for(j=0;j<_jobs.size();j++)
+        {
+            if(_jobs[j]->command != CRAD_JOB_RESCAN) { continue; }
+
+            if(_jobs[j]->state == JOB_QUEUED) { _jobs[j]->state = JOB_CANCELLED; }
+            else if(_jobs[j]->state == JOB_RUNNING) { _jobs[j]->cancel = 1; }
+        }
+    }
+
+    job = new Job();
+
+    /*! 0 means "no job" to callers */
+    if(++_lastID == 0) { ++_lastID; }
+
+    job->id = _lastID;
+    job->command = command;
+    job->station = station;
+    job->strength = strength;
+    job->strategy = strategy;
+    job->state = JOB_QUEUED;
+    job->progress = 0;
+    job->result = 0;
+    job->cancel = 0;
+
+    _jobs.push_back(job);
+    trim();
+
+    pthread_cond_signal(&_cond);
+    pthread_mutex_unlock(&_mutex);
+
+    return job->id;
+}
+
+int ChumbRadioJobManager::cancel(unsigned int id)
+{
+    int ret = CRAD_INVALID_CALL;
+    Job *job;
+
+    pthread_mutex_lock(&_mutex);
+
+    job = find(id);
+
+    if(job == NULL)
+    {
+        ret = CRAD_INVALID_PARAM;
+    }
+    else if(job->state == JOB_QUEUED)
+    {
+        job->state = JOB_CANCELLED;
+        trim();
+        ret = CRAD_OK;
+    }
+    else if( (job->state == JOB_RUNNING) && (job->command == CRAD_JOB_RESCAN) )
+    {
+        job->cancel = 1;
+        ret = CRAD_OK;
+    }
+
+    pthread_mutex_unlock(&_mutex);
+
+    return ret;
+}
+
+int ChumbRadioJobManager::write(unsigned int id, int format, crad_buffer_t *p_buffer)
+{
+    crad_job_t record;
+    crad_station_t station;
+    unsigned int s;
+    Job *job;
+
+    pthread_mutex_lock(&_mutex);
+
+    job = find(id);
+
+    if(job == NULL)
+    {
+        pthread_mutex_unlock(&_mutex);
+        return CRAD_INVALID_PARAM;
+    }
+
+    record.id = job->id;
+    record.command = command_names[job->command];
+    record.state = state_names[job->state];
+    record.progress = job->progress;
+    record.station = job->result;
+
+    crad_format_begin(p_buffer, format, &crad_job_schema, &record, CRAD_FIELDS_ALL, job->stations.size());
+
+    for(s=0;s<job->stations.size();s++)
+    {
+        station.freq = job->stations[s];
+        crad_format_child(p_buffer, format, &crad_station_schema, &station, s);
+    }
+
+    crad_format_end(p_buffer, format, &crad_job_schema, CRAD_FIELDS_ALL);
+
+    pthread_mutex_unlock(&_mutex);
+
+    return CRAD_OK;
+}
+
+/*! call with _mutex held */
+ChumbRadioJobManager::Job * ChumbRadioJobManager::find(unsigned int id)
+{
+    unsigned int j;
+
+    for(j=0;j<_jobs.size();j++)
+    {
+        if(_jobs[j]->id == id) { return _jobs[j]; }
+    }
+
+    return NULL;
+}
+
+/*! the oldest queued job, or NULL; call with _mutex held */
+ChumbRadioJobManager::Job * ChumbRadioJobManager::next()
+{
+    unsigned int j;
+
+    for(j=0;j<_jobs.size();j++)
+    {
+        if(_jobs[j]->state == JOB_QUEUED) { return _jobs[j]; }
+    }
+
+    return NULL;
+}
+
+/*! forget the oldest finished jobs beyond CRAD_JOB_HISTORY; call with _mutex held */
+void ChumbRadioJobManager::trim()
+{
+    unsigned int finished = 0, j;
+
+    for(j=0;j<_jobs.size();j++)
+    {
+        if(_jobs[j]->state >= JOB_SUCCESS) { finished++; }
+    }
+
+    for(j=0;(j<_jobs.size()) && (finished > CRAD_JOB_HISTORY);)
+    {
+        if(_jobs[j]->state >= JOB_SUCCESS)
+        {
+            delete _jobs[j];
+            _jobs.erase(_jobs.begin() + j);
+            finished--;
+        }
+        else
+        {
+            j++;
+        }
+    }
+}
+
+void ChumbRadioJobManager::finish(Job *job, int ret)
+{
+    pthread_mutex_lock(&_mutex);
+
+    if(CRAD_SUCCESS(ret))
+    {
+        job->state = JOB_SUCCESS;
+        job->progress = 100;
+    }
+    else
+    {
+        job->state = (ret == CRAD_CANCELLED) ? JOB_CANCELLED : JOB_FAILURE;
+    }
+
+    job->result = (p_crad != NULL) ? (int)(p_crad->frequency + 0.5) : 0;
+
+    trim();
+
+    pthread_mutex_unlock(&_mutex);
+}
+
+void ChumbRadioJobManager::run(Job *job)
+{
+    int ret = CRAD_INVALID_CALL;
+
+    if(p_crad != NULL)
+    {
+        switch(job->command)
+        {
+            case CRAD_JOB_TUNE:
+                ret = crad_tune_radio(p_crad, job->station);
+                break;
+            case CRAD_JOB_SEEK_UP:
+                ret = crad_seek_radio(p_crad, CRAD_SEEK_DIR_UP, job->strength);
+                break;
+            case CRAD_JOB_SEEK_DOWN:
+                ret = crad_seek_radio(p_crad, CRAD_SEEK_DIR_DOWN, job->strength);
+                break;
+            case CRAD_JOB_RESCAN:
+                ret = crad_scan_stations(p_crad, job->strategy, scanProgress, job);
+                break;
+        }
+    }
+
+    finish(job, ret);
+}
+
+/*! crad_scan_fn for CRAD_JOB_RESCAN; context is the job */
+int ChumbRadioJobManager::scanProgress(void *context, int percent, const int *channels, int count)
+{
+    ChumbRadioJobManager *manager = instance();
+    Job *job = (Job *)context;
+    int cancel;
+
+    pthread_mutex_lock(&manager->_mutex);
+
+    job->progress = percent;
+    job->stations.assign(channels, channels + count);
+    cancel = job->cancel;
+
+    pthread_mutex_unlock(&manager->_mutex);
+
+    return cancel;
+}
+
+void *ChumbRadioJobManager::workerThread(void *arg)
+{
+    ChumbRadioJobManager *manager = (ChumbRadioJobManager *)arg;
+
+    for(;;)
+    {
+        Job *job;
+
+        pthread_mutex_lock(&manager->_mutex);
+
+        while( (job = manager->next()) == NULL )
+        {
+            pthread_cond_wait(&manager->_cond, &manager->_mutex);
+        }
+
+        job->state = JOB_RUNNING;
+
+        pthread_mutex_unlock(&manager->_mutex);
+
+        /*! a running job is never trimmed, so it can be used unlocked */
+        manager->run(job);
+    }
+
+    return NULL;
+}
@@ -0,0 +1,114 @@
+/*
+ * crad_job_manager.h
+ *
+ * (c) Copyright Chumby Industries, 2009
+ * All rights reserved
+ *
+ * This header declares the job manager, which runs tunes, seeks and
+ * station scans for clients that don't want to hold a connection open
+ * while the tuner works.  A request gets a job id back at once; the job's
+ * progress and result are served at /radio/jobs/<id> until it ages out.
+ */
+
+#ifndef CRAD_JOB_MANAGER_H
+#define CRAD_JOB_MANAGER_H
+
+#include <pthread.h>
+#include <deque>
+#include <vector>
+#include "crad_interface.h"
+#include "crad_scan.h"
+
+/*! \name Job commands */
+/*! \{ */
+#define CRAD_JOB_TUNE               0
+#define CRAD_JOB_SEEK_UP            1
+#define CRAD_JOB_SEEK_DOWN          2
+#define CRAD_JOB_RESCAN             3
+/*! \} */
+
+/*! finished jobs kept for /radio/jobs/<id> */
+#define CRAD_JOB_HISTORY            16
+
+/*!
+
+  @brief Chumby Radio job manager
+
+  Jobs run one at a time, in the order they were asked for, on a worker
+  thread of their own; the tuner work itself still goes through the
+  radio's executor.  A tune or seek cancels any scan that is queued or
+  running, since the scan would only retune the radio to where it was.
+
+*/
+class ChumbRadioJobManager
+{
+    public:
+
+        static ChumbRadioJobManager * instance();
+
+        /*!
+
+          Queue a job.
+
+          @param command (INP) - CRAD_JOB_ command
+          @param station (INP) - station in MHz, for CRAD_JOB_TUNE
+          @param strength (INP) - seek strength, for the seeks
+          @param strategy (INP) - CRAD_SCAN_ strategy, for CRAD_JOB_RESCAN
+          @return the job's id, or 0 if it could not be queued
+
+        */
+        unsigned int submit(int command, double station = 0.0, int strength = CRAD_DEFAULT_SEEK_STRENGTH, int strategy = CRAD_SCAN_DEFAULT);
+
+        /*!
+
+          Cancel a job.  A queued job never runs; a running scan stops
+          after the channel it is searching, keeping the old station list.
+          A running tune or seek can't be stopped.
+
+          @return CRAD_OK, CRAD_INVALID_PARAM if the job isn't known (or
+                  has aged out), or CRAD_INVALID_CALL if it can't be stopped
+
+        */
+        int cancel(unsigned int id);
+
+        /*! render a job through crad_job_schema; returns CRAD_INVALID_PARAM if it isn't known */
+        int write(unsigned int id, int format, crad_buffer_t *p_buffer);
+
+    private:
+
+        ChumbRadioJobManager();
+
+        struct Job
+        {
+            unsigned int        id;
+            int                 command;
+            double              station;
+            int                 strength;
+            int                 strategy;
+            int                 state;
+            int                 progress;
+            int                 result;     /*!< station tuned once finished, in 10 kHz units */
+            int                 cancel;
+            std::vector<int>    stations;   /*!< found so far, for a scan */
+        };
+
+        /*! guards everything below */
+        pthread_mutex_t _mutex;
+        pthread_cond_t _cond;
+
+        int _started;
+        unsigned int _lastID;
+        /*! queued, running and recently finished jobs, oldest first */
+        std::deque<Job *> _jobs;
+
+        Job * find(unsigned int id);
+        Job * next();
+        void trim();
+        void finish(Job *job, int ret);
+        void run(Job *job);
+
+        static int scanProgress(void *context, int percent, const int *channels, int count);
+        static void *workerThread(void *arg);
+};
+
+#endif
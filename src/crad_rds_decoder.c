@@ -438,10 +438,13 @@ void decode_callsign(unsigned int *group, char *callsign) {
 // The bits are stored (according to the spec) as:
 // [PPPPPPPPPPPPPPPP] [GGGGVTPPPPPDDDDD] [DDDDDDDDDDDDDDDD] [DDDDDDDDDDDDDDDD]
 void crad_decode_rds(struct rds_data *rds_data, char *data) {
-    int word0 = (data[1]   ) | (data[0]<<8);
-    int word1 = (data[3]   ) | (data[2]<<8);
-    int word2 = (data[5]   ) | (data[4]<<8);
-    int word3 = (data[7]   ) | (data[6]<<8);
+    // The bytes are unsigned; a plain char would sign-extend anything
+    // above 0x7f into the upper bits of the word.
+    unsigned char *bytes = (unsigned char *)data;
+    int word0 = (bytes[1]   ) | (bytes[0]<<8);
+    int word1 = (bytes[3]   ) | (bytes[2]<<8);
+    int word2 = (bytes[5]   ) | (bytes[4]<<8);
+    int word3 = (bytes[7]   ) | (bytes[6]<<8);
 
 
     int pi_code         = word0;
@@ -11,7 +11,7 @@
 
 #include "crad_interface.h"
 
-char *CRAD_RETURN_CODE_LOOKUP[0x07] =
+char *CRAD_RETURN_CODE_LOOKUP[0x08] =
 {
     "CRAD_OK",
     "CRAD_FAIL",
@@ -19,5 +19,6 @@ char *CRAD_RETURN_CODE_LOOKUP[0x07] =
     "CRAD_INVALID_PARAM",
     "CRAD_OUT_OF_MEMORY",
     "CRAD_ACCESS_DENIED",
-    "CRAD_INVALID_CALL"
+    "CRAD_INVALID_CALL",
+    "CRAD_CANCELLED"
 };
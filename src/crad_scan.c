@@ -0,0 +1,315 @@
+/*
+    crad_scan.c
+
+    This file is part of chumbyradio.
+    Copyright (c) Chumby Industries, 2009
+
+    chumbyradio is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    chumbyradio is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with chumbyradio; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include "crad_scan.h"
+#include "qnio.h"
+
+extern UINT16 QNF_GetCh(void);
+extern UINT8 QNF_SetCh(UINT16 freq);
+extern void QNF_ConfigScan(UINT16 start, UINT16 stop, UINT8 step);
+extern void QNF_GetFMRssiAvg(void);
+
+static const char *strategy_names[CRAD_SCAN_STRATEGY_COUNT] = { "seek", "coarse", "hardware" };
+
+// Polls of CHSC before a range scan is given up on, 5 ms apart.
+#define HARDWARE_POLLS 200
+
+// QND_RXSeekCH()'s noise floor for a channel, from QNF_GetFMRssiAvg().
+static int noise_floor(int channel) {
+    if(channel <= 8400) { return Rssinarray[0]; }
+    if(channel <= 9200) { return Rssinarray[1]; }
+    if(channel <= 10000) { return Rssinarray[2]; }
+    return Rssinarray[3];
+}
+
+static int channel_step(void) {
+    return steparray[QND_CH_STEP + qnd_Band * 3];
+}
+
+// QND_RXSeekCH()'s RSSI thresholds: worth a full test, and strong enough to
+// pass it without the multipath check.
+static int above_threshold(const crad_scan_t *p_scan, int channel, int rssi) {
+    return rssi > noise_floor(channel) + 6 + p_scan->db;
+}
+
+static int strong(const crad_scan_t *p_scan, int channel, int rssi) {
+    return rssi > noise_floor(channel) + 12 + p_scan->db;
+}
+
+// The full test: QND_RXSeekCH() over just this channel.
+static int test_channel(crad_scan_t *p_scan, int channel) {
+    p_scan->tests++;
+    return QND_RXSeekCH(channel, channel, QND_CH_STEP, p_scan->db, 1) == channel;
+}
+
+// Keep the list in order, whichever order the stations turn up in.
+static void add_station(crad_scan_t *p_scan, int channel, int rssi) {
+    int i;
+
+    if(p_scan->count >= QN_CCA_MAX_CH) { return; }
+
+    for(i = p_scan->count; i > 0 && p_scan->channels[i - 1] > channel; i--) {
+        p_scan->channels[i] = p_scan->channels[i - 1];
+        p_scan->rssi[i] = p_scan->rssi[i - 1];
+    }
+    p_scan->channels[i] = channel;
+    p_scan->rssi[i] = rssi;
+    p_scan->count++;
+}
+
+// A channel close to a strong station and well below it is most likely
+// the station's own sideband.
+static int beside_strong_station(const crad_scan_t *p_scan, int channel, int rssi) {
+    int i;
+
+    if(!(p_scan->strategy & CRAD_SCAN_SKIP_NEIGHBOURS)) { return 0; }
+
+    for(i = 0; i < p_scan->count; i++) {
+        if(abs(p_scan->channels[i] - channel) <= CRAD_SCAN_NEIGHBOUR_SPAN &&
+           strong(p_scan, p_scan->channels[i], p_scan->rssi[i]) &&
+           rssi + CRAD_SCAN_NEIGHBOUR_DB <= p_scan->rssi[i]) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Where an upward search carries on after finding a station.  Searching
+// up, there's no reading for the channels above yet, so skipping means
+// stepping over all of them.
+static int resume_after(const crad_scan_t *p_scan, int channel, int rssi) {
+    if((p_scan->strategy & CRAD_SCAN_SKIP_NEIGHBOURS) && strong(p_scan, channel, rssi)) {
+        return channel + CRAD_SCAN_NEIGHBOUR_SPAN + channel_step();
+    }
+    return channel + channel_step();
+}
+
+static void seek_step(crad_scan_t *p_scan) {
+    int stop = p_scan->next + CRAD_SCAN_WINDOW;
+    int channel;
+
+    if(stop > QND_CH_STOP) { stop = QND_CH_STOP; }
+
+    p_scan->tests++;
+    channel = QND_RXSeekCH(p_scan->next, stop, QND_CH_STEP, p_scan->db, 1);
+    if(channel) {
+        int rssi = QND_ReadReg(RSSISIG);
+
+        add_station(p_scan, channel, rssi);
+        p_scan->next = resume_after(p_scan, channel, rssi);
+    }
+    else {
+        p_scan->next = stop + channel_step();
+    }
+}
+
+// Sweep a window reading RSSI only, with a short settle, and note the
+// channels worth a full test.  Once the band is swept, test them strongest
+// first, so the sidebands of a strong station come after it.
+static void coarse_step(crad_scan_t *p_scan) {
+    if(p_scan->confirming < 0) {
+        int stop = p_scan->next + CRAD_SCAN_WINDOW;
+        UINT8 system1 = QND_ReadReg(SYSTEM1) | RXREQ | CCA_CH_DIS;
+        int channel;
+
+        if(stop > QND_CH_STOP) { stop = QND_CH_STOP; }
+
+        for(channel = p_scan->next; channel <= stop; channel += channel_step()) {
+            int rssi;
+
+            QND_BatchBegin();
+            QNF_SetCh(channel);
+            QND_WriteReg(SYSTEM1, system1 & ~CHSC);
+            QND_BatchEnd();
+            QND_Delay(CRAD_SCAN_COARSE_SETTLE);
+            rssi = QND_ReadReg(RSSISIG);
+
+            if(above_threshold(p_scan, channel, rssi) && p_scan->candidate_count < CRAD_SCAN_MAX_CANDIDATES) {
+                p_scan->candidates[p_scan->candidate_count] = channel;
+                p_scan->candidate_rssi[p_scan->candidate_count] = rssi;
+                p_scan->candidate_count++;
+            }
+        }
+        p_scan->next = channel;
+
+        if(p_scan->next > QND_CH_STOP) {
+            int i, j;
+
+            for(i = 1; i < p_scan->candidate_count; i++) {
+                int candidate = p_scan->candidates[i], rssi = p_scan->candidate_rssi[i];
+
+                for(j = i; j > 0 && p_scan->candidate_rssi[j - 1] < rssi; j--) {
+                    p_scan->candidates[j] = p_scan->candidates[j - 1];
+                    p_scan->candidate_rssi[j] = p_scan->candidate_rssi[j - 1];
+                }
+                p_scan->candidates[j] = candidate;
+                p_scan->candidate_rssi[j] = rssi;
+            }
+            p_scan->confirming = 0;
+        }
+        return;
+    }
+
+    // One full test per step; sidebands are passed over for free.
+    while(p_scan->confirming < p_scan->candidate_count) {
+        int channel = p_scan->candidates[p_scan->confirming];
+        int rssi = p_scan->candidate_rssi[p_scan->confirming];
+
+        p_scan->confirming++;
+
+        if(beside_strong_station(p_scan, channel, rssi)) { continue; }
+
+        if(test_channel(p_scan, channel)) { add_station(p_scan, channel, rssi); }
+        break;
+    }
+}
+
+// Let the chip search a wide span itself; it stops on the first channel
+// that passes its CCA (or at the end of the span), and that channel gets
+// the full test.
+static void hardware_step(crad_scan_t *p_scan) {
+    int stop = p_scan->next + CRAD_SCAN_HARDWARE_SPAN;
+    UINT8 system1, value;
+    int polls = 0, channel;
+
+    if(stop > QND_CH_STOP) { stop = QND_CH_STOP; }
+
+    // Set the chip up the way QND_RXSeekCH() does for its CCA.
+    QND_BatchBegin();
+    QND_WriteReg(CCOND1, QND_ReadReg(CCOND1) & 0x3f);
+    QND_WriteReg(HCCSTART, 0xb5);
+    QND_WriteReg(CCA2, 0x97);
+    QNF_ConfigScan(p_scan->next, stop, QND_CH_STEP);
+    QNM_SetRxThreshold(noise_floor(p_scan->next) - 22 + p_scan->db);
+    system1 = (QND_ReadReg(SYSTEM1) | RXREQ | CHSC) & ~CCA_CH_DIS;
+    QND_WriteReg(SYSTEM1, system1);
+    QND_BatchEnd();
+
+    do {
+        QND_Delay(5);
+        value = QND_ReadReg(SYSTEM1);
+    } while((value & CHSC) && ++polls < HARDWARE_POLLS);
+
+    QND_BatchBegin();
+    QND_WriteReg(CCA2, 0x93);
+    QND_WriteReg(CCOND1, 0x6d);
+    QND_WriteReg(SYSTEM1, (system1 & ~CHSC) | CCA_CH_DIS);
+    QND_BatchEnd();
+
+    if(value & CHSC) {
+        p_scan->next = stop + channel_step();
+        return;
+    }
+
+    channel = QNF_GetCh();
+    if(channel < p_scan->next || channel > stop) { channel = stop; }
+
+    if(test_channel(p_scan, channel)) {
+        int rssi = QND_ReadReg(RSSISIG);
+
+        add_station(p_scan, channel, rssi);
+        p_scan->next = resume_after(p_scan, channel, rssi);
+    }
+    else {
+        p_scan->next = channel + channel_step();
+    }
+}
+
+void crad_scan_begin(crad_scan_t *p_scan, int strategy, int db) {
+    memset(p_scan, 0, sizeof(*p_scan));
+    p_scan->strategy = strategy;
+    p_scan->db = db;
+    p_scan->next = QND_CH_START;
+    p_scan->confirming = -1;
+
+    // What QND_RXSeekCHAll() does before its first search.
+    autoScanAll = 1;
+    QND_WriteReg(REG_PD2, MUTE);
+    QNF_GetFMRssiAvg();
+}
+
+int crad_scan_step(crad_scan_t *p_scan) {
+    if(p_scan->count >= QN_CCA_MAX_CH) { return 0; }
+
+    switch(p_scan->strategy & CRAD_SCAN_STRATEGY_MASK) {
+        case CRAD_SCAN_COARSE:
+            coarse_step(p_scan);
+            return p_scan->confirming < p_scan->candidate_count;
+        case CRAD_SCAN_HARDWARE:
+            hardware_step(p_scan);
+            break;
+        default:
+            seek_step(p_scan);
+            break;
+    }
+    return p_scan->next <= QND_CH_STOP;
+}
+
+void crad_scan_end(crad_scan_t *p_scan) {
+    autoScanAll = 0;
+
+    // Whatever was left unsearched is given up, so the scan reads as done.
+    p_scan->next = QND_CH_STOP + 1;
+    p_scan->confirming = p_scan->candidate_count;
+}
+
+int crad_scan_percent(const crad_scan_t *p_scan) {
+    int band = QND_CH_STOP - QND_CH_START;
+    int swept = p_scan->next - QND_CH_START;
+
+    if(swept > band) { swept = band; }
+
+    // Reckon the sweep at nine tenths of a coarse scan.
+    if((p_scan->strategy & CRAD_SCAN_STRATEGY_MASK) == CRAD_SCAN_COARSE) {
+        if(p_scan->confirming < 0) { return swept * 90 / band; }
+        if(p_scan->candidate_count == 0) { return 100; }
+        return 90 + p_scan->confirming * 10 / p_scan->candidate_count;
+    }
+    return swept * 100 / band;
+}
+
+int crad_scan_lookup(const char *name) {
+    const char *plus = strchr(name, '+');
+    int length = plus ? (int)(plus - name) : (int)strlen(name);
+    int strategy;
+
+    for(strategy = 0; strategy < CRAD_SCAN_STRATEGY_COUNT; strategy++) {
+        if(length == (int)strlen(strategy_names[strategy]) && !strncmp(name, strategy_names[strategy], length)) {
+            break;
+        }
+    }
+    if(strategy == CRAD_SCAN_STRATEGY_COUNT) { return -1; }
+
+    if(plus == NULL) { return strategy; }
+    if(!strcmp(plus + 1, "skip")) { return strategy | CRAD_SCAN_SKIP_NEIGHBOURS; }
+    return -1;
+}
+
+const char *crad_scan_name(int strategy) {
+    static const char *skip_names[CRAD_SCAN_STRATEGY_COUNT] = { "seek+skip", "coarse+skip", "hardware+skip" };
+    int index = strategy & CRAD_SCAN_STRATEGY_MASK;
+
+    if(index >= CRAD_SCAN_STRATEGY_COUNT) { return NULL; }
+
+    return (strategy & CRAD_SCAN_SKIP_NEIGHBOURS) ? skip_names[index] : strategy_names[index];
+}
@@ -0,0 +1,104 @@
+/*
+ * crad_scan.h
+ *
+ * (c) Copyright Chumby Industries, 2009
+ * All rights reserved
+ *
+ * This header declares the station scan engine.  A scan is run a step at
+ * a time, each step a bounded amount of tuner work, so the caller can put
+ * other commands and cancellation checks between steps.  How the band is
+ * searched is up to the strategy; every strategy accepts a channel on the
+ * same test QND_RXSeekCH() applies, so they differ in speed, not in what
+ * counts as a station.
+ */
+
+#ifndef CRAD_SCAN_H
+#define CRAD_SCAN_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "qndriver.h"
+
+/*! \name Scan strategies */
+/*! \{ */
+#define CRAD_SCAN_SEEK              0   /*!< QND_RXSeekCH() up the band, as QND_RXSeekCHAll() does */
+#define CRAD_SCAN_COARSE            1   /*!< quick RSSI sweep, then the full test on the channels above threshold */
+#define CRAD_SCAN_HARDWARE          2   /*!< the chip's CCA range scan over wide spans, then the full test where it stops */
+#define CRAD_SCAN_STRATEGY_COUNT    3
+#define CRAD_SCAN_STRATEGY_MASK     0x00ff
+/*! \} */
+
+/*! \name Scan flags, or'ed with the strategy */
+/*! \{ */
+#define CRAD_SCAN_SKIP_NEIGHBOURS   0x0100  /*!< don't test the channels beside a strong station */
+/*! \} */
+
+/*! the strategy used unless another is asked for; the faster ones are only
+ *  checked against qnsim so far, so they stay opt-in until a run on the
+ *  real chip backs them */
+#define CRAD_SCAN_DEFAULT           CRAD_SCAN_SEEK
+
+/*! \name Scan tuning */
+/*! \{ */
+#define CRAD_SCAN_WINDOW            100     /*!< most of the band a seek or sweep step covers, in 10 kHz units */
+#define CRAD_SCAN_HARDWARE_SPAN     500     /*!< most of the band one CCA range scan covers */
+#define CRAD_SCAN_COARSE_SETTLE     2       /*!< ms from tuning to reading RSSISIG in the sweep */
+#define CRAD_SCAN_NEIGHBOUR_SPAN    20      /*!< channels this close to a strong station... */
+#define CRAD_SCAN_NEIGHBOUR_DB      10      /*!< ...and this much weaker are taken for its sidebands */
+#define CRAD_SCAN_MAX_CANDIDATES    128
+/*! \} */
+
+/*! @brief A scan in progress */
+typedef struct _crad_scan_t
+{
+    int strategy;           /*!< CRAD_SCAN_ strategy and flags */
+    int db;                 /*!< threshold above the noise floor, as for QND_RXSeekCH() */
+    int next;               /*!< where the search or sweep carries on */
+    int confirming;         /*!< coarse: next candidate to test, or -1 while sweeping */
+    int candidate_count;
+    int candidates[CRAD_SCAN_MAX_CANDIDATES];
+    int candidate_rssi[CRAD_SCAN_MAX_CANDIDATES];
+    int tests;              /*!< full tests run, for the benchmark */
+    int count;
+    int channels[QN_CCA_MAX_CH];   /*!< stations found, lowest first */
+    int rssi[QN_CCA_MAX_CH];
+}
+crad_scan_t;
+
+/*!
+
+ Start a scan of the current band.  This and the other crad_scan_
+ functions talk to the tuner, so they belong on the executor thread.
+
+  @param p_scan (OUT) - scan
+  @param strategy (INP) - CRAD_SCAN_ strategy, or'ed with CRAD_SCAN_ flags
+  @param db (INP) - threshold above the noise floor, 0 for the default
+
+*/
+
+extern void crad_scan_begin(crad_scan_t *p_scan, int strategy, int db);
+
+/*! do the next step of a scan; returns 0 once the band has been searched */
+extern int crad_scan_step(crad_scan_t *p_scan);
+
+/*! finish a scan, stopped early or not; the stations found stay in p_scan,
+ *  and crad_scan_percent() has it at 100 */
+extern void crad_scan_end(crad_scan_t *p_scan);
+
+/*! rough percentage of a scan's work done */
+extern int crad_scan_percent(const crad_scan_t *p_scan);
+
+/*! \name Strategy names, e.g. "coarse" or "hardware+skip" */
+/*! \{ */
+/*! returns CRAD_SCAN_ strategy and flags, or -1 if the name is unknown */
+extern int crad_scan_lookup(const char *name);
+extern const char *crad_scan_name(int strategy);
+/*! \} */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
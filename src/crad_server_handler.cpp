@@ -0,0 +1,55 @@
+/*
+    crad_server_handler.cpp
+
+    This file is part of chumbyradio.
+    Copyright (c) Chumby Industries, 2009
+
+    chumbyradio is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    chumbyradio is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with chumbyradio; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#include <stdio.h>
+#include "crad_server_handler.h"
+
+ChumbRadioResponse * ChumbRadioServerHandler::serve(const ChumbRadioRequest &request)
+{
+    ChumbRadioHTTPStats stats;
+    ChumbRadioResponse *response;
+    char buff[512];
+    int length;
+
+    if(!request.getPath().equals(CRAD_URI_SERVER_STATUS)) { return NULL; }
+
+    _server->getStats(stats);
+
+    length = snprintf(buff, sizeof(buff),
+        "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+        "<server>\n"
+        "  <queue depth=\"%lu\" peak=\"%lu\" limit=\"%lu\"/>\n"
+        "  <connections open=\"%lu\" limit=\"%lu\"/>\n"
+        "  <requests dispatched=\"%lu\" rejected=\"%lu\" refused=\"%lu\"/>\n"
+        "</server>\n",
+        stats.queueDepth, stats.queuePeak, stats.queueLimit,
+        stats.connections, stats.connectionLimit,
+        stats.dispatched, stats.rejected, stats.refused);
+
+    response = new ChumbRadioResponse(CRAD_HTTP_OK);
+
+    response->setMimeType("text/xml");
+    response->addHeader("Cache-Control", "no-cache");
+    response->addHeader("Pragma", "no-cache");
+    response->addContent(buff, length);
+
+    return response;
+}
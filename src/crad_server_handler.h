@@ -0,0 +1,35 @@
+/*
+ * crad_server_handler.h
+ *
+ * (c) Copyright Chumby Industries, 2009
+ * All rights reserved
+ *
+ * This header declares the handler that reports the event driven HTTP
+ * server's load counters, so queueing and load shedding can be watched
+ * on a running device.
+ */
+
+#ifndef CRAD_SERVER_HANDLER_H
+#define CRAD_SERVER_HANDLER_H
+
+#include "crad_http_handler.h"
+#include "crad_http_server.h"
+
+/*! Chumby Radio HTTP server status URI */
+#define CRAD_URI_SERVER_STATUS      "/radio/server.xml"
+
+/*! @brief Chumby Radio HTTP Server Status Handler */
+class ChumbRadioServerHandler : public ChumbRadioHandler
+{
+    public:
+
+        ChumbRadioServerHandler(ChumbRadioHTTPServer *server) : _server(server) { }
+
+        ChumbRadioResponse * serve(const ChumbRadioRequest &request);
+
+    private:
+
+        ChumbRadioHTTPServer *_server;
+};
+
+#endif
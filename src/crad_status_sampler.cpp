@@ -0,0 +1,375 @@
+/*
+    crad_status_sampler.cpp
+
+    This file is part of chumbyradio.
+    Copyright (c) Chumby Industries, 2009
+
+    chumbyradio is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    chumbyradio is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with chumbyradio; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "crad_status_sampler.h"
+#include "crad_event_source.h"
+
+extern crad_t *p_crad;
+
+/*! guards every ChumbRadioStatus reference count */
+static pthread_mutex_t ref_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+ChumbRadioStatus::ChumbRadioStatus()
+{
+    int format;
+
+    _generation = 0;
+    memset(&_record, 0, sizeof(_record));
+    memset(&_state, 0, sizeof(_state));
+
+    for(format=0;format<CRAD_FORMAT_COUNT;format++)
+    {
+        _body[format] = NULL;
+        _gzip[format] = NULL;
+    }
+
+    _refs = 1;
+}
+
+ChumbRadioStatus::~ChumbRadioStatus()
+{
+    int format;
+
+    for(format=0;format<CRAD_FORMAT_COUNT;format++)
+    {
+        if(_body[format] != NULL) { _body[format]->unref(); }
+        if(_gzip[format] != NULL) { _gzip[format]->unref(); }
+    }
+}
+
+void ChumbRadioStatus::ref()
+{
+    pthread_mutex_lock(&ref_mutex);
+    _refs++;
+    pthread_mutex_unlock(&ref_mutex);
+}
+
+void ChumbRadioStatus::unref()
+{
+    int refs;
+
+    pthread_mutex_lock(&ref_mutex);
+    refs = --_refs;
+    pthread_mutex_unlock(&ref_mutex);
+
+    if(refs == 0) { delete this; }
+}
+
+ChumbRadioStatusSampler * ChumbRadioStatusSampler::instance()
+{
+    static ChumbRadioStatusSampler sampler;
+
+    return &sampler;
+}
+
+ChumbRadioStatusSampler::ChumbRadioStatusSampler()
+{
+    pthread_mutex_init(&_mutex, NULL);
+    pthread_cond_init(&_cond, NULL);
+    pthread_cond_init(&_wake, NULL);
+
+    _started = 0;
+    _interval = CRAD_STATUS_SAMPLE_INTERVAL;
+    _holds = 0;
+    _wanted = 0;
+    _lastAccess = 0;
+    memset(_readAccess, 0, sizeof(_readAccess));
+    _sequence = 0;
+    _current = NULL;
+
+    crad_buffer_init(&_buffer);
+}
+
+/*! returns the current monotonic time, in milliseconds */
+unsigned long ChumbRadioStatusSampler::now()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (unsigned long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+void ChumbRadioStatusSampler::setInterval(int ms)
+{
+    pthread_mutex_lock(&_mutex);
+    _interval = (ms > 0) ? ms : 1;
+    pthread_mutex_unlock(&_mutex);
+}
+
+/*! clients are active while something holds the sampler, or for a while after each request */
+int ChumbRadioStatusSampler::isActive(unsigned long now) const
+{
+    return (_holds > 0) || ((_lastAccess != 0) && (now - _lastAccess < CRAD_STATUS_ACTIVE_WINDOW * 1000));
+}
+
+/*! the reads asked for by recent requests; everything while held, or when nobody is asking */
+int ChumbRadioStatusSampler::activeReads(unsigned long now) const
+{
+    int reads = 0, r;
+
+    if(_holds > 0) { return CRAD_STATUS_READ_ALL; }
+
+    for(r=0;r<4;r++)
+    {
+        if( (_readAccess[r] != 0) && (now - _readAccess[r] < CRAD_STATUS_ACTIVE_WINDOW * 1000) ) { reads |= 1 << r; }
+    }
+
+    return (reads != 0) ? reads : CRAD_STATUS_READ_ALL;
+}
+
+/*! the thread is started by the first client; call with _mutex held */
+void ChumbRadioStatusSampler::start()
+{
+    pthread_t thread;
+
+    if(_started) { return; }
+
+    if(pthread_create(&thread, NULL, samplerThread, this))
+    {
+        perror("Unable to create status sampler thread");
+        return;
+    }
+
+    pthread_detach(thread);
+    _started = 1;
+}
+
+ChumbRadioStatus * ChumbRadioStatusSampler::acquire(int reads)
+{
+    ChumbRadioStatus *status;
+    unsigned long t = now();
+    int r;
+
+    pthread_mutex_lock(&_mutex);
+
+    start();
+
+    for(r=0;r<4;r++)
+    {
+        if(reads & (1 << r)) { _readAccess[r] = t; }
+    }
+
+    /*! an idle sampler only follows changes made through the interface, so
+     *  readings straight from the chip (signal, stereo) may be stale */
+    if( (_current == NULL) || !isActive(t) || ((_current->getReads() & reads) != reads) )
+    {
+        unsigned long sequence = _sequence;
+        struct timespec deadline;
+
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += CRAD_STATUS_FRESH_WAIT / 1000;
+        deadline.tv_nsec += (CRAD_STATUS_FRESH_WAIT % 1000) * 1000000;
+        if(deadline.tv_nsec >= 1000000000)
+        {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000;
+        }
+
+        _wanted = 1;
+        _lastAccess = t;
+        pthread_cond_signal(&_wake);
+
+        pthread_mutex_unlock(&_mutex);
+        crad_wake_waiters(p_crad);
+        pthread_mutex_lock(&_mutex);
+
+        while(_sequence == sequence)
+        {
+            if(pthread_cond_timedwait(&_cond, &_mutex, &deadline)) { break; }
+        }
+    }
+
+    _lastAccess = t;
+
+    status = _current;
+    if(status != NULL) { status->ref(); }
+
+    pthread_mutex_unlock(&_mutex);
+
+    return status;
+}
+
+unsigned int ChumbRadioStatusSampler::getGeneration()
+{
+    unsigned int generation;
+
+    pthread_mutex_lock(&_mutex);
+    generation = (_current != NULL) ? _current->getGeneration() : 0;
+    pthread_mutex_unlock(&_mutex);
+
+    return generation;
+}
+
+void ChumbRadioStatusSampler::hold()
+{
+    /*! start the thread, or get it out of its idle wait; this is called
+     *  from the reactor thread, so it doesn't wait for the sample */
+    pthread_mutex_lock(&_mutex);
+    _holds++;
+    start();
+    pthread_cond_signal(&_wake);
+    pthread_mutex_unlock(&_mutex);
+}
+
+void ChumbRadioStatusSampler::release()
+{
+    pthread_mutex_lock(&_mutex);
+    _holds--;
+    pthread_mutex_unlock(&_mutex);
+}
+
+/*!
+
+  Read the chip and, if anything in the status changed, render a new
+  snapshot.  Only the sampler thread calls this.
+
+  @param last (INP) - generation the radio was last seen at
+  @return state generation at the time of the sample, or last if the
+          radio could not be read
+
+*/
+unsigned int ChumbRadioStatusSampler::sample(unsigned int last)
+{
+    ChumbRadioStatus *status = NULL;
+    crad_status_t record;
+    int reads, changed;
+
+    pthread_mutex_lock(&_mutex);
+    reads = activeReads(now());
+    pthread_mutex_unlock(&_mutex);
+
+    /*! one pass over the chip serves the generation, the state and the documents */
+    if(CRAD_FAILED(crad_read_status(p_crad, reads, &record)))
+    {
+        record.generation = last;
+        changed = 0;
+    }
+    else
+    {
+        pthread_mutex_lock(&_mutex);
+        changed = (_current == NULL) || (_current->getGeneration() != record.generation) || (_current->getReads() != reads);
+        pthread_mutex_unlock(&_mutex);
+    }
+
+    if(changed)
+    {
+        status = new ChumbRadioStatus();
+        status->_generation = record.generation;
+        status->_record = record;
+
+        /*! with only some reads taken, requests render the fields they asked for themselves */
+        if(reads == CRAD_STATUS_READ_ALL)
+        {
+            int format;
+
+            crad_status_to_state(&record, &status->_state);
+
+            /*! every format is rendered from the one reading, so they always agree */
+            for(format=0;format<CRAD_FORMAT_COUNT;format++)
+            {
+                /*! the buffer is kept between samples, so rendering doesn't allocate */
+                crad_buffer_clear(&_buffer);
+
+                if(CRAD_FAILED(crad_write_status(p_crad, &record, format, CRAD_FIELDS_ALL, &_buffer)))
+                {
+                    status->unref();
+                    status = NULL;
+                    break;
+                }
+
+                status->_body[format] = new ChumbRadioBlob(_buffer.data, _buffer.length);
+                status->_gzip[format] = ChumbRadioBlob::gzip(_buffer.data, _buffer.length, CRAD_GZIP_LEVEL_DYNAMIC);
+            }
+        }
+    }
+
+    pthread_mutex_lock(&_mutex);
+
+    if(status != NULL)
+    {
+        if(_current != NULL) { _current->unref(); }
+        _current = status;
+        _current->ref();
+    }
+
+    _sequence++;
+    pthread_cond_broadcast(&_cond);
+
+    if( (status == NULL) && (_current != NULL) )
+    {
+        status = _current;
+        status->ref();
+    }
+
+    pthread_mutex_unlock(&_mutex);
+
+    /*! event streams and parked requests follow the snapshots */
+    if(status != NULL)
+    {
+        ChumbRadioEventSource::instance()->update(status);
+        status->unref();
+    }
+
+    return record.generation;
+}
+
+void *ChumbRadioStatusSampler::samplerThread(void *arg)
+{
+    ChumbRadioStatusSampler *sampler = (ChumbRadioStatusSampler *)arg;
+    unsigned int generation = 0;
+
+    for(;;)
+    {
+        int wanted, interval;
+        unsigned int current = generation;
+
+        pthread_mutex_lock(&sampler->_mutex);
+
+        /*! with nobody asking, the chip is left alone, even when the state
+         *  changes; the next acquire() waits for a fresh sample anyway */
+        while(!sampler->_wanted && !sampler->isActive(now()))
+        {
+            pthread_cond_wait(&sampler->_wake, &sampler->_mutex);
+        }
+
+        wanted = sampler->_wanted;
+        interval = sampler->_interval;
+        pthread_mutex_unlock(&sampler->_mutex);
+
+        /*! while clients are active, changes made through the interface
+         *  (tuning, RDS, ...) wake this early */
+        if(!wanted) { current = crad_wait_generation(p_crad, generation, interval); }
+
+        pthread_mutex_lock(&sampler->_mutex);
+        sampler->_wanted = 0;
+        pthread_mutex_unlock(&sampler->_mutex);
+
+        /*! a failed read gives back current, so it isn't retried before the
+         *  next change or interval */
+        generation = sampler->sample(current);
+    }
+
+    return NULL;
+}
@@ -0,0 +1,135 @@
+/*
+ * crad_status_sampler.h
+ *
+ * (c) Copyright Chumby Industries, 2009
+ * All rights reserved
+ *
+ * This header declares the background sampler that owns the radio's status
+ * reads.  A single thread reads the chip and renders an immutable status
+ * snapshot; request handlers only ever take a reference to the latest one,
+ * so their latency no longer depends on the I2C bus.
+ */
+
+#ifndef CRAD_STATUS_SAMPLER_H
+#define CRAD_STATUS_SAMPLER_H
+
+#include <pthread.h>
+#include "crad_blob.h"
+#include "crad_interface.h"
+#include "crad_format.h"
+
+/*! \name Status sampler settings */
+/*! \{ */
+#define CRAD_STATUS_SAMPLE_INTERVAL     1000    /*!< ms between samples while clients are active */
+#define CRAD_STATUS_ACTIVE_WINDOW       10      /*!< seconds a request keeps the sampler active */
+#define CRAD_STATUS_FRESH_WAIT          2000    /*!< ms a request waits for a sample after an idle spell */
+/*! \} */
+
+/*! @brief Immutable, reference counted radio status snapshot */
+class ChumbRadioStatus
+{
+    public:
+
+        /*! state generation the snapshot was taken at */
+        unsigned int getGeneration() const { return _generation; }
+
+        /*! CRAD_STATUS_READ_ flags the snapshot was read with */
+        int getReads() const { return _record.reads; }
+
+        /*! tuner and RDS state; only complete if getReads() is CRAD_STATUS_READ_ALL */
+        const crad_state_t & getState() const { return _state; }
+
+        /*! the status record, for rendering a subset of its fields */
+        const crad_status_t & getRecord() const { return _record; }
+
+        /*! the status document in a CRAD_FORMAT_ format, or NULL unless every read was taken */
+        ChumbRadioBlob * getBody(int format) const { return _body[format]; }
+
+        /*! the document gzip compressed, or NULL if that wouldn't save enough */
+        ChumbRadioBlob * getGzip(int format) const { return _gzip[format]; }
+
+        void ref();
+        void unref();
+
+    private:
+
+        friend class ChumbRadioStatusSampler;
+
+        ChumbRadioStatus();
+        ~ChumbRadioStatus();
+
+        unsigned int    _generation;
+        crad_status_t   _record;
+        crad_state_t    _state;
+        ChumbRadioBlob *_body[CRAD_FORMAT_COUNT];
+        ChumbRadioBlob *_gzip[CRAD_FORMAT_COUNT];
+        int             _refs;
+};
+
+/*! @brief Chumby Radio status sampler */
+class ChumbRadioStatusSampler
+{
+    public:
+
+        static ChumbRadioStatusSampler * instance();
+
+        /*! ms between samples while clients are active */
+        void setInterval(int ms);
+
+        /*!
+
+          Fetch the latest snapshot.  This also marks clients as active,
+          and keeps the sampler taking the given reads for a while.  If
+          the sampler was idle (or has never run), or the snapshot lacks
+          some of the reads, this waits briefly for a fresh sample.  The
+          wait is on the sampler thread; the caller never reads the chip
+          itself.
+
+          @param reads (INP) - CRAD_STATUS_READ_ flags the caller needs
+          @return new reference to the snapshot, or NULL if the radio
+                  could not be sampled
+
+        */
+        ChumbRadioStatus * acquire(int reads = CRAD_STATUS_READ_ALL);
+
+        /*! generation of the latest snapshot, without waiting or marking activity */
+        unsigned int getGeneration();
+
+        /*! keep sampling at the full rate whether or not requests arrive (e.g.
+         *  for event streams and parked requests); never waits on a sample */
+        void hold();
+        void release();
+
+    private:
+
+        ChumbRadioStatusSampler();
+
+        /*! guards everything below */
+        pthread_mutex_t _mutex;
+        pthread_cond_t _cond;
+        /*! wakes an idle sampler thread */
+        pthread_cond_t _wake;
+
+        int _started;
+        int _interval;
+        int _holds;
+        int _wanted;
+        unsigned long _lastAccess;
+        /*! last request for each CRAD_STATUS_READ_ flag */
+        unsigned long _readAccess[4];
+        unsigned long _sequence;
+        ChumbRadioStatus *_current;
+
+        /*! status render buffer, only used by the sampler thread */
+        crad_buffer_t _buffer;
+
+        void start();
+        int isActive(unsigned long now) const;
+        int activeReads(unsigned long now) const;
+        unsigned int sample(unsigned int last);
+
+        static unsigned long now();
+        static void *samplerThread(void *arg);
+};
+
+#endif
@@ -0,0 +1,188 @@
+/*
+    crad_timer_wheel.cpp
+
+    This file is part of chumbyradio.
+    Copyright (c) Chumby Industries, 2009
+
+    chumbyradio is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    chumbyradio is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with chumbyradio; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#include "crad_timer_wheel.h"
+
+#define MASK0   (CRAD_TIMER_WHEEL_SLOTS0 - 1)
+#define MASK1   (CRAD_TIMER_WHEEL_SLOTS1 - 1)
+
+ChumbRadioTimerWheel::ChumbRadioTimerWheel(unsigned long now)
+{
+    int s;
+
+    _tick = now;
+    _count = 0;
+
+    for(s=0;s<CRAD_TIMER_WHEEL_SLOTS0;s++) { initList(&_level0[s]); }
+    for(s=0;s<CRAD_TIMER_WHEEL_SLOTS1;s++) { initList(&_level1[s]); }
+
+    initList(&_expired);
+}
+
+void ChumbRadioTimerWheel::schedule(ChumbRadioTimer *timer, unsigned long ticks)
+{
+    if(timer->isPending()) { unlink(timer); _count--; }
+
+    if(ticks > CRAD_TIMER_WHEEL_MAX_TICKS) { ticks = CRAD_TIMER_WHEEL_MAX_TICKS; }
+
+    timer->expires = _tick + ticks;
+
+    insert(timer);
+    _count++;
+}
+
+void ChumbRadioTimerWheel::cancel(ChumbRadioTimer *timer)
+{
+    if(timer->isPending())
+    {
+        unlink(timer);
+        _count--;
+    }
+}
+
+ChumbRadioTimer * ChumbRadioTimerWheel::expire(unsigned long now)
+{
+    ChumbRadioTimer *timer;
+
+    /*! run ticks until something fires; an empty wheel just catches up */
+    while( isEmpty(&_expired) && ((long)(now - _tick) >= 0) )
+    {
+        if(_count == 0)
+        {
+            _tick = now + 1;
+            break;
+        }
+
+        runTick();
+    }
+
+    if(isEmpty(&_expired)) { return NULL; }
+
+    timer = _expired.next;
+    unlink(timer);
+    _count--;
+
+    return timer;
+}
+
+long ChumbRadioTimerWheel::getTimeout(unsigned long now) const
+{
+    unsigned long t, boundary;
+
+    if(_count == 0) { return -1; }
+
+    if(!isEmpty(&_expired)) { return 0; }
+
+    /*! level 1 timers expire no sooner than the next lap, so only the
+     *  level 0 slots up to it need to be looked at */
+    boundary = (_tick | MASK0) + 1;
+
+    for(t=_tick;t!=boundary;t++)
+    {
+        if(!isEmpty(&_level0[t & MASK0])) { break; }
+    }
+
+    return ((long)(t - now) > 0) ? (long)(t - now) : 0;
+}
+
+/*! file a timer under the slot for its expiry tick */
+void ChumbRadioTimerWheel::insert(ChumbRadioTimer *timer)
+{
+    unsigned long delta = timer->expires - _tick;
+
+    if(delta < CRAD_TIMER_WHEEL_SLOTS0)
+    {
+        linkTail(&_level0[timer->expires & MASK0], timer);
+    }
+    else
+    {
+        linkTail(&_level1[(timer->expires >> CRAD_TIMER_WHEEL_BITS0) & MASK1], timer);
+    }
+}
+
+/*! fire the current tick's slot, cascading level 1 as level 0 starts each lap */
+void ChumbRadioTimerWheel::runTick()
+{
+    ChumbRadioTimer *slot = &_level0[_tick & MASK0];
+
+    /*! append the whole slot to the expired list */
+    if(!isEmpty(slot))
+    {
+        slot->next->prev = _expired.prev;
+        _expired.prev->next = slot->next;
+        slot->prev->next = &_expired;
+        _expired.prev = slot->prev;
+
+        initList(slot);
+    }
+
+    _tick++;
+
+    /*! pull the coming lap's timers down into level 0 straight away, so
+     *  level 0 always holds everything due before the next lap */
+    if((_tick & MASK0) == 0)
+    {
+        ChumbRadioTimer cascade, *timer;
+
+        slot = &_level1[(_tick >> CRAD_TIMER_WHEEL_BITS0) & MASK1];
+
+        /*! detach the slot first, as a timer a full lap away lands back in it */
+        initList(&cascade);
+
+        if(!isEmpty(slot))
+        {
+            cascade.next = slot->next;
+            cascade.prev = slot->prev;
+            cascade.next->prev = &cascade;
+            cascade.prev->next = &cascade;
+            initList(slot);
+        }
+
+        while(!isEmpty(&cascade))
+        {
+            timer = cascade.next;
+            unlink(timer);
+            insert(timer);
+        }
+    }
+}
+
+void ChumbRadioTimerWheel::initList(ChumbRadioTimer *head)
+{
+    head->next = head;
+    head->prev = head;
+}
+
+void ChumbRadioTimerWheel::linkTail(ChumbRadioTimer *head, ChumbRadioTimer *timer)
+{
+    timer->prev = head->prev;
+    timer->next = head;
+    head->prev->next = timer;
+    head->prev = timer;
+}
+
+void ChumbRadioTimerWheel::unlink(ChumbRadioTimer *timer)
+{
+    timer->prev->next = timer->next;
+    timer->next->prev = timer->prev;
+    timer->next = NULL;
+    timer->prev = NULL;
+}
@@ -0,0 +1,97 @@
+/*
+ * crad_timer_wheel.h
+ *
+ * (c) Copyright Chumby Industries, 2009
+ * All rights reserved
+ *
+ * This header declares a two level hierarchical timer wheel.  Timers are
+ * intrusive list nodes, so scheduling, cancelling and expiring one are
+ * constant time no matter how many are pending.  Time is measured in
+ * ticks, whose length is up to the owner of the wheel.
+ */
+
+#ifndef CRAD_TIMER_WHEEL_H
+#define CRAD_TIMER_WHEEL_H
+
+#include <stddef.h>
+
+/*! \name Timer wheel geometry */
+/*! \{ */
+#define CRAD_TIMER_WHEEL_BITS0      8   /*!< level 0 holds the next 256 ticks, one tick per slot */
+#define CRAD_TIMER_WHEEL_BITS1      6   /*!< level 1 holds the next 64 x 256 ticks */
+#define CRAD_TIMER_WHEEL_SLOTS0     (1 << CRAD_TIMER_WHEEL_BITS0)
+#define CRAD_TIMER_WHEEL_SLOTS1     (1 << CRAD_TIMER_WHEEL_BITS1)
+#define CRAD_TIMER_WHEEL_MAX_TICKS  (CRAD_TIMER_WHEEL_SLOTS0 * CRAD_TIMER_WHEEL_SLOTS1 - 1)
+/*! \} */
+
+/*! @brief timer, embedded in whatever it times out */
+struct ChumbRadioTimer
+{
+    ChumbRadioTimer    *next;       /*!< NULL while not scheduled */
+    ChumbRadioTimer    *prev;
+    unsigned long       expires;    /*!< tick at which the timer fires */
+    void               *owner;      /*!< returned to the caller on expiry */
+
+    ChumbRadioTimer() : next(NULL), prev(NULL), expires(0), owner(NULL) { }
+
+    int isPending() const { return next != NULL; }
+};
+
+/*! @brief Chumby Radio hierarchical timer wheel */
+class ChumbRadioTimerWheel
+{
+    public:
+
+        /*! @param now (INP) - current tick */
+        ChumbRadioTimerWheel(unsigned long now);
+
+        /*!
+
+          Schedule a timer, replacing any earlier schedule.  Delays beyond
+          the reach of the wheel are clamped to CRAD_TIMER_WHEEL_MAX_TICKS.
+
+          @param timer (INP) - timer to (re)schedule
+          @param ticks (INP) - delay from the wheel's current tick
+
+        */
+        void schedule(ChumbRadioTimer *timer, unsigned long ticks);
+
+        /*! stop a timer; harmless if it is not scheduled */
+        void cancel(ChumbRadioTimer *timer);
+
+        /*!
+
+          Advance the wheel to now and return one timer that has fired,
+          unscheduled, or NULL once there are none left.  Call repeatedly;
+          timers may be scheduled or cancelled between calls.
+
+        */
+        ChumbRadioTimer * expire(unsigned long now);
+
+        /*! ticks from now until expire() may return something, or -1 if no timers are scheduled */
+        long getTimeout(unsigned long now) const;
+
+        /*! the wheel's current tick */
+        unsigned long getTick() const { return _tick; }
+
+    private:
+
+        /*! next tick to run; every timer scheduled here expires at or after it */
+        unsigned long _tick;
+        unsigned long _count;
+
+        /*! list heads; each slot is a circular list through its sentinel */
+        ChumbRadioTimer _level0[CRAD_TIMER_WHEEL_SLOTS0];
+        ChumbRadioTimer _level1[CRAD_TIMER_WHEEL_SLOTS1];
+        ChumbRadioTimer _expired;
+
+        void insert(ChumbRadioTimer *timer);
+        void runTick();
+
+        static void initList(ChumbRadioTimer *head);
+        static void linkTail(ChumbRadioTimer *head, ChumbRadioTimer *timer);
+        static void unlink(ChumbRadioTimer *timer);
+        static int isEmpty(const ChumbRadioTimer *head) { return head->next == head; }
+};
+
+#endif
@@ -1,8 +1,14 @@
 #include "qndriver.h"
 #include <stdio.h>
+#include <string.h>
 
 extern UINT8 QND_ReadReg(UINT8 adr);
 extern UINT8 QND_WriteReg(UINT8 adr, UINT8 value);
+extern void  QND_BatchBegin(void);
+extern void  QND_BatchEnd(void);
+extern void  QND_FlushRegs(void);
+extern UINT8 QND_ReadRegs(UINT8 adr, UINT8 *buf, UINT8 n);
+extern void  QND_Sleep(UINT32 usec);
 
 #define RSSINTHRESHOLD 4
 UINT8  clearscanflag = 0;
@@ -94,6 +100,7 @@ UINT8 QNF_SetCh(UINT16 freq)
 	UINT8 tCh;
     UINT16 f; 
 		f = FREQ2CHREG(freq); 
+		QND_BatchBegin();
 		// set to reg: CH
 		tCh = (UINT8) f;
 		QND_WriteReg(CH, tCh);
@@ -102,6 +109,7 @@ UINT8 QNF_SetCh(UINT16 freq)
 		tStep &= ~CH_CH;
 		tStep |= ((UINT8) (f >> 8) & CH_CH);
 		QND_WriteReg(CH_STEP, tStep);
+		QND_BatchEnd();
 
     return 1;
 }
@@ -134,6 +142,7 @@ void QNF_ConfigScan(UINT16 start,UINT16 stop, UINT8 step)
 	UINT16 fStop;
 		fStart = FREQ2CHREG(start);
 		fStop = FREQ2CHREG(stop);
+	QND_BatchBegin();
 		// set to reg: CH_START
 	tS = (UINT8) fStart;
 	QND_WriteReg(CH_START, tS);
@@ -145,6 +154,7 @@ void QNF_ConfigScan(UINT16 start,UINT16 stop, UINT8 step)
 	// set to reg: CH_STEP
 	tStep |= step << 6;
 	QND_WriteReg(CH_STEP, tStep);
+	QND_BatchEnd();
 }
 
 /**********************************************************************
@@ -177,6 +187,35 @@ void QNF_SetAudioMono(UINT8 modemask, UINT8 mode)
 	QNF_SetRegBit(SYSTEM2,modemask, mode);
 }
 
+/**********************************************************************
+void QNF_SetFMRssi()
+**********************************************************************
+Description: set the seek thresholds from RSSIn, as measured by
+             QNF_GetFMRssiAvg() or restored from an earlier measurement
+Parameters:
+		None
+Return Value:
+        None
+**********************************************************************/
+void QNF_SetFMRssi() 
+{
+	if (RSSIn >= 32)
+		QNF_SetRegBit(SMSTART, 0x3f, 63);
+	else
+		QNF_SetRegBit(SMSTART, 0x3f, (RSSIn+31)); /*16->31,required by Qifa for glitch 08/05/22*/	
+
+	if (RSSIn > 77) /*required by Qifa for make sure RSSIn + 50 no more  than 127*/
+		QNF_SetRegBit(SNCSTART, 0x7f, 0x7f);
+	else
+		QNF_SetRegBit(SNCSTART, 0x7f, (RSSIn+50));
+
+	if (RSSIn > 44) /*required by Qifa for make sure RSSIn + 19 no more  than 63*/
+		QNF_SetRegBit(HCCSTART, 0xbf, 0xbf);
+	else
+		QNF_SetRegBit(HCCSTART, 0xbf, ((RSSIn+19)|0x80));
+
+}
+
 /**********************************************************************
 void QNF_GetFMRssiAvg()
 **********************************************************************
@@ -222,21 +261,7 @@ void  QNF_GetFMRssiAvg()
 			clearchannel = ch;
 		}
 	}
-	if (RSSIn >= 32)
-		QNF_SetRegBit(SMSTART, 0x3f, 63);
-	else
-		QNF_SetRegBit(SMSTART, 0x3f, (RSSIn+31)); /*16->31,required by Qifa for glitch 08/05/22*/	
-
-	if (RSSIn > 77) /*required by Qifa for make sure RSSIn + 50 no more  than 127*/
-		QNF_SetRegBit(SNCSTART, 0x7f, 0x7f);
-	else
-		QNF_SetRegBit(SNCSTART, 0x7f, (RSSIn+50));
-
-	if (RSSIn > 44) /*required by Qifa for make sure RSSIn + 19 no more  than 63*/
-		QNF_SetRegBit(HCCSTART, 0xbf, 0xbf);
-	else
-		QNF_SetRegBit(HCCSTART, 0xbf, ((RSSIn+19)|0x80));
-
+	QNF_SetFMRssi();
 }
 
 /**********************************************************************
@@ -296,7 +321,9 @@ Return Value:
 **********************************************************************/
 void QND_Delay(UINT16 ms) 
 {
-    usleep(ms*1000);
+    // whatever we're waiting on has to have been written first
+    QND_FlushRegs();
+    QND_Sleep((UINT32)ms*1000);
     /*
 	UINT16 i,k;
     for(i=0; i<3000;i++) 
@@ -335,6 +362,7 @@ UINT8 QND_GetRSSI(UINT16 ch)
 
 void QN_ChipInitialization()
 {
+	QND_BatchBegin();
 	QND_Delay(200);
 	QND_WriteReg(0x01,0x89); //reset
     QND_WriteReg(ANACTL1, 0x29);
@@ -362,6 +390,7 @@ void QN_ChipInitialization()
 	QND_Delay(100);           //wait more than 100ms
 	QND_WriteReg(0x00,0x01);
 	QND_WriteReg(0x52,0x00);
+	QND_BatchEnd();
 }
 
 /**********************************************************************
@@ -397,6 +426,41 @@ UINT8 QND_Init()
     return 1;
 }
 
+/**********************************************************************
+int QND_InitCalibrated()
+**********************************************************************
+Description: Initialize the device as QND_Init() does, but take the noise
+             floor from an earlier QNF_GetFMRssiAvg() instead of waiting
+             for the chip to settle and measuring it again.
+
+Parameters:
+rssinarray: Rssinarray[] as it was measured
+rssin:      RSSIn as it was measured
+clearch:    the quietest channel, as it was measured
+Return Value:
+1: Device is ready to use.
+0: Device is not ready to serve function.
+**********************************************************************/
+UINT8 QND_InitCalibrated(const UINT8 *rssinarray, UINT8 rssin, UINT16 clearch) 
+{
+	QN_ChipInitialization();
+    QND_WriteReg(REG_PD2,  MUTE); //mute to avoid noise
+	QND_WriteReg(HYSTERSIS, 0xff);	
+	QND_WriteReg(MPSTART, 0x12);
+
+	QNF_SetRegBit(GAIN_SEL, 0x38, 0x28);
+
+	memcpy(Rssinarray, rssinarray, sizeof(Rssinarray));
+	RSSIn = rssin;
+	clearchannel = clearch;
+	QNF_SetFMRssi();
+
+	QND_WriteReg(REG_PD2,  UNMUTE); //unmute
+	QND_WriteReg(0x00,  0x01); //resume original status of chip
+	qnd_Band = BAND_FM;
+    return 1;
+}
+
 /**********************************************************************
 void QND_SetSysMode(UINT16 mode)
 ***********************************************************************
@@ -460,6 +524,7 @@ void QND_TuneToCH(UINT16 ch)
 {
 	UINT8 rssi;
 	UINT8 minrssi;
+	QND_BatchBegin();
 	if ((ch - 7710) % 240 == 0) 
 	{
 		QNF_SetRegBit(TXAGC_GAIN, IMR, IMR);
@@ -507,6 +572,7 @@ void QND_TuneToCH(UINT16 ch)
 		}
 
 	}
+	QND_BatchEnd();
 
 }
 
@@ -611,6 +677,7 @@ UINT16 QND_RXSeekCH(UINT16 start, UINT16 stop, UINT8 step, UINT8 db, UINT8 up)
     UINT8 r13;
     UINT8 r56;
 	UINT8 minrssi;
+    QND_BatchBegin();
     r13 = QND_ReadReg(TXAGC_GAIN);
     r56 = QND_ReadReg(CCOND1);
 	if (autoScanAll == 0)
@@ -732,6 +799,7 @@ UINT16 QND_RXSeekCH(UINT16 start, UINT16 stop, UINT8 step, UINT8 db, UINT8 up)
 	{
 		QND_WriteReg(REG_PD2,  UNMUTE); //unmute
 	}
+    QND_BatchEnd();
     //QND_LOGB("Finished AutoScan", c);
     //QND_LOG("=== Done QND_AutoScan_FMChannel_One ===");
     return c;  
@@ -940,7 +1008,6 @@ UINT8 QND_RDSDetectSignal(void)
 void QND_RDSLoadData(UINT8 *rdsRawData, UINT8 upload)
 {
 	UINT8 i;
-	UINT8 temp;
     if (upload) 
 	{	   //TX MODE
         for (i = 0; i <= 7; i++) 
@@ -950,12 +1017,9 @@ void QND_RDSLoadData(UINT8 *rdsRawData, UINT8 upload)
     } 
 	else 
 	{
-		//RX MODE
-        for (i = 0; i <= 7; i++) 
-		{
-            temp = QND_ReadReg(RDSD0 + i);
-            rdsRawData[i] = temp;
-        }
+		//RX MODE: one auto-increment read of RDSD0..RDSD7
+        if (!QND_ReadRegs(RDSD0, rdsRawData, 8))
+            memset(rdsRawData, 0, 8);
     }
 }
 
@@ -370,6 +370,7 @@ Driver API Macro Definition
 
 extern UINT8  S_XDATA  RSSIn;
 extern UINT8  S_XDATA  Rssinarray[4];
+extern UINT16 clearchannel;
 extern UINT8  S_XDATA  qnd_Country;
 extern UINT16 S_XDATA  QND_CH_START;
 extern UINT16 S_XDATA  QND_CH_STOP;
@@ -382,6 +383,7 @@ extern UINT8  S_XDATA  qnd_Band;
 extern void QND_Delay(UINT16 ms) ;
 extern UINT8 QND_GetRSSI(UINT16 ch) ;
 extern UINT8 QND_Init() ;
+extern UINT8 QND_InitCalibrated(const UINT8 *rssinarray, UINT8 rssin, UINT16 clearch) ;
 extern void  QND_TuneToCH(UINT16 ch) ;
 extern void  QND_SetSysMode(UINT16 mode) ;
 extern void  QND_SetCountry(UINT8 country) ;
@@ -5,6 +5,9 @@
 #include <string.h>
 #include <unistd.h>
 #include <sys/ioctl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
 
 
 #include "qndriver.h"
@@ -15,6 +18,7 @@
 
 UINT8 qnd_i2c;
 UINT8 qnd_i2c_timeout = 0;
+UINT32 qnd_i2c_transfers = 0;
 
 /*****************************************************************************************************
 ** Name:      Msdelay()
@@ -35,23 +39,27 @@ extern int i2c_file;
 #define I2C_FILE_NAME "/dev/i2c-0"
 
 
+// Read consecutive registers in one transfer: write the first register's
+// address, then a repeated start and a read the chip auto-increments over.
 static int I2C_Read_nbyte(unsigned char address, unsigned char reg,
                           unsigned char *inbuf, int length) {
 
-    unsigned char inoutbuf[length+1];
     struct i2c_rdwr_ioctl_data packets;
-    struct i2c_msg messages[1];
+    struct i2c_msg messages[2];
     qnd_i2c_timeout = 0;
 
-    inoutbuf[0] = reg;
-
-    messages[0].addr    = address|1;
+    messages[0].addr    = address;
     messages[0].flags   = 0;
-    messages[0].len     = sizeof(inoutbuf);
-    messages[0].buf     = inoutbuf;
+    messages[0].len     = 1;
+    messages[0].buf     = &reg;
+
+    messages[1].addr    = address;
+    messages[1].flags   = I2C_M_RD;
+    messages[1].len     = length;
+    messages[1].buf     = inbuf;
 
     packets.msgs = messages;
-    packets.nmsgs = 1;
+    packets.nmsgs = 2;
 
     if(!i2c_file)
         i2c_file = open(I2C_FILE_NAME, O_RDWR);
@@ -62,7 +70,6 @@ static int I2C_Read_nbyte(unsigned char address, unsigned char reg,
         return 0;
     }
 
-    memcpy(inbuf, inoutbuf+1, length);
     return 1;
 }
 
@@ -110,7 +117,8 @@ static int I2C_Write_nbyte(unsigned char address, unsigned char reg,
     if (ioctl(i2c_file, I2C_SLAVE, address) < 0) {
         /* ERROR HANDLING; you can check errno to see what went wrong */
         perror("Unable to assign slave address");
-        return 1;
+        qnd_i2c_timeout = 1;
+        return 0;
     }
 
     // Write to register 0x07, the MODE register.
@@ -124,30 +132,399 @@ static int I2C_Write_nbyte(unsigned char address, unsigned char reg,
     return 1;
 }
 
-static int I2C_Write_1byte(unsigned char address, unsigned char reg,
-                           unsigned char data) {
-    return I2C_Write_nbyte(address, reg, &data, 1);
+/* i2c-dev bus backend, the chumby's QN8005 on /dev/i2c-0 */
+static UINT8 I2C_Dev_Read(UINT8 reg, UINT8 *buf, UINT8 n)
+{
+    if (n == 1) {
+        buf[0] = I2C_Read_1byte(I2C_DEV0_ADDRESS, reg);
+        return !qnd_i2c_timeout;
+    }
+    return I2C_Read_nbyte(I2C_DEV0_ADDRESS, reg, buf, n);
 }
 
+static UINT8 I2C_Dev_Write(UINT8 reg, UINT8 *buf, UINT8 n)
+{
+    return I2C_Write_nbyte(I2C_DEV0_ADDRESS, reg, buf, n);
+}
+
+const qnd_bus_t qnd_i2c_dev_bus = { "i2c-dev", I2C_Dev_Read, I2C_Dev_Write, 1 };
+
+static const qnd_bus_t *qnd_bus = &qnd_i2c_dev_bus;
+
  
 
 
-UINT8 QND_WriteReg(UINT8 Regis_Addr,UINT8 Data)
+/*****************************************************************************************************
+** Register shadow
+**
+** A copy of the QN8005 register file, so read-modify-writes of configuration
+** registers don't go to the bus.  Registers the chip changes by itself are
+** always read, and SYSTEM1/SYSTEM2 are only kept while none of their self
+** clearing command bits are set.  Between QND_BatchBegin() and
+** QND_BatchEnd(), writes to ascending registers are queued and sent as one
+** auto-increment burst; a short gap between them is filled from the shadow.  A read from the bus,
+** QND_Delay() or the end of the outermost batch sends the queue.
+*****************************************************************************************************/
+
+#define SHADOW_VALID    0x01
+#define SHADOW_VOLATILE 0x02
+
+static pthread_mutex_t qnd_shadow_mutex = PTHREAD_MUTEX_INITIALIZER;
+static UINT8 qnd_shadow[QND_REG_COUNT];
+static UINT8 qnd_shadow_flags[QND_REG_COUNT];
+static UINT8 qnd_shadow_ready = 0;
+static int   qnd_batch_depth = 0;
+
+/* queued burst: registers pending_start .. pending_start+pending_len-1 */
+static UINT8 qnd_pending[QND_BURST_MAX];
+static UINT8 qnd_pending_written[QND_BURST_MAX];
+static UINT8 qnd_pending_start;
+static UINT8 qnd_pending_len = 0;
+
+static void QNF_ShadowSetup(void)
+{
+    static const UINT8 volatile_regs[] = {
+        RDSD0, RDSD1, RDSD2, RDSD3, RDSD4, RDSD5, RDSD6, RDSD7,
+        STATUS1, STATUS3, RSSISIG,
+        RSSIMP, CCA4, CCA5,         /* multipath and IF count, read during seeks */
+    };
+    UINT8 i;
+
+    memset(qnd_shadow_flags, 0, sizeof(qnd_shadow_flags));
+    for (i = 0; i < sizeof(volatile_regs); i++)
+        qnd_shadow_flags[volatile_regs[i]] = SHADOW_VOLATILE;
+
+    qnd_shadow_ready = 1;
+}
+
+/* command bits the chip clears when it is done */
+static UINT8 QNF_SelfClearing(UINT8 reg)
+{
+    switch (reg) {
+    case SYSTEM1: return CHSC;
+    case SYSTEM2: return SWRST | RECAL;
+    }
+    return 0;
+}
+
+/* returns 1 if a register holding value may be served from the shadow */
+static int QNF_Cacheable(UINT8 reg, UINT8 value)
+{
+    return reg < QND_REG_COUNT && !(qnd_shadow_flags[reg] & SHADOW_VOLATILE) && !(value & QNF_SelfClearing(reg));
+}
+
+static int QNF_ShadowCached(UINT8 reg)
+{
+    return reg < QND_REG_COUNT && qnd_shadow_flags[reg] == SHADOW_VALID;
+}
+
+static void QNF_ShadowInvalidate(UINT8 reg)
 {
+    if (reg < QND_REG_COUNT)
+        qnd_shadow_flags[reg] &= ~SHADOW_VALID;
+}
+
+/* the chip changes registers behind our back when reset or scanning */
+static void QNF_ShadowNoteWrite(UINT8 reg, UINT8 data)
+{
+    UINT8 i;
+
+    if (reg == SYSTEM2 && (data & (SWRST | RECAL))) {
+        for (i = 0; i < QND_REG_COUNT; i++)
+            QNF_ShadowInvalidate(i);
+    }
+    else if (reg == SYSTEM1 && (data & CHSC) && !(data & CCA_CH_DIS)) {
+        QNF_ShadowInvalidate(CH);
+        QNF_ShadowInvalidate(CH_STEP);
+    }
+}
+
+/* send the queued burst; called with qnd_shadow_mutex held */
+static void QNF_FlushLocked(void)
+{
+    UINT8 ok, i;
+
+    if (!qnd_pending_len)
+        return;
+
+    if (qnd_pending_len == 1)
+        ok = QND_I2C_WRITE(qnd_pending_start, qnd_pending[0]);
+    else
+        ok = QND_I2C_NWRITE(qnd_pending_start, qnd_pending, qnd_pending_len);
+
+    if (!ok) {
+        for (i = 0; i < qnd_pending_len; i++)
+            QNF_ShadowInvalidate(qnd_pending_start + i);
+    }
+
+    qnd_pending_len = 0;
+}
+
+/* try to add a write to the queued burst */
+static int QNF_QueueLocked(UINT8 reg, UINT8 data)
+{
+    UINT8 end = qnd_pending_start + qnd_pending_len;
+    UINT8 i;
+
+    if (!qnd_pending_len) {
+        qnd_pending_start = reg;
+        qnd_pending[0] = data;
+        qnd_pending_written[0] = 1;
+        qnd_pending_len = 1;
+        return 1;
+    }
 
+    /* a gap filled from the shadow may be overwritten; a second write to
+       a register is kept as a separate write, as it may be a strobe */
+    if (reg >= qnd_pending_start && reg < end) {
+        i = reg - qnd_pending_start;
+        if (qnd_pending_written[i])
+            return 0;
+        qnd_pending[i] = data;
+        qnd_pending_written[i] = 1;
+        return 1;
+    }
+
+    if (reg < end || reg - end > QND_BURST_GAP || reg - qnd_pending_start >= QND_BURST_MAX)
+        return 0;
+
+    for (i = end; i < reg; i++) {
+        if (!QNF_ShadowCached(i))
+            return 0;
+    }
 
-	return QND_I2C_WRITE(Regis_Addr,Data);
+    for (i = end; i < reg; i++) {
+        qnd_pending[i - qnd_pending_start] = qnd_shadow[i];
+        qnd_pending_written[i - qnd_pending_start] = 0;
+    }
+    qnd_pending[reg - qnd_pending_start] = data;
+    qnd_pending_written[reg - qnd_pending_start] = 1;
+    qnd_pending_len = reg - qnd_pending_start + 1;
 
     return 1;
 }
 
+void QND_BatchBegin(void)
+{
+    pthread_mutex_lock(&qnd_shadow_mutex);
+    qnd_batch_depth++;
+    pthread_mutex_unlock(&qnd_shadow_mutex);
+}
+
+void QND_BatchEnd(void)
+{
+    pthread_mutex_lock(&qnd_shadow_mutex);
+    if (--qnd_batch_depth == 0)
+        QNF_FlushLocked();
+    pthread_mutex_unlock(&qnd_shadow_mutex);
+}
+
+void QND_FlushRegs(void)
+{
+    pthread_mutex_lock(&qnd_shadow_mutex);
+    QNF_FlushLocked();
+    pthread_mutex_unlock(&qnd_shadow_mutex);
+}
+
+void QND_SetBus(const qnd_bus_t *bus)
+{
+    UINT8 i;
+
+    pthread_mutex_lock(&qnd_shadow_mutex);
+    QNF_FlushLocked();
+    for (i = 0; i < QND_REG_COUNT; i++)
+        QNF_ShadowInvalidate(i);
+    qnd_bus = bus;
+    pthread_mutex_unlock(&qnd_shadow_mutex);
+}
+
+const qnd_bus_t *QND_GetBus(void)
+{
+    return qnd_bus;
+}
+
+/*
+** Clocks.  The real one is the system's; the virtual one is a counter that
+** QND_Sleep() and QND_Advance() move forward, so a simulated chip can run
+** init, seeks and full-band scans without waiting through their delays.
+*/
+
+static void QNF_RealNow(struct timespec *ts)
+{
+    clock_gettime(CLOCK_MONOTONIC, ts);
+}
+
+static void QNF_RealSleep(UINT32 usec)
+{
+    usleep(usec);
+}
+
+const qnd_clock_t qnd_real_clock = { "real", QNF_RealNow, QNF_RealSleep, NULL };
+
+static pthread_mutex_t qnd_virtual_mutex = PTHREAD_MUTEX_INITIALIZER;
+static struct timespec qnd_virtual_now = { 1, 0 };
+
+static void QNF_VirtualNow(struct timespec *ts)
+{
+    pthread_mutex_lock(&qnd_virtual_mutex);
+    *ts = qnd_virtual_now;
+    pthread_mutex_unlock(&qnd_virtual_mutex);
+}
+
+static void QNF_VirtualAdvance(UINT32 usec)
+{
+    pthread_mutex_lock(&qnd_virtual_mutex);
+    qnd_virtual_now.tv_sec += usec / 1000000;
+    qnd_virtual_now.tv_nsec += (usec % 1000000) * 1000;
+    if (qnd_virtual_now.tv_nsec >= 1000000000)
+    {
+        qnd_virtual_now.tv_sec++;
+        qnd_virtual_now.tv_nsec -= 1000000000;
+    }
+    pthread_mutex_unlock(&qnd_virtual_mutex);
+}
+
+static void QNF_VirtualSleep(UINT32 usec)
+{
+    QNF_VirtualAdvance(usec);
+    /* let any other thread polling the chip have a turn */
+    sched_yield();
+}
+
+const qnd_clock_t qnd_virtual_clock = { "virtual", QNF_VirtualNow, QNF_VirtualSleep, QNF_VirtualAdvance };
+
+static const qnd_clock_t *qnd_clock = &qnd_real_clock;
+
+void QND_SetClock(const qnd_clock_t *clock)
+{
+    qnd_clock = clock;
+}
+
+const qnd_clock_t *QND_GetClock(void)
+{
+    return qnd_clock;
+}
+
+void QND_Now(struct timespec *ts)
+{
+    qnd_clock->now(ts);
+}
+
+void QND_Sleep(UINT32 usec)
+{
+    qnd_clock->sleep(usec);
+}
+
+void QND_Advance(UINT32 usec)
+{
+    if (qnd_clock->advance)
+        qnd_clock->advance(usec);
+}
+
+long QND_Elapsed(const struct timespec *since)
+{
+    struct timespec now;
+
+    qnd_clock->now(&now);
+    return (now.tv_sec - since->tv_sec) * 1000000 + (now.tv_nsec - since->tv_nsec) / 1000;
+}
+
+void QND_InvalidateRegs(void)
+{
+    UINT8 i;
+
+    pthread_mutex_lock(&qnd_shadow_mutex);
+    QNF_FlushLocked();
+    for (i = 0; i < QND_REG_COUNT; i++)
+        QNF_ShadowInvalidate(i);
+    pthread_mutex_unlock(&qnd_shadow_mutex);
+}
+
+UINT8 QND_WriteReg(UINT8 Regis_Addr,UINT8 Data)
+{
+    UINT8 ret;
+
+    pthread_mutex_lock(&qnd_shadow_mutex);
+    if (!qnd_shadow_ready)
+        QNF_ShadowSetup();
+
+    if (QNF_Cacheable(Regis_Addr, Data)) {
+        qnd_shadow[Regis_Addr] = Data;
+        qnd_shadow_flags[Regis_Addr] |= SHADOW_VALID;
+
+        if (qnd_batch_depth) {
+            if (!QNF_QueueLocked(Regis_Addr, Data)) {
+                QNF_FlushLocked();
+                QNF_QueueLocked(Regis_Addr, Data);
+            }
+            pthread_mutex_unlock(&qnd_shadow_mutex);
+            return 1;
+        }
+    }
+    else {
+        QNF_ShadowInvalidate(Regis_Addr);
+    }
+
+    /* commands go out straight away, after anything queued before them */
+    QNF_FlushLocked();
+
+    ret = QND_I2C_WRITE(Regis_Addr,Data);
+    if (!ret)
+        QNF_ShadowInvalidate(Regis_Addr);
+    QNF_ShadowNoteWrite(Regis_Addr, Data);
+    pthread_mutex_unlock(&qnd_shadow_mutex);
+
+    return ret;
+}
+
+UINT8 QND_ReadRegs(UINT8 Regis_Addr, UINT8 *buf, UINT8 n)
+{
+    UINT8 ret, i;
+
+    pthread_mutex_lock(&qnd_shadow_mutex);
+    if (!qnd_shadow_ready)
+        QNF_ShadowSetup();
+
+    QNF_FlushLocked();
+
+    ret = QND_I2C_NREAD(Regis_Addr, buf, n);
+
+    for (i = 0; i < n; i++) {
+        UINT8 reg = Regis_Addr + i;
+
+        if (ret && QNF_Cacheable(reg, buf[i])) {
+            qnd_shadow[reg] = buf[i];
+            qnd_shadow_flags[reg] |= SHADOW_VALID;
+        }
+    }
+    pthread_mutex_unlock(&qnd_shadow_mutex);
+
+    return ret;
+}
+
 UINT8 QND_ReadReg(UINT8 Regis_Addr)
 {
     UINT8 Data;
 
+    pthread_mutex_lock(&qnd_shadow_mutex);
+    if (!qnd_shadow_ready)
+        QNF_ShadowSetup();
 
+    if (QNF_ShadowCached(Regis_Addr)) {
+        Data = qnd_shadow[Regis_Addr];
+    }
+    else {
+        /* the chip has to see queued writes before it answers */
+        QNF_FlushLocked();
+
+        Data = QND_I2C_READ(Regis_Addr);
 
-	Data = QND_I2C_READ(Regis_Addr);
+        if (!qnd_i2c_timeout && QNF_Cacheable(Regis_Addr, Data)) {
+            qnd_shadow[Regis_Addr] = Data;
+            qnd_shadow_flags[Regis_Addr] |= SHADOW_VALID;
+        }
+    }
+    pthread_mutex_unlock(&qnd_shadow_mutex);
 
     return Data;
 }
@@ -158,7 +535,9 @@ UINT8 QND_I2C_WRITE(UINT8 Regis_Addr,UINT8 Data)
     UINT8 tryCount = I2C_TIMEOUT_COUNT;
 	qnd_i2c = 1;
     while(--tryCount) {
-        ret = I2C_Write_1byte(I2C_DEV0_ADDRESS, Regis_Addr, Data);
+        qnd_i2c_transfers++;
+        ret = qnd_bus->write(Regis_Addr, &Data, 1);
+        qnd_i2c_timeout = !ret;
         if(ret) break;
     }
     if(!tryCount) {
@@ -171,11 +550,12 @@ UINT8 QND_I2C_WRITE(UINT8 Regis_Addr,UINT8 Data)
 
 UINT8 QND_I2C_READ(UINT8 Regis_Addr)
 {
-    UINT8 ret;
+    UINT8 ret = 0;
     UINT8 tryCount = I2C_TIMEOUT_COUNT;
 	qnd_i2c = 1;
     while(--tryCount) {
-	ret = I2C_Read_1byte(I2C_DEV0_ADDRESS, Regis_Addr);
+        qnd_i2c_transfers++;
+        qnd_i2c_timeout = !qnd_bus->read(Regis_Addr, &ret, 1);
         if(!qnd_i2c_timeout) break;
     }
     if(!tryCount) {
@@ -191,7 +571,9 @@ UINT8 QND_I2C_NREAD(UINT8 Regis_Addr, UINT8 *buf, UINT8 n)
     UINT8 tryCount = I2C_TIMEOUT_COUNT;
     qnd_i2c = 1;
     while(--tryCount) {
-        ret = I2C_Read_nbyte(I2C_DEV0_ADDRESS, Regis_Addr, buf, n);
+        qnd_i2c_transfers++;
+        ret = qnd_bus->read(Regis_Addr, buf, n);
+        qnd_i2c_timeout = !ret;
         if(!qnd_i2c_timeout) break;
     }
     if(!tryCount) {
@@ -207,7 +589,9 @@ UINT8 QND_I2C_NWRITE(UINT8 Regis_Addr, UINT8 *buf, UINT8 n)
     UINT8 tryCount = I2C_TIMEOUT_COUNT;
     qnd_i2c = 1;
     while(--tryCount) {
-        ret = I2C_Write_nbyte(I2C_DEV0_ADDRESS, Regis_Addr, buf, n);
+        qnd_i2c_transfers++;
+        ret = qnd_bus->write(Regis_Addr, buf, n);
+        qnd_i2c_timeout = !ret;
         if(!qnd_i2c_timeout) break;
     }
     if(!tryCount) {
@@ -1,11 +1,19 @@
 
+#ifndef _QNIO_H__
 #define _QNIO_H__
 
+#include <time.h>
+
 /* modify this according to I2C device address when you use standard I2C function like I2C_XXXX except AI2C_XXXX*/
 #define I2C_DEV0_ADDRESS 0x56
 #define I2C_TIMEOUT_TIME    10
 #define I2C_TIMEOUT_COUNT    8
 #define MS_DELAY_CONST    40
+
+/* register shadow, see QND_BatchBegin() */
+#define QND_REG_COUNT     0x80   /* registers mirrored, 0x00..0x7f */
+#define QND_BURST_MAX     16     /* bytes in one queued write burst */
+#define QND_BURST_GAP     2      /* unwritten registers a burst may span, resent from the shadow */
 /************end*********************/
 
 
@@ -60,6 +68,62 @@ extern UINT8 ChipReset(UINT8 Slave) ;
 
 extern UINT8 QND_ReadReg(UINT8 adr);
 extern UINT8 QND_WriteReg(UINT8 adr, UINT8 value);
+/* read n consecutive registers in one auto-increment transfer; returns 0 on failure */
+extern UINT8 QND_ReadRegs(UINT8 adr, UINT8 *buf, UINT8 n);
+
+/* queue writes until the outermost QND_BatchEnd(), a bus read or QND_Delay() */
+extern void QND_BatchBegin(void);
+extern void QND_BatchEnd(void);
+/* send queued writes now */
+extern void QND_FlushRegs(void);
+/* forget the register shadow, e.g. after the chip lost power */
+extern void QND_InvalidateRegs(void);
+
+/* bus transfers attempted, for measurement */
+extern UINT32 qnd_i2c_transfers;
+
+/* bus backend: how the QND_I2C_ functions reach the chip */
+typedef struct _qnd_bus_t
+{
+    const char *name;
+    /* n consecutive registers, auto-incrementing; return 1 on success */
+    UINT8 (*read)(UINT8 reg, UINT8 *buf, UINT8 n);
+    UINT8 (*write)(UINT8 reg, UINT8 *buf, UINT8 n);
+    /* 1 if the rest of the board (PWM clock, audio mux) is really there */
+    UINT8 hardware;
+}
+qnd_bus_t;
+
+/* the QN8005 on /dev/i2c-0, the default */
+extern const qnd_bus_t qnd_i2c_dev_bus;
+
+/* switch backends; the register shadow is dropped */
+extern void QND_SetBus(const qnd_bus_t *bus);
+extern const qnd_bus_t *QND_GetBus(void);
+
+/* clock backend: what QND_Delay() and the driver's timed polls wait on */
+typedef struct _qnd_clock_t
+{
+    const char *name;
+    void (*now)(struct timespec *ts);
+    void (*sleep)(UINT32 usec);
+    /* time passing inside a simulated device, e.g. a bus transfer; NULL if it passes by itself */
+    void (*advance)(UINT32 usec);
+}
+qnd_clock_t;
+
+/* CLOCK_MONOTONIC and usleep(), the default */
+extern const qnd_clock_t qnd_real_clock;
+/* time only moves when slept or advanced, so waits cost nothing; for single threaded runs */
+extern const qnd_clock_t qnd_virtual_clock;
+
+extern void QND_SetClock(const qnd_clock_t *clock);
+extern const qnd_clock_t *QND_GetClock(void);
+extern void QND_Now(struct timespec *ts);
+extern void QND_Sleep(UINT32 usec);
+extern void QND_Advance(UINT32 usec);
+/* microseconds from since to now on the current clock */
+extern long QND_Elapsed(const struct timespec *since);
 
 
 
@@ -69,3 +133,4 @@ extern UINT8 QND_I2C_READ(UINT8 Regis_Addr);
 extern UINT8 QND_I2C_NREAD(UINT8 Regis_Addr, UINT8 *buf, UINT8 n);
 extern UINT8 QND_I2C_NWRITE(UINT8 Regis_Addr, UINT8 *buf, UINT8 n);
 
+#endif
@@ -0,0 +1,506 @@
+/*
+    qnsim.c
+
+    This file is part of chumbyradio.
+    Copyright (c) Chumby Industries, 2009
+
+    chumbyradio is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    chumbyradio is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with chumbyradio; if not, write to the Free Software
+    Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "qnsim.h"
+
+/*
+** The model only keeps what qndriver.c looks at: the register file, the
+** channel the receiver is on and the RDS group generator.  Writes land in
+** the register file and take effect at once: the receiver follows CH while
+** CCA_CH_DIS is set, a CHSC search lands on its channel straight away but
+** keeps CHSC set for QNS_CCA_CHANNEL_USEC per channel it passed, and SWRST
+** restores the power-on registers.  Reads of the measurement registers are
+** computed from the station on the current channel, or the strongest one
+** next to it.
+*/
+
+/* IF counter value the driver accepts as a carrier (1828 < ifcnt < 2268) */
+#define QNS_IFCNT_CARRIER   2048
+#define QNS_IFCNT_NOISE     0x1fff
+
+/* a byte on a 100 kHz bus, with its ack; what a transfer costs on the virtual clock */
+#define QNS_I2C_BYTE_USEC   90
+
+/* RSSIMP, multipath: below QND_MP_THRESHOLD-ish on a station */
+#define QNS_MP_STATION      0x10
+#define QNS_MP_NOISE        0x3f
+
+static pthread_mutex_t qns_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static UINT8 qns_regs[QND_REG_COUNT];
+static qns_station_t qns_stations[QNS_MAX_STATIONS];
+static int qns_station_count = 0;
+
+/* what the receiver is on */
+static UINT16 qns_freq = 0;
+static const qns_station_t *qns_tuned = NULL;
+
+/* RSSISIG off a station: QNS_NOISE_FLOOR, or what leaks over from a neighbour */
+static UINT8 qns_leakage = 0;
+
+/* the CHSC search in progress */
+static struct timespec qns_scan_start;
+static long qns_scan_usec = 0;
+
+/* RSSI jitter, so repeated readings aren't identical */
+static UINT32 qns_reads = 0;
+
+/* RDS group generator */
+static struct timespec qns_rds_due;
+static UINT32 qns_rds_group = 0;
+
+
+static const qns_station_t *QNS_StationAt(UINT16 freq)
+{
+    int i;
+
+    for (i = 0; i < qns_station_count; i++)
+    {
+        if (qns_stations[i].freq == freq)
+            return &qns_stations[i];
+    }
+    return NULL;
+}
+
+/* RSSISIG on a channel with no station of its own */
+static UINT8 QNS_Leakage(UINT16 freq)
+{
+    UINT8 rssi = 0;
+    int i;
+
+    for (i = 0; i < qns_station_count; i++)
+    {
+        int distance = (int)qns_stations[i].freq - (int)freq;
+
+        if (distance != 0 && abs(distance) <= QNS_ADJACENT_SPAN && qns_stations[i].rssi > rssi + QNS_ADJACENT_DB)
+            rssi = qns_stations[i].rssi - QNS_ADJACENT_DB;
+    }
+    return rssi;
+}
+
+/* the channel in CH and the top bits of CH_STEP, in 10 kHz units */
+static UINT16 QNS_Channel(void)
+{
+    UINT16 ch = ((qns_regs[CH_STEP] & CH_CH) << 8) | qns_regs[CH];
+    return CHREG2FREQ(ch);
+}
+
+static void QNS_Tune(UINT16 freq)
+{
+    UINT16 ch = FREQ2CHREG(freq);
+
+    qns_regs[CH] = (UINT8)ch;
+    qns_regs[CH_STEP] = (qns_regs[CH_STEP] & ~CH_CH) | ((ch >> 8) & CH_CH);
+    if (freq == qns_freq && qns_tuned == QNS_StationAt(freq))
+        return;
+    qns_freq = freq;
+    qns_tuned = QNS_StationAt(freq);
+    qns_leakage = QNS_Leakage(freq);
+
+    /* the RDS decoder needs a moment to sync to the new carrier */
+    QND_Now(&qns_rds_due);
+    qns_rds_group = 0;
+}
+
+/*
+ * CHSC without CCA_CH_DIS: search CH_START..CH_STOP for a carrier.  The
+ * driver programs RXCCAA with minrssi - 22 + db for a search whose RSSI
+ * test is minrssi + 6 + db, so the model reads it as a signed 5 bit offset
+ * from RSSISIG - 28.
+ */
+static void QNS_ChannelScan(void)
+{
+    static const UINT8 steps[4] = { 5, 10, 20, 10 };
+    int threshold = ((qns_regs[CCA] & RXCCAA) ^ 0x10) - 0x10 + 28;
+    UINT16 start = ((qns_regs[CH_STEP] & CH_CH_START) << 6) | qns_regs[CH_START];
+    UINT16 stop = ((qns_regs[CH_STEP] & CH_CH_STOP) << 4) | qns_regs[CH_STOP];
+    UINT16 step = steps[qns_regs[CH_STEP] >> 6];
+    UINT16 freq;
+
+    start = CHREG2FREQ(start);
+    stop = CHREG2FREQ(stop);
+
+    for (freq = start; freq <= stop; freq += step)
+    {
+        const qns_station_t *station = QNS_StationAt(freq);
+
+        if (station && station->rssi > threshold)
+            break;
+    }
+    if (freq > stop)
+        freq = stop;
+    QNS_Tune(freq);
+
+    QND_Now(&qns_scan_start);
+    qns_scan_usec = (long)((freq - start) / step + 1) * QNS_CCA_CHANNEL_USEC;
+}
+
+static void QNS_ResetRegs(void)
+{
+    memset(qns_regs, 0, sizeof(qns_regs));
+    qns_regs[SYSTEM1] = RXREQ | CCA_CH_DIS;
+    qns_regs[CID2] = CHIPID_QN8005;
+    qns_regs[STATUS1] = ST_MO_RX;
+    QNS_Tune(7600);
+}
+
+/* registers first..last were written */
+static void QNS_Written(UINT8 first, UINT8 last)
+{
+    if (first <= SYSTEM2 && last >= SYSTEM2)
+    {
+        if (qns_regs[SYSTEM2] & SWRST)
+            QNS_ResetRegs();
+        qns_regs[SYSTEM2] &= ~(SWRST | RECAL);
+    }
+
+    /* only SYSTEM1 and CH..CH_STEP move the receiver */
+    if (first > CH_STEP || (first > SYSTEM1 && last < CH))
+        return;
+    if ((qns_regs[SYSTEM1] & (CHSC | CCA_CH_DIS)) == CHSC)
+    {
+        QNS_ChannelScan();
+        return;
+    }
+    if (qns_regs[SYSTEM1] & CCA_CH_DIS)
+        QNS_Tune(QNS_Channel());
+    qns_regs[SYSTEM1] &= ~CHSC;
+}
+
+/* PI code for a North American callsign, see decode_callsign() */
+static UINT16 QNS_CallsignPI(const char *callsign)
+{
+    UINT16 base;
+    int i;
+
+    if (strlen(callsign) != 4)
+        return 0;
+    if (callsign[0] == 'K')
+        base = 4096;
+    else if (callsign[0] == 'W')
+        base = 21672;
+    else
+        return 0;
+    for (i = 1; i < 4; i++)
+    {
+        if (callsign[i] < 'A' || callsign[i] > 'Z')
+            return 0;
+    }
+    return base + (callsign[1] - 'A') * 676 + (callsign[2] - 'A') * 26 + (callsign[3] - 'A');
+}
+
+/* the programme service name is always eight characters, space padded */
+static UINT8 QNS_PSChar(const qns_station_t *station, int i)
+{
+    return (i < (int)strlen(station->ps)) ? (UINT8)station->ps[i] : ' ';
+}
+
+/* radiotext segments to send: up to and including the one with the end */
+static int QNS_RadiotextSegments(const qns_station_t *station)
+{
+    int length = strlen(station->radiotext);
+
+    if (length == 0)
+        return 0;
+    if (length >= 64)
+        return 16;
+    return length / 4 + 1;
+}
+
+/* a shorter radiotext ends in a carriage return, then spaces */
+static UINT8 QNS_RadiotextChar(const qns_station_t *station, int i)
+{
+    int length = strlen(station->radiotext);
+
+    if (i < length)
+        return (UINT8)station->radiotext[i];
+    return (i == length) ? '\r' : ' ';
+}
+
+/*
+** Load the next group of the station's cycle into RDSD0..RDSD7: the four
+** 0A programme service segments, the 2A radiotext segments, then a 4A
+** clock-time group.
+*/
+static void QNS_NextGroup(const qns_station_t *station)
+{
+    UINT16 block[4];
+    int segments = QNS_RadiotextSegments(station);
+    int cycle = 4 + segments + 1;
+    int n = qns_rds_group++ % cycle;
+    int i;
+
+    block[0] = QNS_CallsignPI(station->callsign);
+    block[1] = (station->pty & 0x1f) << 5;
+    if (n < 4)
+    {
+        /* 0A: music, no alternative frequencies */
+        block[1] |= 0x0008 | n;
+        block[2] = 0xe0cd;
+        block[3] = (QNS_PSChar(station, n * 2) << 8) | QNS_PSChar(station, n * 2 + 1);
+    }
+    else if (n < 4 + segments)
+    {
+        int at = (n - 4) * 4;
+
+        block[1] |= 0x2000 | (n - 4);
+        block[2] = (QNS_RadiotextChar(station, at) << 8) | QNS_RadiotextChar(station, at + 1);
+        block[3] = (QNS_RadiotextChar(station, at + 2) << 8) | QNS_RadiotextChar(station, at + 3);
+    }
+    else
+    {
+        time_t now = time(NULL);
+        struct tm utc;
+        UINT32 mjd;
+
+        gmtime_r(&now, &utc);
+        mjd = now / 86400 + 40587;
+        block[1] |= 0x4000 | ((mjd >> 15) & 0x3);
+        block[2] = ((mjd & 0x7fff) << 1) | ((utc.tm_hour >> 4) & 1);
+        block[3] = ((utc.tm_hour & 0xf) << 12) | (utc.tm_min << 6);
+    }
+
+    for (i = 0; i < 4; i++)
+    {
+        qns_regs[RDSD0 + i * 2] = block[i] >> 8;
+        qns_regs[RDSD0 + i * 2 + 1] = block[i] & 0xff;
+    }
+}
+
+/* STATUS3 is read: toggle RDS_RXUPD if a group has come in since */
+static void QNS_PollRDS(void)
+{
+    struct timespec now;
+    long late;
+
+    if (!(qns_regs[SYSTEM1] & RDSEN) || !qns_tuned || !QNS_CallsignPI(qns_tuned->callsign))
+    {
+        qns_regs[STATUS3] &= ~RDSSYNC;
+        return;
+    }
+    qns_regs[STATUS3] |= RDSSYNC;
+
+    late = QND_Elapsed(&qns_rds_due);
+    if (late < 0)
+        return;
+    QND_Now(&now);
+
+    QNS_NextGroup(qns_tuned);
+    qns_regs[STATUS3] ^= RDS_RXUPD;
+
+    /* groups the reader was too slow for are overwritten, as on the chip */
+    if (late > QNS_RDS_GROUP_USEC)
+        late = 0;
+    qns_rds_due = now;
+    qns_rds_due.tv_nsec += (QNS_RDS_GROUP_USEC - late) * 1000;
+    if (qns_rds_due.tv_nsec >= 1000000000)
+    {
+        qns_rds_due.tv_sec++;
+        qns_rds_due.tv_nsec -= 1000000000;
+    }
+}
+
+static UINT8 QNS_ReadOne(UINT8 reg)
+{
+    switch (reg)
+    {
+    case RSSISIG:
+        qns_reads++;
+        if (qns_tuned)
+            return qns_tuned->rssi + (qns_reads & 1);
+        if (qns_leakage > QNS_NOISE_FLOOR + 2)
+            return qns_leakage + (qns_reads & 1);
+        return QNS_NOISE_FLOOR + (qns_reads * 7) % 3;
+    case SYSTEM1:
+        if ((qns_regs[SYSTEM1] & CHSC) && QND_Elapsed(&qns_scan_start) >= qns_scan_usec)
+            qns_regs[SYSTEM1] &= ~CHSC;
+        return qns_regs[SYSTEM1];
+    case STATUS1:
+        if (qns_tuned && qns_tuned->stereo && !(qns_regs[SYSTEM1] & (TXREQ | STNBY)))
+            return qns_regs[STATUS1] & ~ST_MO_RX;
+        return qns_regs[STATUS1] | ST_MO_RX;
+    case STATUS3:
+        QNS_PollRDS();
+        return qns_regs[STATUS3];
+    case CCA4:
+        return (qns_tuned ? QNS_IFCNT_CARRIER : QNS_IFCNT_NOISE) & 0xff;
+    case CCA5:
+        return (qns_regs[CCA5] & ~0x1f) | (((qns_tuned ? QNS_IFCNT_CARRIER : QNS_IFCNT_NOISE) >> 8) & 0x1f);
+    case RSSIMP:
+        return qns_tuned ? QNS_MP_STATION : QNS_MP_NOISE;
+    default:
+        return qns_regs[reg];
+    }
+}
+
+static UINT8 QNS_BusRead(UINT8 reg, UINT8 *buf, UINT8 n)
+{
+    UINT8 i;
+
+    if (reg + n > QND_REG_COUNT)
+        return 0;
+    /* address, register, address again, then the data */
+    QND_Advance((3 + n) * QNS_I2C_BYTE_USEC);
+    pthread_mutex_lock(&qns_mutex);
+    for (i = 0; i < n; i++)
+        buf[i] = QNS_ReadOne(reg + i);
+    pthread_mutex_unlock(&qns_mutex);
+    return 1;
+}
+
+static UINT8 QNS_BusWrite(UINT8 reg, UINT8 *buf, UINT8 n)
+{
+    if (reg + n > QND_REG_COUNT)
+        return 0;
+    QND_Advance((2 + n) * QNS_I2C_BYTE_USEC);
+    pthread_mutex_lock(&qns_mutex);
+    memcpy(&qns_regs[reg], buf, n);
+    QNS_Written(reg, reg + n - 1);
+    pthread_mutex_unlock(&qns_mutex);
+    return 1;
+}
+
+const qnd_bus_t qns_bus = { "qnsim", QNS_BusRead, QNS_BusWrite, 0 };
+
+void QNS_Reset(void)
+{
+    pthread_mutex_lock(&qns_mutex);
+    qns_station_count = 0;
+    QNS_ResetRegs();
+    pthread_mutex_unlock(&qns_mutex);
+}
+
+int QNS_AddStation(const qns_station_t *station)
+{
+    int ret = -1;
+
+    pthread_mutex_lock(&qns_mutex);
+    if (qns_station_count < QNS_MAX_STATIONS)
+    {
+        qns_stations[qns_station_count++] = *station;
+        qns_tuned = QNS_StationAt(qns_freq);
+        ret = 0;
+    }
+    pthread_mutex_unlock(&qns_mutex);
+    return ret;
+}
+
+const qns_station_t *QNS_GetStation(int index)
+{
+    const qns_station_t *station = NULL;
+
+    pthread_mutex_lock(&qns_mutex);
+    if (index >= 0 && index < qns_station_count)
+        station = &qns_stations[index];
+    pthread_mutex_unlock(&qns_mutex);
+    return station;
+}
+
+void QNS_DefaultScene(void)
+{
+    static const qns_station_t scene[] =
+    {
+        {  8850, 38, 1, "KQED", 3,  "KQED",     "" },
+        {  8950, 31, 0, "",     0,  "",         "" },
+        {  9770, 52, 1, "KCBS", 4,  "KCBS FM",  "Now playing: Take It Easy by Eagles" },
+        { 10130, 47, 1, "KFOG", 5,  "KFOG 104", "World class rock on KFOG" },
+        { 10290, 27, 0, "",     0,  "",         "" },
+        { 10450, 44, 1, "KBLX", 12, "KBLX",     "" },
+        { 10690, 35, 1, "KBRG", 10, "KBRG",     "La Kalle" },
+    };
+    unsigned int i;
+
+    QNS_Reset();
+    for (i = 0; i < sizeof(scene) / sizeof(scene[0]); i++)
+        QNS_AddStation(&scene[i]);
+}
+
+/* Copy a scene field into a station, cut to fit and always terminated. */
+static void QNS_CopyField(char *field, size_t size, const char *text)
+{
+    size_t length = strnlen(text, size - 1);
+
+    memcpy(field, text, length);
+    field[length] = '\0';
+}
+
+int QNS_LoadScene(const char *path)
+{
+    FILE *file;
+    char line[256];
+    int count = 0;
+
+    file = fopen(path, "r");
+    if (!file)
+    {
+        perror("Unable to open scene");
+        return -1;
+    }
+
+    QNS_Reset();
+    while (fgets(line, sizeof(line), file))
+    {
+        qns_station_t station;
+        char callsign[16], ps[16];
+        double mhz;
+        int rssi, stereo, pty, used = 0;
+        char *c;
+
+        if (line[0] == '#' || line[0] == '\n')
+            continue;
+        if ((c = strchr(line, '\n')) != NULL)
+            *c = '\0';
+        if (sscanf(line, "%lf %d %d %15s %d %15s %n", &mhz, &rssi, &stereo, callsign, &pty, ps, &used) < 6)
+        {
+            fprintf(stderr, "Ignoring scene line \"%s\"\n", line);
+            continue;
+        }
+
+        memset(&station, 0, sizeof(station));
+        station.freq = (UINT16)(mhz * 100 + 0.5);
+        station.rssi = rssi;
+        station.stereo = !!stereo;
+        station.pty = pty;
+        if (strcmp(callsign, "-"))
+            QNS_CopyField(station.callsign, sizeof(station.callsign), callsign);
+        if (strcmp(ps, "-"))
+            QNS_CopyField(station.ps, sizeof(station.ps), ps);
+        for (c = station.ps; *c; c++)
+        {
+            if (*c == '_')
+                *c = ' ';
+        }
+        if (used)
+            QNS_CopyField(station.radiotext, sizeof(station.radiotext), line + used);
+
+        if (QNS_AddStation(&station) == 0)
+            count++;
+    }
+    fclose(file);
+
+    return count;
+}
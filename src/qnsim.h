@@ -0,0 +1,72 @@
+/*
+ * qnsim.h
+ *
+ * (c) Copyright Chumby Industries, 2009
+ * All rights reserved
+ *
+ * This header declares an in-process model of the QN8005 that can stand in
+ * for the chip on /dev/i2c-0.  It plays back a configurable RF scene, a
+ * list of stations with a signal strength, a stereo pilot and RDS data, and
+ * answers the channel, CCA, status and RDS registers the way qndriver.c
+ * expects, so the daemon can be run and measured without the hardware.
+ */
+
+#ifndef _QNSIM_H__
+#define _QNSIM_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "qndriver.h"
+#include "qnio.h"
+
+#define QNS_MAX_STATIONS    64
+#define QNS_NOISE_FLOOR     14      /* RSSISIG between stations */
+#define QNS_RDS_GROUP_USEC  87600   /* 1187.5 bps / 104 bits per group */
+#define QNS_CCA_CHANNEL_USEC 2500   /* a CHSC search, per channel; assumed, not from the datasheet */
+#define QNS_ADJACENT_SPAN   20      /* a station shows on channels this close, in 10 kHz units... */
+#define QNS_ADJACENT_DB     20      /* ...this much weaker, but with no carrier for CCA */
+
+/* one transmitter in the scene */
+typedef struct _qns_station_t
+{
+    UINT16 freq;            /* in 10 kHz units, e.g. 10130 */
+    UINT8  rssi;            /* RSSISIG while tuned to it */
+    UINT8  stereo;          /* 1 if it sends the stereo pilot */
+    char   callsign[5];     /* "K..." or "W...", sent as the RDS PI code; "" for no RDS */
+    UINT8  pty;             /* RDS programme type, 0..31 */
+    char   ps[9];           /* RDS programme service name */
+    char   radiotext[65];   /* RDS radiotext */
+}
+qns_station_t;
+
+/* the model, as a bus backend for QND_SetBus() */
+extern const qnd_bus_t qns_bus;
+
+/* power-on registers and an empty scene */
+extern void QNS_Reset(void);
+
+/* returns 0, or -1 if the scene is full */
+extern int QNS_AddStation(const qns_station_t *station);
+
+/* returns station index of the scene, or NULL past the end */
+extern const qns_station_t *QNS_GetStation(int index);
+
+/* a few stations across the US band, some with RDS */
+extern void QNS_DefaultScene(void);
+
+/*
+ * Replace the scene with the stations in a file, one per line:
+ *   <MHz> <rssi> <stereo> <callsign|-> <pty> <ps|-> [radiotext]
+ * An '_' in the programme service name stands for a space, and lines
+ * starting with '#' are comments.  Returns the number of stations, or -1
+ * if the file can't be read.
+ */
+extern int QNS_LoadScene(const char *path);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif